@@ -0,0 +1,190 @@
+#include "AgentChannel.h"
+
+#include <atomic>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+AgentChannel::~AgentChannel()
+{
+	if (m_shared)
+	{
+		munmap(m_shared, sizeof(AgentShared));
+		shm_unlink(m_name.c_str());
+	}
+}
+
+bool AgentChannel::create(std::string& name)
+{
+	//macOS下共享内存的名字最长31个字符
+	static std::atomic<int> counter(0);
+	m_name = "/saber" + std::to_string(getpid()) + "_" + std::to_string(counter++);
+	int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		return false;
+	}
+	if (ftruncate(fd, sizeof(AgentShared)) != 0)
+	{
+		close(fd);
+		shm_unlink(m_name.c_str());
+		return false;
+	}
+	auto shared = mmap(nullptr, sizeof(AgentShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED)
+	{
+		shm_unlink(m_name.c_str());
+		return false;
+	}
+
+	//新建的共享内存内容为0,hook都是Free
+	m_shared = (AgentShared*)shared;
+	m_shared->magic = agentMagic;
+	name = m_name;
+	return true;
+}
+
+bool AgentChannel::agentLoaded() const
+{
+	return m_shared && m_shared->agentPid.load(std::memory_order_acquire) != 0;
+}
+
+AgentHook* AgentChannel::findHook(uint64_t address) const
+{
+	for (auto& hook : m_shared->hooks)
+	{
+		if (hook.state.load(std::memory_order_acquire) != (uint32_t)AgentHookState::Free && hook.address == address)
+		{
+			return &hook;
+		}
+	}
+	return nullptr;
+}
+
+bool AgentChannel::install(uint64_t address)
+{
+	if (!m_shared || findHook(address))
+	{
+		return false;
+	}
+	for (auto& hook : m_shared->hooks)
+	{
+		if (hook.state.load(std::memory_order_acquire) == (uint32_t)AgentHookState::Free)
+		{
+			hook.address = address;
+			hook.trampoline = 0;
+			hook.hits.store(0, std::memory_order_relaxed);
+			hook.state.store((uint32_t)AgentHookState::Install, std::memory_order_release);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool AgentChannel::remove(uint64_t address)
+{
+	if (!m_shared)
+	{
+		return false;
+	}
+	auto hook = findHook(address);
+	if (!hook)
+	{
+		return false;
+	}
+	//agent只会把Install改为Installed/Failed,失败时重新读取状态
+	for (;;)
+	{
+		auto state = hook->state.load(std::memory_order_acquire);
+		if (state == (uint32_t)AgentHookState::Remove || state == (uint32_t)AgentHookState::Free)
+		{
+			return true;
+		}
+		if (hook->state.compare_exchange_weak(state, (uint32_t)AgentHookState::Remove, std::memory_order_acq_rel))
+		{
+			return true;
+		}
+	}
+}
+
+AgentHookState AgentChannel::state(uint64_t address) const
+{
+	if (!m_shared)
+	{
+		return AgentHookState::Free;
+	}
+	auto hook = findHook(address);
+	return hook ? (AgentHookState)hook->state.load(std::memory_order_acquire) : AgentHookState::Free;
+}
+
+uint64_t AgentChannel::hits(uint64_t address) const
+{
+	if (!m_shared)
+	{
+		return 0;
+	}
+	auto hook = findHook(address);
+	return hook ? hook->hits.load(std::memory_order_relaxed) : 0;
+}
+
+bool AgentChannel::overlaps(uint64_t address, uint64_t size) const
+{
+	if (!m_shared)
+	{
+		return false;
+	}
+	for (auto const& hook : m_shared->hooks)
+	{
+		//Remove状态的hook可能还没有被agent恢复
+		auto state = (AgentHookState)hook.state.load(std::memory_order_acquire);
+		if (state != AgentHookState::Free && state != AgentHookState::Failed
+			&& hook.address < address + size && address < hook.address + agentRelocateSpan)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::size_t AgentChannel::drain(std::vector<AgentRecord>& records, uint64_t& dropped)
+{
+	if (!m_shared)
+	{
+		return 0;
+	}
+
+	auto head = m_shared->head.load(std::memory_order_acquire);
+	if (head - m_tail > agentRecordCount)
+	{
+		dropped += head - agentRecordCount - m_tail;
+		m_tail = head - agentRecordCount;
+	}
+
+	std::size_t count = 0;
+	for (; m_tail != head; ++m_tail)
+	{
+		//sequence最后写入,读取字段前后各检查一次,中途被覆盖时丢弃
+		auto& slot = m_shared->records[m_tail & (agentRecordCount - 1)];
+		auto sequence = __atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE);
+		if (sequence < m_tail + 1)
+		{
+			break;
+		}
+		AgentRecord record;
+		record.address = __atomic_load_n(&slot.address, __ATOMIC_RELAXED);
+		record.caller = __atomic_load_n(&slot.caller, __ATOMIC_RELAXED);
+		record.thread = __atomic_load_n(&slot.thread, __ATOMIC_RELAXED);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence != m_tail + 1 || __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != sequence)
+		{
+			++dropped;
+			continue;
+		}
+		record.sequence = sequence;
+		records.emplace_back(record);
+		++count;
+	}
+	return count;
+}
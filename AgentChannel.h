@@ -0,0 +1,46 @@
+#pragma once
+
+#include "AgentProtocol.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//调试器一端的agent共享内存,创建后把名字通过环境变量传给调试目标中的agent
+//hook的安装和移除由agent异步完成,命中记录可以在任何线程中读取,不需要调试目标停下
+class AgentChannel
+{
+public:
+	AgentChannel() = default;
+	~AgentChannel();
+	AgentChannel(AgentChannel const&) = delete;
+	AgentChannel& operator=(AgentChannel const&) = delete;
+
+	//创建共享内存,name为需要传给agent的名字
+	bool create(std::string& name);
+	bool isOpen() const { return m_shared != nullptr; }
+	//agent已经映射了共享内存
+	bool agentLoaded() const;
+
+	//写入安装请求,没有空闲的hook时返回false
+	bool install(uint64_t address);
+	bool remove(uint64_t address);
+	//没有对应的hook时返回Free
+	AgentHookState state(uint64_t address) const;
+	//跳板计数的命中次数,调试目标运行时也是准确的
+	uint64_t hits(uint64_t address) const;
+	//[address, address + size)和已安装或者等待安装/移除的hook搬移的范围重叠
+	bool overlaps(uint64_t address, uint64_t size) const;
+
+	//取出上次读取之后的命中记录,追加到records后面,dropped加上被覆盖没有读到的记录数
+	//还没有写完的记录留到下次读取
+	std::size_t drain(std::vector<AgentRecord>& records, uint64_t& dropped);
+
+private:
+	AgentHook* findHook(uint64_t address) const;
+
+	AgentShared* m_shared = nullptr;
+	std::string m_name;
+	//下一条要读取的记录的序号
+	uint64_t m_tail = 0;
+};
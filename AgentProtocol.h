@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//调试器(AgentChannel)和注入到调试目标中的agent(SaberAgent.cpp)共享的内存布局,不依赖Qt
+//调试器创建共享内存,名字通过环境变量传给agent; agent在被hook的函数入口写入命中记录,调试器直接读取,不经过调试异常
+
+#define SABER_AGENT_SHM_ENV "SABER_AGENT_SHM"
+
+static const uint32_t agentMagic = 0x52424153; //"SABR"
+static const int agentMaxHooks = 64;
+//hook写入的jmp rel32的长度
+static const int agentPatchSize = 5;
+//agent搬移覆盖到的整条指令,最后一条从address + agentPatchSize - 1开始,最长15字节
+//这个范围内的0xCC会被复制到跳板中,调试器不能在其中设置软件断点
+static const int agentRelocateSpan = agentPatchSize - 1 + 15;
+//命中记录的个数,必须是2的幂
+static const uint64_t agentRecordCount = 1 << 16;
+
+enum class AgentHookState : uint32_t
+{
+	//调试器写入Install和Remove, agent写入其他状态
+	Free,
+	Install,
+	Installed,
+	Failed,
+	Remove,
+};
+
+struct AgentHook
+{
+	std::atomic<uint32_t> state;
+	uint32_t reserved;
+	uint64_t address;
+	//跳板的地址,安装成功后由agent写入
+	uint64_t trampoline;
+	//跳板中用lock inc递增的命中次数,不会像记录一样被覆盖,调试器写入Install前清零
+	std::atomic<uint64_t> hits;
+};
+
+//跳板中的机器码直接写入各字段,修改时要同时修改SaberAgent.cpp中的跳板
+struct AgentRecord
+{
+	//写入完成后最后写入,为记录的序号加1,读取时用来判断记录是否完整
+	uint64_t sequence;
+	uint64_t address;
+	//函数入口处栈顶的返回地址
+	uint64_t caller;
+	//线程的fs:[0](macOS下为gs:[0]),即pthread_self()
+	uint64_t thread;
+};
+
+struct AgentShared
+{
+	//下一条记录的序号,跳板中用lock xadd递增,必须在偏移0处,单独占一个cache line
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) uint32_t magic;
+	//agent映射共享内存后写入调试目标的pid
+	std::atomic<uint32_t> agentPid;
+	AgentHook hooks[agentMaxHooks];
+	//环形缓冲区,写满后覆盖最旧的记录
+	alignas(64) AgentRecord records[agentRecordCount];
+};
+
+static_assert(sizeof(AgentRecord) == 32, "跳板中按32字节计算记录的地址");
+static_assert(offsetof(AgentShared, head) == 0, "跳板中递增偏移0处的head");
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "跳板中把head和hits当做普通的8字节整数");
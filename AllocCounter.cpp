@@ -0,0 +1,167 @@
+#include "AllocCounter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+static thread_local uint64_t allocations = 0;
+
+uint64_t threadAllocations()
+{
+	return allocations;
+}
+
+#ifdef __GLIBC__
+
+//替换glibc的malloc,计数后交给glibc原来的实现, operator new也会调用到这里
+extern "C"
+{
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* p, size_t size);
+
+void* malloc(size_t size)
+{
+	++allocations;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+	++allocations;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size)
+{
+	++allocations;
+	return __libc_realloc(p, size);
+}
+}
+
+#else
+
+//macOS下替换malloc需要malloc zone,这里只替换operator new
+//所有形式的new都替换,否则标准库的默认实现和这里的delete不一定配对
+void* operator new(std::size_t size)
+{
+	++allocations;
+	if (auto p = std::malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+	++allocations;
+	return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept
+{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::nothrow_t const&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::nothrow_t const&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+#ifdef __cpp_aligned_new
+//对齐的分配用aligned_alloc,大小必须是对齐的整数倍
+static void* alignedAlloc(std::size_t size, std::align_val_t align)
+{
+	++allocations;
+	auto alignment = std::max<std::size_t>((std::size_t)align, sizeof(void*));
+	size = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment;
+	return std::aligned_alloc(alignment, size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+	if (auto p = alignedAlloc(size, align))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+	return operator new(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, std::nothrow_t const&) noexcept
+{
+	return alignedAlloc(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, std::nothrow_t const&) noexcept
+{
+	return alignedAlloc(size, align);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t, std::nothrow_t const&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, std::nothrow_t const&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+	std::free(p);
+}
+#endif
+
+#endif
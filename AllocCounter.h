@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+//当前线程分配内存的次数,用于确认调试线程处理异常时没有分配内存
+//替换了malloc和operator new,只在CMake选项SABER_COUNT_ALLOCATIONS打开时编译进Saber,默认返回0
+//Linux(glibc)下统计malloc/calloc/realloc,包括QString等直接调用malloc的分配; macOS下只统计operator new
+#ifdef SABER_COUNT_ALLOCATIONS
+uint64_t threadAllocations();
+#else
+inline uint64_t threadAllocations()
+{
+	return 0;
+}
+#endif
@@ -11,7 +11,9 @@
 
 #include <sys/time.h>
 #include <unistd.h>
+#ifdef __APPLE__
 #include <libproc.h>
+#endif
 
 AttachProcessList::AttachProcessList(QWidget *parent)
 	:QDialog(parent)
@@ -47,6 +49,7 @@ AttachProcessList::AttachProcessList(QWidget *parent)
 
 	refresh();
 }
+#ifdef __APPLE__
 void AttachProcessList::refresh()
 {
 	int num = proc_listallpids(nullptr, 0);
@@ -87,3 +90,30 @@ void AttachProcessList::refresh()
 		table_->setItem(i, 1, new QTableWidgetItem(path));
 	}
 }
+#else
+void AttachProcessList::refresh()
+{
+	//Linux下从/proc中枚举进程
+	QDir proc("/proc");
+	auto entries = proc.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+	std::vector<pid_t> pids;
+	for (auto const& entry : entries)
+	{
+		bool ok = false;
+		auto pid = (pid_t)entry.toInt(&ok);
+		if (ok && pid != 0)
+		{
+			pids.push_back(pid);
+		}
+	}
+	std::sort(pids.begin(), pids.end());
+
+	table_->setRowCount(pids.size());
+	for (std::size_t i = 0; i < pids.size(); ++i)
+	{
+		table_->setItem(i, 0, new QTableWidgetItem(QString::number(pids[i])));
+		auto path = QFile::symLinkTarget(QString("/proc/%1/exe").arg(pids[i]));
+		table_->setItem(i, 1, new QTableWidgetItem(path));
+	}
+}
+#endif
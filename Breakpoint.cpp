@@ -16,20 +16,40 @@ bool Breakpoint::setEnabled(bool enabled)
 {
 	auto _ = finally([] { emit EventDispatcher::instance()->breakpointChanged(); });
 
-    log(QString("bp set enabled: %1").arg(enabled));
+    logLazy(LogType::Debug, [enabled] { return QString("bp set enabled: %1").arg(enabled); });
     if (enabled == m_enabled)
     {
         return true;
     }
 
+	//硬件断点不修改内存,由DebugCore分配调试寄存器
+	if (m_isHardware)
+	{
+		if (!m_debugCore->setHardwareBreakpoint(this, enabled))
+		{
+			return false;
+		}
+
+		m_enabled = enabled;
+		return true;
+	}
+
     if (enabled)
     {
-        bool r = m_debugCore->readMemory(m_address, &m_orgByte, 1, false);
+        //跟踪点移除时agent恢复的原始数据会覆盖0xCC
+        if (m_debugCore->overlapsTracepoint(m_address))
+        {
+            return false;
+        }
+
+        uint8_t orgByte;
+        bool r = m_debugCore->readMemory(m_address, &orgByte, 1, false);
         if (!r)
         {
             log(QString("无法启用断点 %1：readMemory()失败。").arg(QString::number(m_address, 16)), LogType::Warning);
             return false;
         }
+        m_orgByte = orgByte;
         r = m_debugCore->writeMemory(m_address, &bpData, 1, false);
         if (!r)
         {
@@ -41,7 +61,7 @@ bool Breakpoint::setEnabled(bool enabled)
         return true;
     }
 
-    log("disable bp");
+    logLazy(LogType::Debug, [] { return QString("disable bp"); });
     uint8_t tmp;
     bool r = m_debugCore->readMemory(m_address, &tmp, 1, false);
     if (!r)
@@ -56,7 +76,8 @@ bool Breakpoint::setEnabled(bool enabled)
                                    LogType::Warning);
     }
 
-    r = m_debugCore->writeMemory(m_address, &m_orgByte, 1, false);
+    uint8_t orgByte = m_orgByte;
+    r = m_debugCore->writeMemory(m_address, &orgByte, 1, false);
     if (!r)
     {
         log(QString("无法禁用断点 %1：writeMemory()失败。").arg(QString::number(m_address, 16)), LogType::Warning);
@@ -67,6 +88,88 @@ bool Breakpoint::setEnabled(bool enabled)
     return true;
 }
 
+bool Breakpoint::setCondition(QString const& text, QString& error)
+{
+	std::shared_ptr<Expression> condition;
+	if (!text.trimmed().isEmpty())
+	{
+		condition = std::make_shared<Expression>();
+		if (!condition->compile(text.trimmed(), error))
+		{
+			return false;
+		}
+	}
+
+	std::atomic_store(&m_condition, std::shared_ptr<const Expression>(condition));
+	m_hitCount = 0;
+	emit EventDispatcher::instance()->breakpointChanged();
+	return true;
+}
+
+QString Breakpoint::condition() const
+{
+	auto condition = std::atomic_load(&m_condition);
+	return condition ? condition->text() : QString();
+}
+
+bool Breakpoint::setLogMessage(QString const& text, QString& error)
+{
+	std::shared_ptr<LogFormat> logFormat;
+	if (!text.isEmpty())
+	{
+		logFormat = std::make_shared<LogFormat>();
+		if (!logFormat->compile(text, error))
+		{
+			return false;
+		}
+	}
+
+	std::atomic_store(&m_logFormat, std::shared_ptr<const LogFormat>(logFormat));
+	emit EventDispatcher::instance()->breakpointChanged();
+	return true;
+}
+
+QString Breakpoint::logMessage() const
+{
+	auto logFormat = std::atomic_load(&m_logFormat);
+	return logFormat ? logFormat->text() : QString();
+}
+
+bool Breakpoint::shouldBreak(ThreadState const& state)
+{
+	auto hits = ++m_hitCount;
+	auto readMemory = [this](uint64_t address, void* buffer, uint64_t size)
+	{
+		return m_debugCore->readMemory(address, buffer, size);
+	};
+	auto readVector = [this](int index, int offset, int size, uint64_t& value)
+	{
+		return m_debugCore->readVectorRegister(m_debugCore->excInfo().threadId, index, offset, size, value);
+	};
+
+	auto condition = std::atomic_load(&m_condition);
+	uint64_t result;
+	if (condition && !condition->evaluate(state, hits, readMemory, readVector, result))
+	{
+		log(QString("断点 0x%1 的条件 %2 求值失败").arg(m_address, 0, 16).arg(condition->text()), LogType::Warning);
+		return true;
+	}
+	if (condition && !result)
+	{
+		return false;
+	}
+
+	//log只是放入LogQueue,由输出窗口定时批量显示
+	auto logFormat = std::atomic_load(&m_logFormat);
+	if (logFormat)
+	{
+		log(logFormat->format(state, hits, readMemory, readVector));
+		return false;
+	}
+
+	return true;
+}
+
 Breakpoint::~Breakpoint()
 {
     setEnabled(false);
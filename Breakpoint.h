@@ -2,12 +2,25 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
+#include <memory>
+
+#include "Common.h"
+#include "Expression.h"
 
 class DebugCore;
 
 class Breakpoint
 {
 public:
+	//硬件断点的触发条件,取值与DR7中的R/W位一致
+	enum class HardwareType
+	{
+		Execute = 0,
+		Write = 1,
+		ReadWrite = 3,
+	};
+
     Breakpoint(DebugCore* debugCore);
 	~Breakpoint();
     Breakpoint(const Breakpoint&) = delete;
@@ -45,6 +58,31 @@ public:
         return m_isHardware;
     }
 
+	HardwareType hardwareType() const
+	{
+		return m_hardwareType;
+	}
+
+	//监视的字节数,软件断点为1
+	int size() const
+	{
+		return m_size;
+	}
+
+	//在启用之前设置
+	void setHardware(HardwareType type, int size)
+	{
+		m_isHardware = true;
+		m_hardwareType = type;
+		m_size = size;
+	}
+
+	//执行到address时触发,软件断点和硬件执行断点
+	bool isExecute() const
+	{
+		return !m_isHardware || m_hardwareType == HardwareType::Execute;
+	}
+
 	bool isOneTime()
 	{
 		return m_oneTime;
@@ -55,14 +93,41 @@ public:
 		m_oneTime = oneTime;
 	}
 
+	//text为空时删除条件,编译失败时返回false且原来的条件不变,设置后命中次数清零
+	bool setCondition(QString const& text, QString& error);
+	QString condition() const;
+	uint64_t hitCount() const
+	{
+		return m_hitCount;
+	}
+
+	//设置日志点的消息格式,命中且满足条件时输出消息后继续运行,text为空时恢复为普通断点
+	bool setLogMessage(QString const& text, QString& error);
+	QString logMessage() const;
+
+	//在调试线程中命中时调用,计数并求值条件,state的rip为断点地址,求值失败时也停下
+	//日志点在这里输出消息,总是返回false
+	bool shouldBreak(ThreadState const& state);
+
 	static const uint8_t bpData;
 private:
+	//DebugCore::setBreakpoints批量修改内存后直接设置状态
+	friend class DebugCore;
+
     uint64_t m_address = 0;
-    uint8_t m_orgByte = 0;
+	//反汇编线程在DebugCore::readMemory中读取
+	std::atomic<uint8_t> m_orgByte{0};
     bool m_enabled = false;
     bool m_isHardware = false;
+	HardwareType m_hardwareType = HardwareType::Execute;
+	int m_size = 1;
     bool m_oneTime = false;
 
+	//界面线程修改条件时调试线程可能正在求值,整体替换
+	std::shared_ptr<const Expression> m_condition;
+	std::shared_ptr<const LogFormat> m_logFormat;
+	std::atomic<uint64_t> m_hitCount{0};
+
     DebugCore* m_debugCore;
 };
 
@@ -20,11 +20,23 @@ public:
 		m_address = new QLineEdit(this);
 		m_address->setValidator(new QRegExpValidator(QRegExp("[0-9a-fA-F]{1,16}"), m_address));
 		flay->addRow("地址", m_address);
+		m_type = new QComboBox(this);
+		m_type->addItems(QStringList() << "软件断点" << "硬件执行" << "硬件写入" << "硬件读写");
+		flay->addRow("类型", m_type);
+		m_size = new QComboBox(this);
+		m_size->addItems(QStringList() << "1" << "2" << "4" << "8");
+		flay->addRow("长度", m_size);
 		m_enabled = new QCheckBox(this);
 		m_enabled->setChecked(true);
 		flay->addRow("激活", m_enabled);
 		m_oneTime = new QCheckBox(this);
 		flay->addRow("一次性", m_oneTime);
+		m_condition = new QLineEdit(this);
+		m_condition->setPlaceholderText("例如 rcx == 5 && dword [rsp+8] != 0");
+		flay->addRow("条件", m_condition);
+		m_logMessage = new QLineEdit(this);
+		m_logMessage->setPlaceholderText("不为空时只输出日志不停下,例如 n = {rdi:d}");
+		flay->addRow("日志", m_logMessage);
 
 		auto btnBox = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, this);
 		vlay->addWidget(btnBox);
@@ -34,19 +46,57 @@ public:
 	}
 
 	uint64_t address(){ return m_address->text().toULongLong(nullptr, 16); }
+	bool isHardware(){ return m_type->currentIndex() != 0; }
+	Breakpoint::HardwareType hardwareType()
+	{
+		static const Breakpoint::HardwareType types[] =
+		{
+			Breakpoint::HardwareType::Execute,
+			Breakpoint::HardwareType::Execute,
+			Breakpoint::HardwareType::Write,
+			Breakpoint::HardwareType::ReadWrite,
+		};
+		return types[m_type->currentIndex()];
+	}
+	int size(){ return m_size->currentText().toInt(); }
 	bool enabled(){ return m_enabled->isChecked(); }
 	bool oneTime(){ return m_oneTime->isChecked(); }
+	QString condition(){ return m_condition->text(); }
+	QString logMessage(){ return m_logMessage->text(); }
 
 private:
 	QLineEdit* m_address;
+	QComboBox* m_type;
+	QComboBox* m_size;
 	QCheckBox* m_enabled;
 	QCheckBox* m_oneTime;
+	QLineEdit* m_condition;
+	QLineEdit* m_logMessage;
 };
 
+static QString breakpointType(Breakpoint const& bp)
+{
+	if (!bp.isHardware())
+	{
+		return "软件";
+	}
+
+	switch (bp.hardwareType())
+	{
+	case Breakpoint::HardwareType::Execute:
+		return "硬件执行";
+	case Breakpoint::HardwareType::Write:
+		return QString("硬件写入 %1字节").arg(bp.size());
+	case Breakpoint::HardwareType::ReadWrite:
+		return QString("硬件读写 %1字节").arg(bp.size());
+	}
+	return QString();
+}
+
 BreakpointView::BreakpointView(QWidget *parent)
-	: QTableWidget(0, 3, parent)
+	: QTableWidget(0, 7, parent)
 {
-	setHorizontalHeaderLabels(QStringList() << "地址" << "是否激活" << "一次性");
+	setHorizontalHeaderLabels(QStringList() << "地址" << "是否激活" << "一次性" << "条件" << "命中次数" << "日志" << "类型");
 	setSelectionBehavior(QAbstractItemView::SelectRows);
 	setEditTriggers(QAbstractItemView::NoEditTriggers);
 
@@ -74,6 +124,58 @@ BreakpointView::BreakpointView(QWidget *parent)
 			QMessageBox::warning(this, "错误", "设置失败");
 		}
 	});
+	m_menu->addAction("设置条件", [this]
+	{
+		auto debugCore = m_debugCore.lock();
+		if (!debugCore)
+		{
+			QMessageBox::information(this, "提示", "请先启动调试");
+			return;
+		}
+
+		auto address = getSel();
+		if (address == 0)
+		{
+			QMessageBox::information(this, "提示", "请先选择一个断点");
+			return;
+		}
+		auto bp = debugCore->findBreakpoint(address);
+
+		bool ok;
+		auto text = QInputDialog::getText(this, "设置条件", "条件(为空时总是停下):", QLineEdit::Normal, bp->condition(), &ok);
+		QString error;
+		if (ok && !bp->setCondition(text, error))
+		{
+			QMessageBox::warning(this, "错误", "条件错误: " + error);
+		}
+	});
+	m_menu->addAction("设置日志", [this]
+	{
+		auto debugCore = m_debugCore.lock();
+		if (!debugCore)
+		{
+			QMessageBox::information(this, "提示", "请先启动调试");
+			return;
+		}
+
+		auto address = getSel();
+		if (address == 0)
+		{
+			QMessageBox::information(this, "提示", "请先选择一个断点");
+			return;
+		}
+		auto bp = debugCore->findBreakpoint(address);
+
+		bool ok;
+		auto text = QInputDialog::getText(this, "设置日志", "日志({}中为表达式,为空时停下):", QLineEdit::Normal, bp->logMessage(), &ok);
+		QString error;
+		if (ok && !bp->setLogMessage(text, error))
+		{
+			QMessageBox::warning(this, "错误", "日志格式错误: " + error);
+		}
+	});
+	m_menu->addAction("启用全部断点", [this] { setAllEnabled(true); });
+	m_menu->addAction("禁用全部断点", [this] { setAllEnabled(false); });
 	m_menu->addAction("删除断点", [this]
 	{
 		auto debugCore = m_debugCore.lock();
@@ -129,15 +231,32 @@ BreakpointView::BreakpointView(QWidget *parent)
 			return;
 		}
 
-		if (!debugCore->addBreakpoint(dlg.address(), dlg.enabled(), false, dlg.oneTime()))
+		bool added = dlg.isHardware()
+			? debugCore->addHardwareBreakpoint(dlg.address(), dlg.hardwareType(), dlg.size(), dlg.enabled(), dlg.oneTime())
+			: debugCore->addBreakpoint(dlg.address(), dlg.enabled(), false, dlg.oneTime());
+		if (!added)
 		{
 			QMessageBox::warning(this, "错误", "添加断点失败");
+			return;
+		}
+
+		QString error;
+		auto bp = debugCore->findBreakpoint(dlg.address());
+		if (!bp->setCondition(dlg.condition(), error))
+		{
+			QMessageBox::warning(this, "错误", "条件错误: " + error);
+		}
+		if (!bp->setLogMessage(dlg.logMessage(), error))
+		{
+			QMessageBox::warning(this, "错误", "日志格式错误: " + error);
 		}
 	});
 	//TODO: 添加断点编辑功能
 
 	QObject::connect(EventDispatcher::instance(), &EventDispatcher::setDebugCore, this, &BreakpointView::setDebugCore);
 	QObject::connect(EventDispatcher::instance(), &EventDispatcher::breakpointChanged, this, &BreakpointView::updateContent);
+	//停下时刷新命中次数
+	QObject::connect(EventDispatcher::instance(), &EventDispatcher::debugEvent, this, &BreakpointView::updateContent);
 }
 
 void BreakpointView::updateContent()
@@ -157,6 +276,31 @@ void BreakpointView::updateContent()
 		setItem(i, 0, new QTableWidgetItem(QString::number(bp->address(), 16)));
 		setItem(i, 1, new QTableWidgetItem(bp->enabled()? "是" :"否"));
 		setItem(i, 2, new QTableWidgetItem(bp->isOneTime()? "是" : "否"));
+		setItem(i, 3, new QTableWidgetItem(bp->condition()));
+		setItem(i, 4, new QTableWidgetItem(QString::number(bp->hitCount())));
+		setItem(i, 5, new QTableWidgetItem(bp->logMessage()));
+		setItem(i, 6, new QTableWidgetItem(breakpointType(*bp)));
+	}
+}
+
+void BreakpointView::setAllEnabled(bool enabled)
+{
+	auto debugCore = m_debugCore.lock();
+	if (!debugCore)
+	{
+		QMessageBox::information(this, "提示", "请先启动调试");
+		return;
+	}
+
+	std::vector<uint64_t> addresses;
+	for (auto const& bp : debugCore->breakpoints())
+	{
+		addresses.push_back(bp->address());
+	}
+
+	if (!debugCore->setBreakpoints(addresses, enabled))
+	{
+		QMessageBox::warning(this, "错误", "设置失败");
 	}
 }
 
@@ -27,5 +27,6 @@ private:
 	QMenu* m_menu;
 
 	uint64_t getSel();
+	void setAllEnabled(bool enabled);
 };
 
@@ -1,30 +1,105 @@
-
 #pragma once
 
 #include <QString>
-#include <mach/mach.h>
 #include <vector>
+#include <cstdint>
 
+//按级别从低到高排列
 enum class LogType
 {
+	Debug,		//处理每个异常时的细节,默认不记录
 	Info,
 	Warning,
 	Error
 };
 
+//线程标识: macOS下为线程的mach port, Linux下为tid
+using ThreadId = uint64_t;
+
+//与VM_PROT_*和PROT_*取值一致
+enum MemoryProtection
+{
+	ProtNone = 0,
+	ProtRead = 1,
+	ProtWrite = 2,
+	ProtExecute = 4,
+};
+
 struct MemoryRegion
 {
-    mach_vm_address_t start;
-    mach_vm_size_t size;
-    vm_region_submap_short_info_64 info;
+    uint64_t start;
+    uint64_t size;
+    int protection;
+    int maxProtection;
+};
+
+//通用寄存器, 字段顺序与x86_thread_state64_t一致
+struct ThreadState
+{
+	uint64_t rax;
+	uint64_t rbx;
+	uint64_t rcx;
+	uint64_t rdx;
+	uint64_t rdi;
+	uint64_t rsi;
+	uint64_t rbp;
+	uint64_t rsp;
+	uint64_t r8;
+	uint64_t r9;
+	uint64_t r10;
+	uint64_t r11;
+	uint64_t r12;
+	uint64_t r13;
+	uint64_t r14;
+	uint64_t r15;
+	uint64_t rip;
+	uint64_t rflags;
+	uint64_t cs;
+	uint64_t fs;
+	uint64_t gs;
+};
+
+//调试寄存器, 字段顺序与x86_debug_state64_t一致
+//dr[0..3]为断点地址, dr7为启用位和类型/长度, dr6为触发状态
+struct DebugRegisters
+{
+	uint64_t dr[4];
+	uint64_t dr4;
+	uint64_t dr5;
+	uint64_t dr6;
+	uint64_t dr7;
+};
+
+//DR6中的单步位, 低4位为触发的DR0-DR3
+static const uint64_t dr6SingleStep = 1 << 14;
+
+//x87/SSE/AVX/AVX-512寄存器, 比通用寄存器大得多, 停止时不读取, 需要时通过DebugCore::getVectorState()读取
+struct VectorState
+{
+	//FXSAVE格式的x87状态, ftw为简化的标记字节
+	uint16_t fcw;
+	uint16_t fsw;
+	uint8_t ftw;
+	uint16_t fop;
+	uint64_t fip;
+	uint64_t fdp;
+	uint32_t mxcsr;
+	uint32_t mxcsrMask;
+	//st0-st7的80位值, 每个占16字节
+	uint8_t st[8][16];
+	//zmm0-zmm31, xmm为低16字节, ymm为低32字节, CPU不支持的部分为0
+	uint8_t zmm[32][64];
+	//AVX-512的k0-k7
+	uint64_t k[8];
+	//向量寄存器的字节数(16/32/64)和个数(16/32)
+	int vectorSize;
+	int vectorCount;
 };
 
 struct Register
 {
-	x86_thread_state64_t threadState;
-//	x86_float_state64_t floatState;
-//	x86_avx_state64_t avxState;
-//	x86_debug_state64_t debugState;
+	ThreadState threadState;
+	DebugRegisters debugState;
 };
 
 enum class RegisterType
@@ -64,11 +139,36 @@ struct Segment
     uint64_t filesize;  	/* amount to map from the file */
 };
 
+//由各平台后端将原始异常翻译成以下类型
+enum class ExceptionType
+{
+	Exec,		//调试目标执行exec系列函数时产生的SIGTRAP
+	Signal,		//调试目标收到的其他signal, 值见ExceptionInfo::signal
+	Breakpoint,	//int3
+	SingleStep,	//TF单步
+	HardwareBreakpoint,	//调试寄存器断点, 触发的断点见ExceptionInfo::debugStatus
+	Fault,		//访问异常/非法指令/算术异常等
+	Detach,		//停止调试附加的进程前所有线程已经停下,回调中恢复断点处的原始数据, threadId为0
+	Other,
+};
 
 struct ExceptionInfo
 {
-    mach_port_t threadPort;
-    mach_port_t taskPort;
-    exception_type_t exceptionType;
-    std::vector<mach_exception_data_type_t> exceptionData;
-};
\ No newline at end of file
+    ThreadId threadId;
+    ExceptionType exceptionType;
+    int signal;
+    uint64_t debugStatus = 0;	//HardwareBreakpoint时的DR6, 同时是单步时设置dr6SingleStep
+    //平台相关的原始异常数据, 仅用于输出日志, 直接放在结构中, 处理异常时不分配内存
+    static const int maxExceptionData = 4;
+    int64_t exceptionData[maxExceptionData];
+    int exceptionDataCount = 0;
+
+    //超过maxExceptionData的部分丢弃
+    void addExceptionData(int64_t value)
+    {
+        if (exceptionDataCount < maxExceptionData)
+        {
+            exceptionData[exceptionDataCount++] = value;
+        }
+    }
+};
@@ -1,62 +1,32 @@
 #include "DebugCore.h"
-#include "TargetException.h"
 #include "EventDispatcher.h"
 #include "global.h"
 #include "utils.h"
 #include "libasmx64.h"
+#include "InsnRelocator.h"
+#include "AllocCounter.h"
 
 #include <vector>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 
-#include <QProcess>
-#include <QDir>
-#include <QFile>
-#include <QDebug>
-
-#include <spawn.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <mach-o/loader.h>
-
-#include <CoreFoundation/CoreFoundation.h>
-
-class DebugProcess : public QProcess
-{
-public:
-    DebugProcess()
-    {}
-
-    // QProcess interface
-protected:
-    void setupChildProcess() override;
-};
-
-void DebugProcess::setupChildProcess()
-{
-    //--------------------------------------------------------------
-    // Child process
-    //--------------------------------------------------------------
-    ptrace (PT_TRACE_ME, 0, 0, 0);    // Debug this process
-    ptrace (PT_SIGEXC, 0, 0, 0);    // Get BSD signals as mach exceptions
-
-    // If our parent is setgid, lets make sure we don't inherit those
-    // extra powers due to nepotism.
-    if (setgid (getgid ()) == 0)
-    {
-
-        // Let the child have its own process group. We need to execute
-        // this call in both the child and parent to avoid a race condition
-        // between the two processes.
-        setpgid (0, 0);    // Set the child process group to match its pid
+#include <signal.h>
 
-        // Sleep a bit to before the exec call
-        sleep (1);
-    }
-}
+#include <QDebug>
+#include <QDir>
 
 
 DebugCore::DebugCore()
+	: m_backend(createTargetBackend())
+	, m_memCache(m_backend.get())
+	//分析线程和反汇编线程一样通过readMemory读取,断点的屏蔽由m_breakpointsMtx保护
+	, m_flowAnalysis([this](uint64_t address, void* buffer, uint64_t size) { return readMemory(address, buffer, size); })
 {
-
+	m_backend->setExceptionCallback(ExceptionCallback::bind<DebugCore, &DebugCore::onException>(this));
+	QObject::connect(&m_flowAnalysis, &FlowAnalysis::progress,
+		EventDispatcher::instance(), &EventDispatcher::flowGraphChanged);
 }
 
 DebugCore::~DebugCore()
@@ -66,430 +36,369 @@ DebugCore::~DebugCore()
 
 std::vector<MemoryRegion> DebugCore::getMemoryMap()
 {
-	std::vector<MemoryRegion> memoryRegions;
-    mach_vm_address_t start = 0;
-    do
-    {
-        mach_vm_size_t size = 0;
-        natural_t depth = 0;
-        vm_region_submap_short_info_data_64_t info;
-        mach_msg_type_number_t count = VM_REGION_SUBMAP_SHORT_INFO_COUNT_64;
-
-        kern_return_t kr = mach_vm_region_recurse(g_task, &start, &size,
-                              &depth, (vm_region_recurse_info_t)&info, &count);
-        if (kr != KERN_SUCCESS)
-        {
-            break;
-        }
-
-        bool needAdd = true;
-        if (!memoryRegions.empty())
-        {
-            auto& region = memoryRegions.back();
-            if (start == region.start + region.size)
-            {
-                auto& prevInfo = region.info;
-                if ((info.protection != prevInfo.protection)
-                    || (info.max_protection != prevInfo.max_protection)
-                    || (info.inheritance != prevInfo.inheritance)
-                    || (info.share_mode != prevInfo.share_mode))
-                {
-                    region.size += size;
-                    needAdd = false;
-                }
-            }
-        }
-        if (needAdd)
-        {
-            memoryRegions.emplace_back(MemoryRegion{start, size, info});
-        }
-
-        start += size;
-
-    } while (start != 0);
-
-	return memoryRegions;
+	return m_backend->getMemoryMap();
 }
 
 bool DebugCore::findRegion(uint64_t address, uint64_t &start, uint64_t &size)
 {
-    mach_vm_address_t _start = address;
-    mach_vm_size_t _size = 0;
-    natural_t depth = 0;
-    vm_region_submap_short_info_data_64_t info;
-    mach_msg_type_number_t count = VM_REGION_SUBMAP_SHORT_INFO_COUNT_64;
-
-    if (mach_vm_region_recurse(g_task, &_start, &_size,
-       &depth, (vm_region_recurse_info_t)&info, &count) != KERN_SUCCESS)
-    {
-        return false;
-    }
+	MemoryRegion region;
+	if (!m_backend->findRegion(address, region))
+	{
+		return false;
+	}
 
-    start = _start;
-    size = _size;
+    start = region.start;
+    size = region.size;
     return true;
 }
 
-bool DebugCore::readMemory(mach_vm_address_t address, void* buffer, mach_vm_size_t size, bool bypassBreakpoint)
+bool DebugCore::readMemory(uint64_t address, void* buffer, uint64_t size, bool bypassBreakpoint)
 {
-	mach_vm_address_t regionAddress = address;
-	mach_vm_size_t regionSize = 0;
-	natural_t depth = 0;
-	vm_region_submap_short_info_data_64_t info;
-	mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
-	bool needRestore = false;
-	auto _ = finally([this, &needRestore, &address, &size, &info]
+	//反汇编和流程分析线程也会调用,读取目标内存时不加锁,只在替换断点处的字节时加共享锁
+	//读取期间有断点被删除时读到的0xCC可能已经没有对应的断点,版本变化时重新读取
+	//断点一直在变化时最后一次在锁内读取,不会一直重试
+	std::shared_lock<std::shared_timed_mutex> lock(m_breakpointsMtx, std::defer_lock);
+	for (int retry = 0; ; ++retry)
 	{
-		if (!needRestore)
+		auto version = m_breakpointsVersion.load(std::memory_order_acquire);
+		if (retry == 3)
 		{
-			return;
+			lock.lock();
 		}
-		log("restore");
-		kern_return_t kr = mach_vm_protect(g_task, address, size, 0, info.protection);
-		if (kr != KERN_SUCCESS)
+		if (!m_memCache.read(address, buffer, size))
 		{
-			log(QString("mach_vm_protect还原内存属性失败：").append(mach_error_string(kr)), LogType::Warning);
+			return false;
+		}
+		if (lock.owns_lock())
+		{
+			break;
 		}
-	});
-
-	kern_return_t kr = mach_vm_region_recurse(g_task, &regionAddress, &regionSize, &depth, (vm_region_recurse_info_t)&info, &count);
-	if (kr != KERN_SUCCESS)
-	{
-		log(QString("读取内存失败，mach_vm_region_recurse：").append(mach_error_string(kr)), LogType::Warning);
-		return false;
-	}
 
-	//outputMessage(QString("region: %1").arg(regionAddress, 0, 16), MessageType::Info);
-	if ((info.protection & VM_PROT_READ) == 0)
-	{
-		kr = mach_vm_protect(g_task, address, size, 0, info.protection | VM_PROT_READ);
-		if (kr != KERN_SUCCESS)
+		lock.lock();
+		if (m_breakpointsVersion.load(std::memory_order_relaxed) == version)
 		{
-			log(QString("读取内存失败，mach_vm_protect：").append(mach_error_string(kr)), LogType::Warning);
-			return false;
+			break;
 		}
-		needRestore = true;
+		lock.unlock();
 	}
 
-    /* read memory - vm_read_overwrite because we supply the buffer */
-    mach_vm_size_t nread;
-    kr = mach_vm_read_overwrite(g_task, address, size, (mach_vm_address_t)buffer, &nread);
-    if (kr != KERN_SUCCESS)
-    {
-        log(QString("mach_vm_read_overwrite failed at address: 0x%1 with error: %2").arg(address, 0, 16).arg(mach_error_string(kr)), LogType::Warning);
-        return false;
-    }
-    else if (nread != size)
-    {
-        log(QString("mach_vm_read_overwrite failed, requested size: %1 read: %2").arg(size).arg(nread), LogType::Warning);
-        return false;
-    }
+	//临时断点总是隐藏,设置普通断点时读到的也是原来的数据
+	if (m_stepBP.active && !m_stepBP.rearm && m_stepBP.address - address < size)
+	{
+		((uint8_t*)buffer)[m_stepBP.address - address] = m_stepBP.orgByte;
+	}
 
 	if (!bypassBreakpoint)
 	{
 		return true;
 	}
 
-	for (auto bp : m_breakpoints)
+	auto range = breakpointRange(address, size);
+	for (auto it = range.first; it != range.second; ++it)
 	{
-		auto bpAddr = bp->address();
-		if (bpAddr >= address && bpAddr < address + size)
+		auto& bp = *it;
+		if (!bp->isHardware())
 		{
-			((uint8_t*)buffer)[bpAddr - address] = bp->orgByte();
+			((uint8_t*)buffer)[bp->address() - address] = bp->orgByte();
 		}
 	}
 
 	return true;
 }
 
-bool DebugCore::writeMemory(mach_vm_address_t address, const void *buffer, mach_vm_size_t size, bool bypassBreakpoint)
+bool DebugCore::writeMemory(uint64_t address, const void *buffer, uint64_t size, bool bypassBreakpoint)
 {
-    mach_vm_address_t regionAddress = address;
-    mach_vm_size_t regionSize = 0;
-    natural_t depth = 0;
-    vm_region_submap_short_info_data_64_t info;
-    mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
-	bool needRestore = false;
-	auto _ = finally([this, &needRestore, &address, &size, &info]
+	//全部写完后再使缓存失效,其他线程在写入过程中缓存的旧数据不会留下
+	auto _ = finally([this, address, size]
+	{
+		m_memCache.invalidate(address, size);
+		m_insnCache.invalidate(address, size);
+	});
+	if (!m_backend->writeMemory(address, buffer, size))
+	{
+		return false;
+	}
+
+	if (m_stepBP.active && !m_stepBP.rearm && m_stepBP.address - address < size)
 	{
-		if (!needRestore)
+		if (bypassBreakpoint)
 		{
-			return;
+			std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+			m_stepBP.orgByte = ((uint8_t*)buffer)[m_stepBP.address - address];
+			++m_breakpointsVersion;
 		}
-		log("restore");
-		kern_return_t kr = mach_vm_protect(g_task, address, size, 0, info.protection);
-		if (kr != KERN_SUCCESS)
+		if (!m_backend->writeMemory(m_stepBP.address, &Breakpoint::bpData, 1))
 		{
-			log(QString("mach_vm_protect还原内存属性失败：").append(mach_error_string(kr)), LogType::Warning);
+			log(QString("恢复临时断点 0x%1 失败").arg(m_stepBP.address, 0, 16), LogType::Error);
+			return false;
 		}
-	});
-    kern_return_t kr = mach_vm_region_recurse(g_task, &regionAddress, &regionSize, &depth, (vm_region_recurse_info_t)&info, &count);
-    if (kr != KERN_SUCCESS)
-    {
-        log(QString("写入内存失败，mach_vm_region_recurse：").append(mach_error_string(kr)), LogType::Warning);
-        return false;
-    }
-
-    //outputMessage(QString("region: %1").arg(regionAddress, 0, 16), MessageType::Info);
-    if ((info.protection & VM_PROT_WRITE) == 0)
-    {
-        kr = mach_vm_protect(g_task, address, size, 0, info.protection | VM_PROT_WRITE);
-        if (kr != KERN_SUCCESS)
-        {
-            log(QString("写入内存失败，mach_vm_protect：").append(mach_error_string(kr)), LogType::Warning);
-            return false;
-        }
-
-		needRestore = true;
-    }
-
-    kr = mach_vm_write(g_task, address, (vm_offset_t)buffer, size);
-    if (kr != KERN_SUCCESS)
-    {
-        log(QString("mach_vm_write() failed: %1, address: 0x%2").arg(mach_error_string(kr)).arg(QString::number(address, 16)), LogType::Warning);
-        return false;
-    }
+	}
 
 	if (!bypassBreakpoint)
 	{
 		return true;
 	}
 
-	for (auto bp : m_breakpoints)
+	//指令被修改后副本失效,下次命中时重新生成
+	auto displaced = m_displaced.lower_bound(address >= 15 ? address - 15 : 0);
+	while (displaced != m_displaced.end() && displaced->first < address + size)
 	{
-		auto bpAddr = bp->address();
-		if (bpAddr >= address && bpAddr < address + size)
+		if (displaced->first + std::max(displaced->second.size, 1) > address)
 		{
-			kr = mach_vm_write(g_task, bpAddr, (vm_offset_t)&Breakpoint::bpData, 1);
-			if (kr != KERN_SUCCESS)
-			{
-				//TODO: ?????????
-				log(QString("mach_vm_write() failed: %1, address: 0x%2").arg(mach_error_string(kr)).arg(QString::number(address, 16)), LogType::Error);
-				return false;
-			}
+			displaced = m_displaced.erase(displaced);
+		}
+		else
+		{
+			++displaced;
+		}
+	}
 
-			bp->setOrgByte(((uint8_t*)buffer)[bpAddr - address]);
+	auto range = breakpointRange(address, size);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto& bp = *it;
+		auto bpAddr = bp->address();
+		if (bp->isHardware())
+		{
+			continue;
 		}
+		if (!m_backend->writeMemory(bpAddr, &Breakpoint::bpData, 1))
+		{
+			//TODO: ?????????
+			log(QString("恢复断点 0x%1 失败").arg(QString::number(bpAddr, 16)), LogType::Error);
+			return false;
+		}
+
+		bp->setOrgByte(((uint8_t*)buffer)[bpAddr - address]);
 	}
-    // TODO: 还原内存属性
+
+	emit EventDispatcher::instance()->memoryWritten(address, size);
     return true;
 }
 
-
-mach_vm_address_t DebugCore::findBaseAddress()
+std::shared_ptr<const DecodedInsn> DebugCore::decodeInsn(uint64_t address, int maxLen)
 {
-    mach_vm_address_t addr = 0;
-    for (;;)
-    {
-        mach_header mh = {0};
-        mach_vm_size_t size = 0;
-        uint32_t depth;
-        vm_region_submap_short_info_data_64_t info;
-        mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
-
-        kern_return_t kr = mach_vm_region_recurse(g_task, &addr, &size, &depth, (vm_region_recurse_info_t)&info, &count);
-        if (kr != KERN_SUCCESS)
-        {
-            log(QString("查找基地址失败，vm_region_recurse_64：").append(mach_error_string(kr)), LogType::Error);
-            return 0;
-        }
-
-        ;
-        if (!readMemory(addr, &mh, sizeof(struct mach_header)))
-        {
-            log(QString("查找基地址失败，readMemory() error"), LogType::Error);
-            return 0;
-        }
-        /* only one image with MH_EXECUTE filetype */
-        if (mh.filetype == MH_EXECUTE)
-        {
-			if (mh.magic == MH_MAGIC)
-			{
-				log("调试目标是32位程序,暂不支持调试32位程序", LogType::Error);
-				return 0;
-			}
-
-			if (mh.magic == MH_MAGIC_64)
-			{
-				return addr;
-			}
-        }
+	uint8_t code[15];
+	int len = std::min(maxLen, 15);
+	if (!readMemory(address, code, len))
+	{
+		//指令可能在不可读的页前面
+		auto toPageEnd = PageCache::pageSize - address % PageCache::pageSize;
+		if (toPageEnd >= (uint64_t)len)
+		{
+			return nullptr;
+		}
+		len = (int)toPageEnd;
+		if (!readMemory(address, code, len))
+		{
+			return nullptr;
+		}
+	}
 
-        addr += size;
-    }
+	return m_insnCache.decode(address, code, len);
 }
 
 bool DebugCore::getEntryAndDataAddr()
 {
-    mach_vm_address_t aslrBase = findBaseAddress();
-	if (aslrBase == 0)
-	{
-		return false;
-	}
-    mach_header header = {0};
-    if (!readMemory(aslrBase, &header, sizeof(header)))
-	{
-		return false;
-	}
+	return m_backend->getEntryAndDataAddr(m_entryAddr, m_dataAddr);
+}
 
-    std::vector<char> cmdBuff(header.sizeofcmds);
-    auto p = cmdBuff.data();
-    if (!readMemory(aslrBase + sizeof(mach_header_64), p, cmdBuff.size()))
+void DebugCore::startFlowAnalysis()
+{
+	uint64_t start, size;
+	if (!findRegion(m_entryAddr, start, size))
 	{
-		return false;
+		log(QString("入口点 0x%1 不在已映射的内存中,不分析函数").arg(m_entryAddr, 0, 16), LogType::Warning);
+		return;
 	}
 
-    for (int i = 0; i < header.ncmds; ++i)
-    {
-        load_command* cmd = (load_command*)p;
-		log(QString("cmd->cmd: %1").arg(cmd->cmd, 8, 16));
-        if (cmd->cmd == LC_MAIN)
-        {
-            entry_point_command* epcmd = (entry_point_command*)p;
-            m_entryAddr = aslrBase + epcmd->entryoff;
-            log(QString("aslr base: 0x%1, entry: 0x%2").arg(QString::number(aslrBase, 16)).arg(QString::number(m_entryAddr, 16)), LogType::Info);
-        }
-		else if (cmd->cmd == LC_UNIXTHREAD || cmd->cmd == LC_THREAD)
-		{
-			//LC_UNIXTHREAD和LC_THREAD对应的结构体thread_commant不完整,这里直接通过偏移找到
-			m_entryAddr = *reinterpret_cast<uint64_t*>(p + 16 * 9);
-		}
-		else if (cmd->cmd == LC_SEGMENT_64)
-		{
-			segment_command_64* segcmd = (segment_command_64*)p;
-			if (std::strncmp(segcmd->segname, SEG_DATA, 6) == 0)
-			{
-				for (int j = 0; j < segcmd->nsects; ++j)
-				{
-					auto secloc = p + sizeof(segment_command_64) + j * sizeof(section_64);
-					section_64* sec = (section_64*)secloc;
-					if (std::strncmp(sec->sectname, SECT_DATA, 6) == 0)
-					{
-						m_dataAddr = aslrBase + sec->addr;
-						log(QString("__data section addr is %1").arg(m_dataAddr));
-					}
-				}
-			}
-		}
-        p += cmd->cmdsize;
-    }
-
-	return true;
+	m_flowAnalysis.start(start, size, m_entryAddr);
 }
 
-Register DebugCore::getAllRegisterState(mach_port_t thread)
+Register DebugCore::getAllRegisterState(ThreadId thread)
 {
-    /* Get the thread state for the first thread */
     Register reg;
-    mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
-    auto err = thread_get_state(thread, x86_THREAD_STATE64, (thread_state_t)&reg.threadState, &stateCount);
-    if (err != KERN_SUCCESS)
+    if (!getThreadState(thread, reg.threadState))
     {
-        log(QString("thread_get_state() error: \"%1\" 获取通用寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
         return {};
     }
-
-//	stateCount = x86_FLOAT_STATE64_COUNT;
-//	err = thread_get_state(thread, x86_FLOAT_STATE64, (thread_state_t)&reg.floatState, &stateCount);
-//	if (err != KERN_SUCCESS)
-//	{
-//		log(QString("thread_get_state() error: \"%1\" 获取浮点寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
-//		return {};
-//	}
-//
-//	stateCount = x86_AVX_STATE64_COUNT;
-//	err = thread_get_state(thread, x86_AVX_STATE64, (thread_state_t)&reg.avxState, &stateCount);
-//	if (err != KERN_SUCCESS)
-//	{
-//		log(QString("thread_get_state() error: \"%1\" 获取AVX寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
-//		return {};
-//	}
-//
-//	stateCount = x86_DEBUG_STATE64_COUNT;
-//	err = thread_get_state(thread, x86_DEBUG_STATE64, (thread_state_t)&reg.debugState, &stateCount);
-//	if (err != KERN_SUCCESS)
-//	{
-//		log(QString("thread_get_state() error: \"%1\" 获取调试寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
-//		return {};
-//	}
+	if (!m_backend->getDebugRegisters(thread, reg.debugState))
+	{
+		reg.debugState = DebugRegisters();
+	}
 
 	return reg;
 }
 
 bool DebugCore::addBreakpoint(uint64_t address, bool enabled, bool isHardware, bool oneTime)
 {
-    assert(!isHardware);    //TODO:
+	if (isHardware)
+	{
+		return addHardwareBreakpoint(address, Breakpoint::HardwareType::Execute, 1, enabled, oneTime);
+	}
     assert(!findBreakpoint(address));
 
+	//在已分析的代码中检查断点是否在指令开头,不在时写入的int3会破坏指令
+	auto graph = m_flowAnalysis.graph();
+	if (graph->findBlock(address) && !graph->isInsnStart(address))
+	{
+		log(QString("断点 0x%1 不在指令开头").arg(address, 0, 16), LogType::Warning);
+	}
+
     auto bp = std::make_shared<Breakpoint>(this);
     bp->setAddress(address);
 	bp->setOneTime(oneTime);
+
+	//先带着原始数据加入m_breakpoints再写入0xCC,反汇编线程读内存时不会看到0xCC
+	uint8_t orgByte = 0;
+	readMemory(address, &orgByte, 1, false);
+	bp->setOrgByte(orgByte);
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_breakpoints.insert(lowerBound(address), bp);
+		++m_breakpointsVersion;
+	}
+
     if (!bp->setEnabled(enabled))
     {
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_breakpoints.erase(lowerBound(address));
+		++m_breakpointsVersion;
         return false;
     }
 
-    m_breakpoints.emplace_back(bp);
 	emit EventDispatcher::instance()->breakpointChanged();
     return true;
 }
 
-bool DebugCore::removeBreakpoint(uint64_t address)
+bool DebugCore::addHardwareBreakpoint(uint64_t address, Breakpoint::HardwareType type, int size, bool enabled, bool oneTime)
 {
-	auto it = std::find_if(m_breakpoints.cbegin(), m_breakpoints.cend(),
-		[address](BreakpointPtr bp)
+	if (findBreakpoint(address))
 	{
-		return bp->address() == address;
-	});
+		log(QString("0x%1 处已经有断点").arg(address, 0, 16), LogType::Warning);
+		return false;
+	}
 
-	if (it == m_breakpoints.cend())
+	//调试寄存器只能监视按长度对齐的1/2/4/8字节,执行断点的长度必须为1
+	if ((size != 1 && size != 2 && size != 4 && size != 8) || address % size != 0
+		|| (type == Breakpoint::HardwareType::Execute && size != 1))
+	{
+		log(QString("硬件断点 0x%1 的长度 %2 无效或地址没有对齐").arg(address, 0, 16).arg(size), LogType::Warning);
 		return false;
+	}
 
-	if (!(*it)->setEnabled(false))
+	auto bp = std::make_shared<Breakpoint>(this);
+	bp->setAddress(address);
+	bp->setOneTime(oneTime);
+	bp->setHardware(type, size);
+	if (!bp->setEnabled(enabled))
 	{
 		return false;
 	}
 
-	m_breakpoints.erase(it);
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_breakpoints.insert(lowerBound(address), bp);
+		++m_breakpointsVersion;
+	}
 	emit EventDispatcher::instance()->breakpointChanged();
 	return true;
 }
-bool DebugCore::removeBreakpoint(DebugCore::BreakpointPtr bp)
+
+bool DebugCore::setHardwareBreakpoint(Breakpoint* bp, bool enabled)
 {
-	return removeBreakpoint(bp->address());
+	auto slot = std::find(std::begin(m_hardwareSlots), std::end(m_hardwareSlots), bp);
+	if (enabled == (slot != std::end(m_hardwareSlots)))
+	{
+		return true;
+	}
+
+	if (enabled)
+	{
+		slot = std::find(std::begin(m_hardwareSlots), std::end(m_hardwareSlots), nullptr);
+		if (slot == std::end(m_hardwareSlots))
+		{
+			log(QString("无法启用硬件断点 0x%1：4个调试寄存器都已被使用。").arg(bp->address(), 0, 16), LogType::Warning);
+			return false;
+		}
+	}
+
+	*slot = enabled ? bp : nullptr;
+	if (!m_backend->setDebugRegisters(debugRegisters()))
+	{
+		*slot = enabled ? nullptr : bp;
+		log(QString("设置硬件断点 0x%1 失败").arg(bp->address(), 0, 16), LogType::Warning);
+		return false;
+	}
+	return true;
 }
 
-bool DebugCore::debugNew(const QString &path, const QString &args)
+DebugRegisters DebugCore::debugRegisters()
 {
-	//TODO: 检查文件是否是64位程序,不是则停止调试
+	//LEN的编码: 1字节为00, 2字节为01, 8字节为10, 4字节为11
+	static const uint64_t lengthBits[9] = { 0, 0, 1, 0, 3, 0, 0, 0, 2 };
 
-    m_process = new DebugProcess; //TODO: 泄露怎么处理??
-    QString command = path + " " + args;
-	m_process->start(command);
-    g_pid = (pid_t)m_process->pid();
+	DebugRegisters regs = {};
+	for (int i = 0; i < 4; ++i)
+	{
+		auto bp = m_hardwareSlots[i];
+		if (!bp)
+		{
+			continue;
+		}
 
-    if (g_pid <= 0)
-    {
-        log(QString("启动调试进程失败：%1").arg(m_process->errorString()), LogType::Error);
-        return false;
-    }
+		regs.dr[i] = bp->address();
+		//L0-L3为bit 0/2/4/6, 从bit 16开始每个断点4位: 低2位R/W,高2位LEN
+		regs.dr7 |= 1ull << (i * 2);
+		regs.dr7 |= ((uint64_t)bp->hardwareType() | lengthBits[bp->size()] << 2) << (16 + i * 4);
+	}
+	return regs;
+}
 
-    //父进程执行
-    kern_return_t err = task_for_pid(mach_task_self(), g_pid, &g_task);
-    if (err != KERN_SUCCESS)
-    {
-        log(QString("task_for_pid() error: %1 启动调试进程失败").arg(mach_error_string(err)), LogType::Error);
-        return false;
-    }
+Breakpoint* DebugCore::findHardwareBreakpoint(uint64_t debugStatus)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		if ((debugStatus & (1 << i)) && m_hardwareSlots[i])
+		{
+			return m_hardwareSlots[i];
+		}
+	}
+	return nullptr;
+}
 
-	if (!TargetException::instance()
-		.setExceptionCallback(std::bind(&DebugCore::handleException, this, std::placeholders::_1)))
-    {
-        log("setExceptionCallback failed, 启动调试进程失败", LogType::Error);
-        return false;
-    }
+bool DebugCore::removeBreakpoint(uint64_t address)
+{
+	auto it = lowerBound(address);
+	if (it == m_breakpoints.end() || (*it)->address() != address)
+		return false;
+
+	if (!(*it)->setEnabled(false))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_breakpoints.erase(it);
+		++m_breakpointsVersion;
+	}
+	emit EventDispatcher::instance()->breakpointChanged();
+	return true;
+}
+bool DebugCore::removeBreakpoint(DebugCore::BreakpointPtr bp)
+{
+	return removeBreakpoint(bp->address());
+}
+
+bool DebugCore::debugNew(const QString &path, const QString &args)
+{
+	if (!m_backend->debugNew(path, args))
+	{
+		return false;
+	}
+	m_stopRequested = false;
 
-	m_isAttach = false;
 	auto self = shared_from_this();
     m_debugThread = std::thread([this, self]
     {
@@ -500,28 +409,12 @@ bool DebugCore::debugNew(const QString &path, const QString &args)
 
 bool DebugCore::attach(pid_t pid)
 {
-	g_pid = pid;
-	kern_return_t err = task_for_pid(mach_task_self(), g_pid, &g_task);
-	if (err != KERN_SUCCESS)
-	{
-		log(QString("task_for_pid() error: %1 附加目标进程失败").arg(mach_error_string(err)), LogType::Error);
-		return false;
-	}
-
-	if (!TargetException::instance()
-		.setExceptionCallback(std::bind(&DebugCore::handleException, this, std::placeholders::_1)))
+	if (!m_backend->attach(pid))
 	{
-		log("setExceptionCallback failed, 附加目标进城失败", LogType::Error);
 		return false;
 	}
+	m_stopRequested = false;
 
-	if (ptrace(PT_ATTACHEXC, pid, 0, 0) != 0)
-	{
-		log("ptrace PT_ATTACHEXC failed, 附加目标进城失败", LogType::Error);
-		return false;
-	}
-
-	m_isAttach = true;
 	auto self = shared_from_this();
 	m_debugThread = std::thread([this, self]
 	{
@@ -532,58 +425,45 @@ bool DebugCore::attach(pid_t pid)
 
 bool DebugCore::pause()
 {
-	return kill(g_pid, SIGINT) == 0;
+	return m_backend->pause();
 }
 
 void DebugCore::stop()
 {
-	if (g_pid == 0)
+	if (m_backend->pid() == 0)
 	{
 		return;
 	}
 
-	auto ret = kill(g_pid, SIGKILL);
-	if (ret != 0)
-	{
-		log(QString("Stop debug SIGKILL failed: %1").arg(ret), LogType::Warning);
-	}
-	TargetException::instance().stop();
-
-	if (m_isAttach)
-	{
-		//TODO: 删除所有断点
-		if (ptrace(PT_DETACH, g_pid, (caddr_t)1, 0) != 0)
-		{
-			log("Stop debug detach failed", LogType::Error);
-			return;
-		}
-	}
-	else
+	m_flowAnalysis.cancel();
+	//停在异常上时调试线程在waitForContinue中等待,让它返回
 	{
-		ret = ptrace(PT_KILL, g_pid, 0, 0);
-		if (ret != -1)
-		{
-			log(QString("Stop debug ptrace kill failed: %1").arg(ret), LogType::Error);
-			return;
-		}
+		std::lock_guard<std::mutex> lock(m_continueMtx);
+		m_stopRequested = true;
 	}
+	m_continueCV.notify_all();
+	//启动的进程被结束,附加的进程在调试线程中恢复断点后分离
+	m_backend->stop();
+	m_memCache.setEnabled(false);
 
 	if (m_debugThread.joinable())
 	{
 		m_debugThread.join();
 	}
-
-	g_pid = 0;
 }
 
 void DebugCore::debugLoop()
 {
-    if (!TargetException::instance().run())
+    if (!m_backend->run())
     {
-        log("TargetException.run() failed.", LogType::Error);
+        log("TargetBackend.run() failed.", LogType::Error);
     }
 
-	log("TargetException.run() exited.");
+	log("TargetBackend.run() exited.");
+#ifdef SABER_COUNT_ALLOCATIONS
+	auto stats = dispatchStats();
+	log(QString("不通知界面的停止 %1 次, 共分配内存 %2 次").arg(stats.stops).arg(stats.allocations));
+#endif
 
 //    for (;;)
 //    {
@@ -611,68 +491,116 @@ void DebugCore::debugLoop()
 //    }
 }
 
-bool DebugCore::handleException(ExceptionInfo const&info)
+//数据断点在访问内存的指令执行后触发,可能和单步在同一个异常中
+static bool isSingleStep(ExceptionInfo const& info)
 {
-	m_excInfo = info;
-    auto str = QString("Exception: %1, Data size %2").arg(m_excInfo.exceptionType).arg(m_excInfo.exceptionData.size());
-    for (auto it : m_excInfo.exceptionData)
-    {
-        str += "," + QString::number(it, 16);
-    }
-
-    log(str, LogType::Info);
+	return info.exceptionType == ExceptionType::SingleStep
+		|| (info.exceptionType == ExceptionType::HardwareBreakpoint && (info.debugStatus & dr6SingleStep));
+}
 
-	auto regInfo = getAllRegisterState(m_excInfo.threadPort);
+bool DebugCore::onException(ExceptionInfo const& info)
+{
+	m_notified = false;
+	{
+		std::lock_guard<std::mutex> lock(m_registersMtx);
+		m_registers.thread = info.threadId;
+		m_registers.valid = false;
+		m_registers.dirty = false;
+		m_registers.vectorValid = false;
+	}
+	auto handled = handleException(info);
+	//回调返回后后端让目标继续运行
+	flushRegisters(false);
+	//和上次回调返回时相比,包括后端让目标继续运行,等待和翻译这次异常时的分配
+	auto allocations = threadAllocations();
+	if (!m_notified && info.exceptionType != ExceptionType::Exec)
+	{
+		m_quietAllocations += allocations - m_lastAllocations;
+		++m_quietStops;
+	}
+	m_lastAllocations = allocations;
+	return handled;
+}
+
+bool DebugCore::handleException(ExceptionInfo const&info)
+{
+	if (info.exceptionType == ExceptionType::Detach)
+	{
+		restoreForDetach();
+		return true;
+	}
+
+	m_excInfo = info;
+	//副本中的指令触发了数据断点或异常,或者执行副本时收到signal
+	if (info.exceptionType == ExceptionType::HardwareBreakpoint || info.exceptionType == ExceptionType::Fault
+		|| info.exceptionType == ExceptionType::Signal)
+	{
+		fixDisplacedRip(info.threadId);
+	}
+	//跟踪时的单步异常不通知界面,直接继续单步,停下的原因已经在traceStep中判断过
+	if (m_traceRemaining)
+	{
+		if (isSingleStep(info) && traceStep())
+		{
+			//traceStep已经让目标继续单步
+			return true;
+		}
+		finishTrace();
+	}
+	//越过断点的单步异常和条件不满足的断点直接继续运行,不通知界面
+	else if ((info.exceptionType == ExceptionType::Breakpoint || info.exceptionType == ExceptionType::SingleStep
+		|| info.exceptionType == ExceptionType::HardwareBreakpoint) && resumeQuietly())
+	{
+		//已经让目标继续运行,返回true表示异常已处理,Mach下返回false时异常会交给调试目标
+		return true;
+	}
+
+	//回调返回后调试目标就会继续运行
+	m_memCache.setEnabled(true);
+	auto _ = finally([this] { m_memCache.setEnabled(false); });
+    logLazy(LogType::Debug, [this]
+    {
+        auto str = QString("Exception: %1, Data size %2").arg((int)m_excInfo.exceptionType).arg(m_excInfo.exceptionDataCount);
+        for (int i = 0; i < m_excInfo.exceptionDataCount; ++i)
+        {
+            str += "," + QString::number(m_excInfo.exceptionData[i], 16);
+        }
+        return str;
+    });
+
+	auto regInfo = getAllRegisterState(m_excInfo.threadId);
     emit EventDispatcher::instance()->showRegisters(regInfo);
-	m_stackAddr = regInfo.threadState.__rsp;
+	m_stackAddr = regInfo.threadState.rsp;
 	emit EventDispatcher::instance()->setStackAddress(m_stackAddr);
     switch (m_excInfo.exceptionType)
     {
-        case EXC_SOFTWARE:
-            if (m_excInfo.exceptionData.size() == 2 && m_excInfo.exceptionData[0] == EXC_SOFT_SIGNAL)
-            {
-                //调试目标的signal, data[1]为signal的值
-                if (m_excInfo.exceptionData[1] == SIGTRAP)
-                {
-                    //当子进程执行exec系列函数时会产生sigtrap信号
-                    //TODO: 有多个子进程应该如何处理?
-					if (!getEntryAndDataAddr())
-					{
-						log("获取入口点失败,正在停止调试", LogType::Error);
-						stop();
-						return false;
-					}
-                    addOrEnableBreakpoint(m_entryAddr, false, true);
-					emit EventDispatcher::instance()->setMemoryViewAddress(m_dataAddr);
-                }
-				else
-				{
-					waitForContinue();
-				}
-                ptrace(PT_CONTINUE, g_pid, (caddr_t)1, 0);
-            }
-            else if (m_excInfo.exceptionData.size() >=1 && m_excInfo.exceptionData[0] == 1)
+        case ExceptionType::Exec:
+            //当子进程执行exec系列函数时会产生sigtrap信号
+            //TODO: 有多个子进程应该如何处理?
+            m_displaced.clear();
+            m_scratchPages.clear();
+            if (!getEntryAndDataAddr())
             {
-                //lldb中将这种情况当做breakpoint进行处理的
-                return handleBreakpoint();
+                log("获取入口点失败,正在停止调试", LogType::Error);
+                stop();
+                return false;
             }
+            addOrEnableBreakpoint(m_entryAddr, false, true);
+            startFlowAnalysis();
+            emit EventDispatcher::instance()->setMemoryViewAddress(m_dataAddr);
+            resumeTarget();
             return false;
-        case EXC_BREAKPOINT:
-        {
+        case ExceptionType::Signal:
+            //调试目标的signal, m_excInfo.signal为signal的值
+            waitForContinue();
+            resumeTarget();
+            return false;
+        case ExceptionType::Breakpoint:
+        case ExceptionType::SingleStep:
+        case ExceptionType::HardwareBreakpoint:
             return handleBreakpoint();
-        }
-        case EXC_BAD_ACCESS:
-        case EXC_BAD_INSTRUCTION:
-        case EXC_ARITHMETIC:
-        case EXC_EMULATION:
-        case EXC_SYSCALL:
-        case EXC_MACH_SYSCALL:
-        case EXC_RPC_ALERT:
-        case EXC_CRASH:
-        case EXC_RESOURCE:
-        case EXC_GUARD:
-        case EXC_CORPSE_NOTIFY:
-			m_excAddr = regInfo.threadState.__rip;
+        case ExceptionType::Fault:
+			m_excAddr = regInfo.threadState.rip;
             waitForContinue();
             //TODO:如果用户处理了异常应该返回true阻止程序自己处理异常
             return false;
@@ -683,15 +611,34 @@ bool DebugCore::handleException(ExceptionInfo const&info)
 
 DebugCore::BreakpointPtr DebugCore::findBreakpoint(uint64_t address)
 {
-    for (auto it : m_breakpoints)
-    {
-        if (it->address() == address)
-        {
-            return it;
-        }
-    }
+	auto it = lowerBound(address);
+	if (it == m_breakpoints.end() || (*it)->address() != address)
+	{
+		return nullptr;
+	}
+
+	return *it;
+}
+
+std::vector<DebugCore::BreakpointPtr>::iterator DebugCore::lowerBound(uint64_t address)
+{
+	return std::lower_bound(m_breakpoints.begin(), m_breakpoints.end(), address,
+		[](BreakpointPtr const& bp, uint64_t address)
+	{
+		return bp->address() < address;
+	});
+}
 
-    return nullptr;
+std::pair<std::vector<DebugCore::BreakpointPtr>::iterator, std::vector<DebugCore::BreakpointPtr>::iterator>
+DebugCore::breakpointRange(uint64_t address, uint64_t size)
+{
+	auto first = lowerBound(address);
+	auto last = first;
+	while (last != m_breakpoints.end() && (*last)->address() - address < size)
+	{
+		++last;
+	}
+	return {first, last};
 }
 
 bool DebugCore::addOrEnableBreakpoint(uint64_t address, bool isHardware, bool oneTime)
@@ -705,6 +652,211 @@ bool DebugCore::addOrEnableBreakpoint(uint64_t address, bool isHardware, bool on
     return addBreakpoint(address, true, isHardware, oneTime);
 }
 
+bool DebugCore::setBreakpoints(std::vector<uint64_t> const& addresses, bool enabled)
+{
+	auto sorted = addresses;
+	std::sort(sorted.begin(), sorted.end());
+	sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+	//需要修改内存的断点,按地址排序
+	std::vector<BreakpointPtr> targets;
+	std::vector<BreakpointPtr> added;
+	bool ok = true;
+	for (auto address : sorted)
+	{
+		auto bp = findBreakpoint(address);
+		if (enabled && (!bp || !bp->isHardware()) && overlapsTracepoint(address))
+		{
+			ok = false;
+			continue;
+		}
+		if (!bp)
+		{
+			if (!enabled)
+			{
+				continue;
+			}
+
+			bp = std::make_shared<Breakpoint>(this);
+			bp->setAddress(address);
+			added.emplace_back(bp);
+		}
+
+		if (bp->isHardware())
+		{
+			//不修改内存,逐个分配调试寄存器
+			ok = bp->setEnabled(enabled) && ok;
+		}
+		else if (bp->enabled() != enabled)
+		{
+			targets.emplace_back(bp);
+		}
+	}
+
+	//按页分组,先读出所有原始数据,新断点加入m_breakpoints后再写入0xCC,反汇编线程读内存时不会看到0xCC
+	struct Group
+	{
+		std::size_t first;
+		std::size_t last;
+		std::vector<uint8_t> buf;
+	};
+	std::vector<Group> groups;
+	for (std::size_t i = 0, j = 0; i < targets.size(); i = j)
+	{
+		auto page = targets[i]->address() / PageCache::pageSize;
+		j = i + 1;
+		while (j < targets.size() && targets[j]->address() / PageCache::pageSize == page)
+		{
+			++j;
+		}
+
+		auto start = targets[i]->address();
+		std::vector<uint8_t> buf(targets[j - 1]->address() - start + 1);
+		if (!readMemory(start, buf.data(), buf.size(), false))
+		{
+			log(QString("无法设置断点 %1：readMemory()失败。").arg(QString::number(start, 16)), LogType::Warning);
+			ok = false;
+			continue;
+		}
+
+		for (auto k = i; k < j; ++k)
+		{
+			auto& bp = targets[k];
+			auto& byte = buf[bp->address() - start];
+			if (enabled)
+			{
+				bp->m_orgByte = byte;
+				byte = Breakpoint::bpData;
+			}
+			else
+			{
+				if (byte != Breakpoint::bpData)
+				{
+					log(QString("断点 %1 的数据不为0xCC，已被重写为 0x%2")
+						.arg(QString::number(bp->address(), 16)).arg(QString::number(byte, 16)),
+						LogType::Warning);
+				}
+				byte = bp->m_orgByte;
+			}
+		}
+
+		groups.push_back({ i, j, std::move(buf) });
+	}
+
+	auto byAddress = [](BreakpointPtr const& lhs, BreakpointPtr const& rhs)
+	{
+		return lhs->address() < rhs->address();
+	};
+	if (!added.empty())
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		auto mid = m_breakpoints.size();
+		m_breakpoints.insert(m_breakpoints.end(), added.begin(), added.end());
+		std::inplace_merge(m_breakpoints.begin(), m_breakpoints.begin() + mid, m_breakpoints.end(), byAddress);
+		++m_breakpointsVersion;
+	}
+
+	for (auto& group : groups)
+	{
+		auto start = targets[group.first]->address();
+		if (!writeMemory(start, group.buf.data(), group.buf.size(), false))
+		{
+			log(QString("无法设置断点 %1：writeMemory()失败。").arg(QString::number(start, 16)), LogType::Warning);
+			ok = false;
+			continue;
+		}
+
+		for (auto k = group.first; k < group.last; ++k)
+		{
+			targets[k]->m_enabled = enabled;
+		}
+	}
+
+	//和addBreakpoint一致,启用失败的新断点不添加
+	if (!ok && !added.empty())
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_breakpoints.erase(std::remove_if(m_breakpoints.begin(), m_breakpoints.end(),
+			[&](BreakpointPtr const& bp)
+		{
+			return !bp->enabled() && std::binary_search(added.begin(), added.end(), bp, byAddress);
+		}), m_breakpoints.end());
+		++m_breakpointsVersion;
+	}
+
+	emit EventDispatcher::instance()->breakpointChanged();
+	return ok;
+}
+
+bool DebugCore::enableAgent(QString const& library)
+{
+	std::string name;
+	if (!m_agent.create(name))
+	{
+		log(QString("创建agent的共享内存失败：%1").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	m_backend->setEnvironment(SABER_AGENT_SHM_ENV, QString::fromStdString(name));
+	m_backend->preloadLibrary(library);
+	return true;
+}
+
+bool DebugCore::addTracepoint(uint64_t address)
+{
+	if (!m_agent.isOpen())
+	{
+		log("没有启用agent, 不能添加跟踪点", LogType::Warning);
+		return false;
+	}
+	//agent搬移的指令中有0xCC时会复制到跳板中,在那里触发时没有对应的断点
+	bool hasBreakpoint;
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		auto range = breakpointRange(address, agentRelocateSpan);
+		hasBreakpoint = std::any_of(range.first, range.second, [](BreakpointPtr const& bp) { return bp->enabled() && !bp->isHardware(); })
+			|| (m_stepBP.active && m_stepBP.address - address < agentRelocateSpan);
+	}
+	if (hasBreakpoint)
+	{
+		log(QString("0x%1 之后%2字节内有断点, 不能添加跟踪点").arg(address, 0, 16).arg(agentRelocateSpan), LogType::Warning);
+		return false;
+	}
+
+	auto it = std::lower_bound(m_tracepoints.begin(), m_tracepoints.end(), address);
+	if ((it != m_tracepoints.end() && *it == address) || !m_agent.install(address))
+	{
+		return false;
+	}
+	m_tracepoints.insert(it, address);
+	return true;
+}
+
+bool DebugCore::removeTracepoint(uint64_t address)
+{
+	auto it = std::lower_bound(m_tracepoints.begin(), m_tracepoints.end(), address);
+	if (it == m_tracepoints.end() || *it != address)
+	{
+		return false;
+	}
+	m_tracepoints.erase(it);
+	return m_agent.remove(address);
+}
+
+bool DebugCore::overlapsTracepoint(uint64_t address, uint64_t size)
+{
+	if (!m_agent.overlaps(address, size))
+	{
+		return false;
+	}
+	log(QString("0x%1 在跟踪点覆盖的指令中, 不能设置软件断点").arg(address, 0, 16), LogType::Warning);
+	return true;
+}
+
+std::size_t DebugCore::drainTracepointHits(std::vector<AgentRecord>& records, uint64_t& dropped)
+{
+	return m_agent.drain(records, dropped);
+}
+
 void DebugCore::continueDebug()
 {
     m_continueType = ContinueType::ContinueRun;
@@ -723,59 +875,130 @@ void DebugCore::stepOver()
 	m_continueCV.notify_all();
 }
 
+void DebugCore::stepOut()
+{
+	m_continueType = ContinueType::ContinueStepOut;
+	m_continueCV.notify_all();
+}
+
+void DebugCore::trace(uint64_t count)
+{
+	m_traceRemaining = count;
+	m_continueType = ContinueType::ContinueTrace;
+	m_continueCV.notify_all();
+}
+
+bool DebugCore::runTo(uint64_t address)
+{
+	uint8_t data;
+	if (!readMemory(address, &data, 1))
+	{
+		return false;
+	}
+
+	m_runToAddress = address;
+	m_continueType = ContinueType::ContinueRunTo;
+	m_continueCV.notify_all();
+	return true;
+}
+
 void DebugCore::waitForContinue()
 {
+	m_notified = true;
+	{
+		std::lock_guard<std::mutex> lock(m_continueMtx);
+		if (m_stopRequested)
+		{
+			return;
+		}
+		m_waitingContinue = true;
+	}
 	emit EventDispatcher::instance()->debugEvent();
     std::unique_lock<std::mutex> lock(m_continueMtx);
-    m_continueCV.wait(lock);
+	for (;;)
+	{
+		if (m_stopRequested)
+		{
+			break;
+		}
+		//界面线程请求读取向量寄存器,读取后继续等待
+		if (m_vectorRequested)
+		{
+			{
+				std::lock_guard<std::mutex> registersLock(m_registersMtx);
+				loadVectorState(m_registers.thread);
+			}
+			m_vectorRequested = false;
+			m_vectorCV.notify_all();
+		}
+		m_continueCV.wait(lock);
+		if (!m_vectorRequested)
+		{
+			break;
+		}
+	}
+	m_waitingContinue = false;
 }
 
 bool DebugCore::handleBreakpoint()
 {
-    x86_thread_state64_t state;
-    mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
-    auto err = thread_get_state(m_excInfo.threadPort, x86_THREAD_STATE64, (thread_state_t)&state, &stateCount);
-    if (err != KERN_SUCCESS)
+    ThreadState state;
+    if (!getThreadState(m_excInfo.threadId, state))
     {
-        log(QString("In handleBreakpoint, thread_get_state failed: %1").arg(mach_error_string(err)), LogType::Error);
+        log("In handleBreakpoint, getThreadState failed", LogType::Error);
         return false;
     }
-    log(QString("rip: 0x%1").arg(state.__rip, 0, 16));
+    logLazy(LogType::Debug, [&state] { return QString("rip: 0x%1").arg(state.rip, 0, 16); });
 
-    if (m_excInfo.exceptionData[0] == 1)	//单步
-    {
-		if (m_currentHitBP)
+	if (m_excInfo.exceptionType == ExceptionType::HardwareBreakpoint)
+	{
+		//和其他断点一样取消单步步过
+		clearStepBreakpoint();
+		m_excAddr = state.rip;
+		auto bp = findHardwareBreakpoint(m_excInfo.debugStatus);
+		if (bp)
 		{
-			assert(!m_currentHitBP->enabled());
-			m_currentHitBP->setEnabled(true);
-			m_currentHitBP.reset();
+			log(QString("硬件断点 0x%1 触发").arg(bp->address(), 0, 16));
 		}
-
-		//如果不是单步但是触发了单步异常,说明是为了绕过断点
-		if (m_continueType == ContinueType::ContinueRun)
+		if (bp && bp->isOneTime() && !removeBreakpoint(bp->address()))
 		{
-			return doContinueDebug();
+			log(QString("删除一次性断点 0x%1 失败").arg(bp->address(), 0, 16), LogType::Warning);
 		}
+		waitForContinue();
 
+		return doContinueDebug();
+	}
+
+    if (m_excInfo.exceptionType == ExceptionType::SingleStep)	//单步
+    {
 		//正常的单步步入或者没有遇到call的单步步过
-		m_excAddr = state.__rip;
+		m_excAddr = state.rip;
         waitForContinue();
 
         return doContinueDebug();
     }
 
 	//int3 断点
-    --state.__rip;
-	m_excAddr = state.__rip;
+    --state.rip;
+
+    auto bp = findBreakpoint(state.rip);
+	if (bp && bp->isHardware())
+	{
+		bp = nullptr;
+	}
 
-    auto bp = findBreakpoint(state.__rip);
-    if (!bp)
+	//单步步过完成,或者在其他断点上停下时取消单步步过
+	bool stepDone = m_stepBP.active && m_stepBP.address == state.rip;
+	clearStepBreakpoint();
+	m_excAddr = state.rip;
+
+    if (!bp && !stepDone)
     {
 		//这个断点并非我们调试器所加的,
-        log(QString("Un known breakpoint at 0x%1").arg(state.__rip), LogType::Warning);
-        ++state.__rip;
+        log(QString("Un known breakpoint at 0x%1").arg(state.rip), LogType::Warning);
+        ++state.rip;
     }
-	else if (bp->isOneTime())
+	else if (bp && bp->isOneTime())
 	{
 		if (!removeBreakpoint(bp))
 		{
@@ -783,10 +1006,9 @@ bool DebugCore::handleBreakpoint()
 		}
 	}
 
-	err = thread_set_state(m_excInfo.threadPort, x86_THREAD_STATE64, (thread_state_t)&state, stateCount);
-	if (err != KERN_SUCCESS)
+	if (!setThreadState(m_excInfo.threadId, state))
 	{
-		log(QString("In handleBreakpoint, thread_set_state failed: %1").arg(mach_error_string(err)), LogType::Error);
+		log("In handleBreakpoint, setThreadState failed", LogType::Error);
 		return false;
 	}
 
@@ -795,160 +1017,914 @@ bool DebugCore::handleBreakpoint()
     return doContinueDebug();
 }
 
-bool DebugCore::doContinueDebug()
+bool DebugCore::resumeQuietly()
 {
-    x86_thread_state64_t state;
-    mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
-    auto err = thread_get_state(m_excInfo.threadPort, x86_THREAD_STATE64, (thread_state_t)&state, &stateCount);
-    if (err != KERN_SUCCESS)
-    {
-        log(QString("In DebugCore::stepIn, thread_get_state failed: %1").arg(mach_error_string(err)), LogType::Error);
-        return false;
-    }
+	ThreadState state;
+	if (!getThreadState(m_excInfo.threadId, state))
+	{
+		return false;
+	}
 
-	//查找要继续运行的地址上是否有断点
-	//如果有断点,需要先禁用该断点,然后单步执行
-	//除服单步异常后,重新启用该断点
-	m_currentHitBP = findBreakpoint(state.__rip);
-	if (m_currentHitBP)
+	bool stepping = isSingleStep(m_excInfo);
+	bool rearmed = false;
+	if (stepping)
 	{
-		if (!m_currentHitBP->setEnabled(false))
+		resumeSuspendedBreakpoint();
+
+		if (m_stepBP.rearm)
 		{
-			log("disable breakpoint failed", LogType::Error);
-			//TODO: 询问用户是将异常传递给程序还是从断点指令下一条指令执行
+			{
+				std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+				m_stepBP.rearm = false;
+				++m_breakpointsVersion;
+			}
+			if (!writeStepByte(Breakpoint::bpData))
+			{
+				log(QString("恢复临时断点 0x%1 失败").arg(m_stepBP.address, 0, 16), LogType::Warning);
+			}
+			rearmed = true;
 		}
 	}
-	//FIXME: 在call上下断点,单步步过会变成单步步入
-    if (m_continueType == ContinueType::ContinueStepIn || m_currentHitBP)
-    {
-        state.__rflags |= (1 << 8);
-    }
-	else if (m_continueType == ContinueType::ContinueStepOver)
+
+	if (m_excInfo.exceptionType == ExceptionType::HardwareBreakpoint)
 	{
-		uint8_t code[15];
-		if (!readMemory(state.__rip, code, 15))
+		//不是我们设置的硬件断点时按单步或未知的断点处理
+		auto bp = findHardwareBreakpoint(m_excInfo.debugStatus);
+		if (bp ? bp->shouldBreak(state) : !stepping)
 		{
-			//读取内存失败就当做单步步入处理
-			state.__rflags |= (1 << 8);
+			return false;
 		}
-		else
+
+		//执行断点在指令执行前触发,设置RF后继续运行时不会再次触发
+		if (!stepping)
 		{
-			x64dis decoder;
-			x86dis_insn* insn = decoder.decode(code, 15, state.__rip);
-			if (insn->invalid || !std::strstr(insn->name, "call"))
-			{
-				state.__rflags |= (1 << 8);
-			}
-			else
+			if (bp->hardwareType() == Breakpoint::HardwareType::Execute)
 			{
-				addBreakpoint(state.__rip + insn->size, true, false, true);
-				state.__rflags &= ~(1 << 8);
+				state.rflags |= (1 << 16);
+				if (!setThreadState(m_excInfo.threadId, state))
+				{
+					log("In DebugCore::resumeQuietly, setThreadState failed", LogType::Error);
+				}
 			}
+			resumeTarget();
+			return true;
 		}
-
 	}
-    else
-    {
-        state.__rflags &= ~(1 << 8);
-    }
-
-    log(QString("RFLAGS: 0x%1").arg(state.__rflags, 0, 16));
-
-    err = thread_set_state(m_excInfo.threadPort, x86_THREAD_STATE64, (thread_state_t)&state, stateCount);
-    if (err != KERN_SUCCESS)
-    {
-        log(QString("In DebugCore::stepIn, thread_set_state failed: %1").arg(mach_error_string(err)), LogType::Error);
-        return false;
-    }
 
-    return ptrace(PT_CONTINUE, g_pid, (caddr_t)1, 0) == -1;
-}
-bool DebugCore::setRegisterState(mach_port_t thread, RegisterType type, uint64_t value)
-{
-	x86_thread_state64_t state;
-	mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
-	auto err = thread_get_state(thread, x86_THREAD_STATE64, (thread_state_t)&state, &stateCount);
-	if (err != KERN_SUCCESS)
+	if (stepping)
 	{
-		log(QString("In DebugCore::setRegisterState, thread_get_state failed: %1").arg(mach_error_string(err)), LogType::Error);
+		//如果不是单步但是触发了单步异常,说明是为了绕过断点
+		//在断点上的call单步步过时先单步越过断点,然后运行到返回地址的临时断点
+		if (rearmed || m_continueType == ContinueType::ContinueRun || m_stepBP.active)
+		{
+			resumeRunning();
+			return true;
+		}
 		return false;
 	}
 
-	switch (type)
+	//int3 断点
+	--state.rip;
+	auto bp = findBreakpoint(state.rip);
+	if (m_stepBP.active && m_stepBP.address == state.rip)
 	{
-	case RegisterType::RAX :
-		state.__rax = value;
-		break;
-	case RegisterType::RBX :
-		state.__rbx = value;
-		break;
-	case RegisterType::RCX :
-		state.__rcx = value;
-		break;
-	case RegisterType::RDX :
-		state.__rdx = value;
-		break;
-	case RegisterType::RDI :
-		state.__rdi = value;
-		break;
-	case RegisterType::RSI :
-		state.__rsi = value;
-		break;
-	case RegisterType::RBP :
-		state.__rbp = value;
-		break;
-	case RegisterType::RSP :
-		state.__rsp = value;
-		break;
-	case RegisterType::R8 :
-		state.__r8 = value;
-		break;
-	case RegisterType::R9 :
-		state.__r9 = value;
-		break;
-	case RegisterType::R10 :
-		state.__r10 = value;
-		break;
-	case RegisterType::R11 :
-		state.__r11 = value;
-		break;
-	case RegisterType::R12 :
-		state.__r12 = value;
-		break;
-	case RegisterType::R13 :
-		state.__r13 = value;
-		break;
-	case RegisterType::R14 :
-		state.__r14 = value;
-		break;
-	case RegisterType::R15 :
-		state.__r15 = value;
-		break;
-	case RegisterType::RIP :
-		state.__rip = value;
-		break;
-	case RegisterType::RFLAGS :
-		state.__rflags = value;
-		break;
-	case RegisterType::CS :
-		state.__cs = value;
-		break;
-	case RegisterType::FS :
-		state.__fs = value;
-		break;
-	case RegisterType::GS :
-		state.__gs = value;
-		break;
+		//其他线程或者更深一层的递归执行到了返回地址,越过后继续运行
+		if (bp || !m_stepBP.stackPointer
+			|| (m_excInfo.threadId == m_stepBP.thread && state.rsp >= m_stepBP.stackPointer))
+		{
+			return false;
+		}
 	}
-
-	err = thread_set_state(thread, x86_THREAD_STATE64, (thread_state_t)&state, stateCount);
-	if (err != KERN_SUCCESS)
+	else if (!bp || bp->isHardware() || !bp->enabled() || bp->shouldBreak(state))
 	{
-		log(QString("In DebugCore::setRegisterState, thread_set_state failed: %1").arg(mach_error_string(err)), LogType::Error);
 		return false;
 	}
 
-	return true;
+	//条件不满足,和继续运行时一样在副本上执行断点处的指令
+	//单步时或者不能搬移时恢复原来的数据单步越过,单步异常后按上面的流程继续运行或者停下
+	bool runOn = m_continueType == ContinueType::ContinueRun || m_stepBP.active;
+	if (!runOn || !displaceInsn(state.rip, state))
+	{
+		if (bp ? !suspendBreakpoint(bp) : !skipStepBreakpoint())
+		{
+			return false;
+		}
+		state.rflags |= (1 << 8);
+	}
+
+	if (!setThreadState(m_excInfo.threadId, state))
+	{
+		log("In DebugCore::resumeQuietly, setThreadState failed", LogType::Error);
+		return true;
+	}
+	resumeTarget();
+	return true;
+}
+
+bool DebugCore::suspendBreakpoint(BreakpointPtr const& bp)
+{
+	auto orgByte = bp->orgByte();
+	if (!writeMemory(bp->address(), &orgByte, 1, false))
+	{
+		log(QString("越过断点 0x%1 失败").arg(bp->address(), 0, 16), LogType::Error);
+		return false;
+	}
+	m_currentHitBP = bp;
+	return true;
+}
+
+void DebugCore::resumeSuspendedBreakpoint()
+{
+	if (!m_currentHitBP)
+	{
+		return;
+	}
+
+	//越过期间断点可能已经被禁用或删除
+	auto bp = std::move(m_currentHitBP);
+	if (bp->enabled() && findBreakpoint(bp->address()) == bp
+		&& !writeMemory(bp->address(), &Breakpoint::bpData, 1, false))
+	{
+		log(QString("恢复断点 0x%1 失败").arg(bp->address(), 0, 16), LogType::Error);
+	}
+}
+
+DebugCore::DisplacedInsn DebugCore::relocateInsn(uint64_t address)
+{
+	DisplacedInsn displaced;
+	auto decoded = decodeInsn(address);
+	if (!decoded || !InsnRelocator::relocatable(decoded->insn))
+	{
+		return displaced;
+	}
+	displaced.size = decoded->size;
+
+	uint64_t target = 0;
+	if (x64dis::flowKind(decoded->insn) == X86_FLOW_JMP && x64dis::branchTarget(decoded->insn, target))
+	{
+		displaced.jumpTo = target;
+		return displaced;
+	}
+
+	//rip相对寻址的指令的副本必须在它访问的数据附近
+	int pos;
+	uint64_t dataAddress = address;
+	uint64_t slot;
+	if (!InsnRelocator::ripRelative(decoded->insn, decoded->code, address, pos, dataAddress)
+		|| !allocateSlot(dataAddress, pos >= 0, slot))
+	{
+		return displaced;
+	}
+
+	//执行完后跳回下一条指令,ret和间接跳转不会执行到这里
+	uint8_t code[slotSize];
+	Relocation relocation;
+	if (!InsnRelocator::relocate(decoded->insn, decoded->code, address, slot, code, relocation))
+	{
+		return displaced;
+	}
+	auto len = relocation.size;
+	for (int i = 0; i < relocation.stopCount; ++i)
+	{
+		displaced.stopAt[i] = slot + relocation.stopOffset[i];
+		displaced.origin[i] = relocation.origin[i];
+	}
+	displaced.stopCount = relocation.stopCount;
+	if (relocation.fallsThrough)
+	{
+		displaced.stopAt[displaced.stopCount] = slot + len;
+		displaced.origin[displaced.stopCount++] = address + decoded->size;
+		len += InsnRelocator::writeJump(code + len, address + decoded->size);
+	}
+
+	if (!writeMemory(slot, code, len, false))
+	{
+		log(QString("写入 0x%1 处指令的副本失败").arg(address, 0, 16), LogType::Warning);
+		return DisplacedInsn();
+	}
+	displaced.slot = slot;
+	return displaced;
+}
+
+bool DebugCore::allocateSlot(uint64_t address, bool near, uint64_t& slot)
+{
+	//留出余量,副本中的指令和它访问的数据都在rip相对寻址的范围内
+	static const int64_t nearRange = 0x7fff0000;
+	auto isNear = [address](uint64_t page)
+	{
+		auto distance = (int64_t)(page - address);
+		return distance > -nearRange && distance < nearRange;
+	};
+
+	for (auto& page : m_scratchPages)
+	{
+		if (page.used + slotSize <= PageCache::pageSize && (!near || isNear(page.address)))
+		{
+			slot = page.address + page.used;
+			page.used += slotSize;
+			return true;
+		}
+	}
+
+	//在停下的线程中执行系统调用,先写回修改过的寄存器
+	uint64_t page;
+	flushRegisters(true);
+	if (!m_backend->allocateMemory(m_excInfo.threadId, findScratchHint(address), PageCache::pageSize, page))
+	{
+		log("分配指令副本的内存失败, 断点改为单步越过", LogType::Warning);
+		return false;
+	}
+	m_scratchPages.emplace_back(ScratchPage{page, 0});
+	if (near && !isNear(page))
+	{
+		return false;
+	}
+	slot = page;
+	m_scratchPages.back().used = slotSize;
+	return true;
+}
+
+uint64_t DebugCore::findScratchHint(uint64_t address)
+{
+	//Linux下mmap不能使用0x10000以下的地址,用户空间到0x7ffffffff000为止
+	static const uint64_t minAddress = 0x10000;
+	static const uint64_t maxAddress = 0x7ffffffff000;
+
+	uint64_t best = 0;
+	uint64_t bestDistance = UINT64_MAX;
+	auto consider = [&](uint64_t start, uint64_t end)
+	{
+		if (end <= start || end - start < PageCache::pageSize)
+		{
+			return;
+		}
+		//空闲区域中离address最近的一页
+		uint64_t page = address < start ? start : end - PageCache::pageSize;
+		if (address >= start && address < end)
+		{
+			page = address & ~(uint64_t)(PageCache::pageSize - 1);
+		}
+		auto distance = page > address ? page - address : address - page;
+		if (distance < bestDistance)
+		{
+			best = page;
+			bestDistance = distance;
+		}
+	};
+
+	auto prevEnd = minAddress;
+	for (auto const& region : getMemoryMap())
+	{
+		if (region.start >= maxAddress)
+		{
+			break;
+		}
+		consider(prevEnd, region.start);
+		prevEnd = std::max(prevEnd, region.start + region.size);
+	}
+	consider(prevEnd, maxAddress);
+	return best;
+}
+
+bool DebugCore::displaceInsn(uint64_t address, ThreadState& state)
+{
+	auto it = m_displaced.find(address);
+	if (it == m_displaced.end())
+	{
+		it = m_displaced.emplace(address, relocateInsn(address)).first;
+	}
+
+	auto const& displaced = it->second;
+	if (displaced.jumpTo)
+	{
+		state.rip = displaced.jumpTo;
+	}
+	else if (displaced.slot)
+	{
+		state.rip = displaced.slot;
+	}
+	else
+	{
+		return false;
+	}
+	state.rflags &= ~(1 << 8);
+	return true;
+}
+
+void DebugCore::fixDisplacedRip(ThreadId thread)
+{
+	if (m_scratchPages.empty())
+	{
+		return;
+	}
+
+	ThreadState state;
+	if (!getThreadState(thread, state))
+	{
+		return;
+	}
+	auto inScratch = std::any_of(m_scratchPages.begin(), m_scratchPages.end(), [&state](ScratchPage const& page)
+	{
+		return state.rip - page.address < PageCache::pageSize;
+	});
+	if (!inScratch)
+	{
+		return;
+	}
+
+	for (auto const& it : m_displaced)
+	{
+		auto const& displaced = it.second;
+		for (int i = 0; i < displaced.stopCount; ++i)
+		{
+			if (displaced.stopAt[i] == state.rip)
+			{
+				state.rip = displaced.origin[i];
+				if (!setThreadState(thread, state))
+				{
+					log("In DebugCore::fixDisplacedRip, setThreadState failed", LogType::Error);
+				}
+				return;
+			}
+		}
+	}
+}
+
+bool DebugCore::doContinueDebug()
+{
+	if (m_stopRequested)
+	{
+		return false;
+	}
+
+    ThreadState state;
+    if (!getThreadState(m_excInfo.threadId, state))
+    {
+        log("In DebugCore::doContinueDebug, getThreadState failed", LogType::Error);
+        return false;
+    }
+
+	//查找要继续运行的地址上是否有断点
+	//硬件执行断点设置RF,执行完这条指令之前不会再触发
+	auto bp = findBreakpoint(state.rip);
+	if (bp && bp->enabled() && bp->isHardware() && bp->hardwareType() == Breakpoint::HardwareType::Execute)
+	{
+		state.rflags |= (1 << 16);
+	}
+	bool trap = false;
+	switch (m_continueType)
+	{
+	case ContinueType::ContinueStepIn:
+		trap = true;
+		break;
+	case ContinueType::ContinueStepOver:
+	{
+		//call在返回地址下临时断点后运行,其他指令和读取内存失败时当做单步步入处理
+		auto decoded = decodeInsn(state.rip);
+		trap = !decoded || x64dis::flowKind(decoded->insn) != X86_FLOW_CALL
+			|| !setStepBreakpoint(state.rip + decoded->size, m_excInfo.threadId, state.rsp);
+		break;
+	}
+	case ContinueType::ContinueStepOut:
+	{
+		//在返回地址下临时断点,ret弹出返回地址后的栈就是调用者的栈
+		uint64_t retAddr, slot;
+		if (!findReturnAddress(state.rsp, retAddr, slot))
+		{
+			log("找不到当前函数的返回地址,单步执行", LogType::Warning);
+			trap = true;
+		}
+		else
+		{
+			trap = !setStepBreakpoint(retAddr, m_excInfo.threadId, slot + 8);
+		}
+		break;
+	}
+	case ContinueType::ContinueRunTo:
+		trap = !setStepBreakpoint(m_runToAddress, 0, 0);
+		break;
+	case ContinueType::ContinueTrace:
+	{
+		//内存中放不下的记录写入临时目录
+		auto path = QDir::temp().filePath(QString("saber-trace-%1.bin").arg(m_backend->pid()));
+		if (!m_trace.reset(path.toLocal8Bit().constData()))
+		{
+			log(QString("创建跟踪文件 %1 失败,只保留最近的记录").arg(path), LogType::Warning);
+		}
+		m_trace.record(state);
+		m_traceTimer.start();
+		trap = true;
+		break;
+	}
+	default:
+		break;
+	}
+
+	//临时断点就在当前地址上(比如运行到循环的开头)时先单步越过
+	if (m_stepBP.active && m_stepBP.address == state.rip)
+	{
+		if (!skipStepBreakpoint())
+		{
+			return false;
+		}
+		trap = true;
+	}
+
+	//继续运行时在副本上执行断点处的指令,单步或者不能搬移时先恢复原来的数据,然后单步执行
+	//触发单步异常后,重新写入0xCC
+	if (bp && bp->enabled() && !bp->isHardware() && (trap || !displaceInsn(state.rip, state)))
+	{
+		//TODO: 失败时询问用户是将异常传递给程序还是从断点指令下一条指令执行
+		suspendBreakpoint(bp);
+	}
+
+	//当前地址上有断点时先单步越过,单步步过call时越过后再运行到临时断点
+	if (trap || m_currentHitBP)
+	{
+		state.rflags |= (1 << 8);
+	}
+	else
+	{
+		state.rflags &= ~(1 << 8);
+	}
+
+    logLazy(LogType::Debug, [&state] { return QString("RFLAGS: 0x%1").arg(state.rflags, 0, 16); });
+
+    if (!setThreadState(m_excInfo.threadId, state))
+    {
+        log("In DebugCore::doContinueDebug, setThreadState failed", LogType::Error);
+        return false;
+    }
+
+    return resumeTarget();
+}
+
+bool DebugCore::resumeTarget()
+{
+	//结束调试时线程保持停止,由后端结束或分离
+	if (m_stopRequested)
+	{
+		return false;
+	}
+
+	//调试目标继续运行后内存可能被修改
+	m_memCache.setEnabled(false);
+	flushRegisters(false);
+	return m_backend->resume(m_excInfo.threadId);
+}
+
+void DebugCore::restoreForDetach()
+{
+	//所有线程都已经停下,禁用断点恢复原始数据,之后析构断点时不再访问已分离的进程
+	clearStepBreakpoint();
+	for (auto const& bp : m_breakpoints)
+	{
+		bp->setEnabled(false);
+	}
+}
+
+bool DebugCore::resumeRunning()
+{
+	ThreadState state;
+	if (!getThreadState(m_excInfo.threadId, state))
+	{
+		log("In DebugCore::resumeRunning, getThreadState failed", LogType::Error);
+		return false;
+	}
+
+	state.rflags &= ~(1 << 8);
+	if (!setThreadState(m_excInfo.threadId, state))
+	{
+		log("In DebugCore::resumeRunning, setThreadState failed", LogType::Error);
+		return false;
+	}
+
+	return resumeTarget();
+}
+
+bool DebugCore::setStepBreakpoint(uint64_t address, ThreadId thread, uint64_t stackPointer)
+{
+	clearStepBreakpoint();
+	if (overlapsTracepoint(address))
+	{
+		return false;
+	}
+
+	//地址上有普通断点时读到的是断点保存的原始数据,写入0xCC不影响普通断点
+	uint8_t orgByte;
+	if (!readMemory(address, &orgByte, 1))
+	{
+		log(QString("无法设置临时断点 0x%1").arg(address, 0, 16), LogType::Warning);
+		return false;
+	}
+
+	//和普通断点一样先设置好原始数据再写入0xCC,其他线程读到0xCC时一定会替换
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_stepBP.address = address;
+		m_stepBP.orgByte = orgByte;
+		m_stepBP.thread = thread;
+		m_stepBP.stackPointer = stackPointer;
+		m_stepBP.rearm = false;
+		m_stepBP.active = true;
+		++m_breakpointsVersion;
+	}
+	if (!writeStepByte(Breakpoint::bpData))
+	{
+		std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+		m_stepBP.active = false;
+		++m_breakpointsVersion;
+		log(QString("无法设置临时断点 0x%1").arg(address, 0, 16), LogType::Warning);
+		return false;
+	}
+	return true;
+}
+
+void DebugCore::clearStepBreakpoint()
+{
+	if (!m_stepBP.active)
+	{
+		return;
+	}
+
+	//先恢复原始数据再清除,和删除普通断点的顺序一致
+	auto bp = findBreakpoint(m_stepBP.address);
+	if (!(bp && bp->enabled()) && !writeStepByte(m_stepBP.orgByte))
+	{
+		log(QString("删除临时断点 0x%1 失败").arg(m_stepBP.address, 0, 16), LogType::Warning);
+	}
+
+	std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+	m_stepBP.active = false;
+	++m_breakpointsVersion;
+}
+
+bool DebugCore::writeStepByte(uint8_t byte)
+{
+	//不经过writeMemory,m_stepBP有效时writeMemory会把0xCC写回去
+	auto ok = m_backend->writeMemory(m_stepBP.address, &byte, 1);
+	m_memCache.invalidate(m_stepBP.address, 1);
+	m_insnCache.invalidate(m_stepBP.address, 1);
+	return ok;
+}
+
+bool DebugCore::traceStep()
+{
+	ThreadState state;
+	if (!getThreadState(m_excInfo.threadId, state))
+	{
+		return false;
+	}
+
+	resumeSuspendedBreakpoint();
+
+	m_trace.record(state);
+	if (--m_traceRemaining == 0)
+	{
+		return false;
+	}
+
+	//刚执行的指令触发了数据断点
+	if (m_excInfo.exceptionType == ExceptionType::HardwareBreakpoint)
+	{
+		auto hardwareBP = findHardwareBreakpoint(m_excInfo.debugStatus);
+		if (hardwareBP && hardwareBP->shouldBreak(state))
+		{
+			return false;
+		}
+	}
+
+	//下一条指令上有断点时停下,和运行时遇到断点一样
+	auto flags = state.rflags | (1 << 8);
+	auto bp = findBreakpoint(state.rip);
+	if (bp && bp->enabled() && bp->isExecute())
+	{
+		if (bp->shouldBreak(state) || (!bp->isHardware() && !suspendBreakpoint(bp)))
+		{
+			return false;
+		}
+		if (bp->isHardware())
+		{
+			flags |= (1 << 16);
+		}
+	}
+
+	//Linux下TF在单步异常后仍然保留,不需要再写寄存器
+	if (flags != state.rflags)
+	{
+		state.rflags = flags;
+		if (!setThreadState(m_excInfo.threadId, state))
+		{
+			return false;
+		}
+	}
+	return resumeTarget();
+}
+
+void DebugCore::finishTrace()
+{
+	m_traceRemaining = 0;
+	log(QString("跟踪结束: %1 条指令, 耗时 %2 ms").arg(m_trace.count()).arg(m_traceTimer.elapsed()));
+	emit EventDispatcher::instance()->traceChanged();
+}
+
+bool DebugCore::skipStepBreakpoint()
+{
+	if (!writeStepByte(m_stepBP.orgByte))
+	{
+		log(QString("越过临时断点 0x%1 失败").arg(m_stepBP.address, 0, 16), LogType::Error);
+		return false;
+	}
+
+	std::lock_guard<std::shared_timed_mutex> lock(m_breakpointsMtx);
+	m_stepBP.rearm = true;
+	++m_breakpointsVersion;
+	return true;
+}
+
+bool DebugCore::findReturnAddress(uint64_t stackPointer, uint64_t& address, uint64_t& slot)
+{
+	//没有调试信息时无法可靠地回溯栈帧,取栈上第一个在可执行内存中、前面是一条call的值
+	//在函数开头或ret上时就是[rsp],不用rbp是因为不使用栈帧的函数中rbp可能指向调用者的栈帧
+	static const uint64_t maxScanSize = 0x10000;
+
+	auto regions = getMemoryMap();
+	auto isCode = [&regions](uint64_t address)
+	{
+		auto it = std::upper_bound(regions.begin(), regions.end(), address,
+			[](uint64_t address, MemoryRegion const& r) { return address < r.start; });
+		return it != regions.begin() && address - (it - 1)->start < (it - 1)->size
+			&& ((it - 1)->protection & ProtExecute);
+	};
+	auto followsCall = [this](uint64_t address)
+	{
+		//call rel32是5字节,call r/m是2到7字节
+		uint8_t code[7];
+		if (!readMemory(address - sizeof(code), code, sizeof(code)))
+		{
+			return false;
+		}
+		for (int len = 2; len <= (int)sizeof(code); ++len)
+		{
+			x86dis_insn insn;
+			if (x64dis::decode(code + sizeof(code) - len, len, address - len, insn)
+				&& insn.size == len && x64dis::flowKind(insn) == X86_FLOW_CALL)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	//按页读取,直到栈的末尾
+	uint64_t values[PageCache::pageSize / sizeof(uint64_t)];
+	auto pos = stackPointer;
+	while (pos - stackPointer < maxScanSize)
+	{
+		auto count = (PageCache::pageSize - pos % PageCache::pageSize) / sizeof(uint64_t);
+		if (count == 0 || !readMemory(pos, values, count * sizeof(uint64_t)))
+		{
+			break;
+		}
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			if (isCode(values[i]) && followsCall(values[i]))
+			{
+				address = values[i];
+				slot = pos + i * sizeof(uint64_t);
+				return true;
+			}
+		}
+		pos += count * sizeof(uint64_t);
+	}
+	return false;
+}
+
+bool DebugCore::setRegisterState(ThreadId thread, RegisterType type, uint64_t value)
+{
+	return setRegisters(thread, {RegisterValue{type, value}});
+}
+
+bool DebugCore::setRegisters(ThreadId thread, std::vector<RegisterValue> const& values)
+{
+	ThreadState state;
+	if (!getThreadState(thread, state))
+	{
+		log("In DebugCore::setRegisters, getThreadState failed", LogType::Error);
+		return false;
+	}
+
+	for (auto const& value : values)
+	{
+		switch (value.type)
+		{
+		case RegisterType::RAX :
+			state.rax = value.value;
+			break;
+		case RegisterType::RBX :
+			state.rbx = value.value;
+			break;
+		case RegisterType::RCX :
+			state.rcx = value.value;
+			break;
+		case RegisterType::RDX :
+			state.rdx = value.value;
+			break;
+		case RegisterType::RDI :
+			state.rdi = value.value;
+			break;
+		case RegisterType::RSI :
+			state.rsi = value.value;
+			break;
+		case RegisterType::RBP :
+			state.rbp = value.value;
+			break;
+		case RegisterType::RSP :
+			state.rsp = value.value;
+			break;
+		case RegisterType::R8 :
+			state.r8 = value.value;
+			break;
+		case RegisterType::R9 :
+			state.r9 = value.value;
+			break;
+		case RegisterType::R10 :
+			state.r10 = value.value;
+			break;
+		case RegisterType::R11 :
+			state.r11 = value.value;
+			break;
+		case RegisterType::R12 :
+			state.r12 = value.value;
+			break;
+		case RegisterType::R13 :
+			state.r13 = value.value;
+			break;
+		case RegisterType::R14 :
+			state.r14 = value.value;
+			break;
+		case RegisterType::R15 :
+			state.r15 = value.value;
+			break;
+		case RegisterType::RIP :
+			state.rip = value.value;
+			break;
+		case RegisterType::RFLAGS :
+			state.rflags = value.value;
+			break;
+		case RegisterType::CS :
+			state.cs = value.value;
+			break;
+		case RegisterType::FS :
+			state.fs = value.value;
+			break;
+		case RegisterType::GS :
+			state.gs = value.value;
+			break;
+		}
+	}
+
+	if (!setThreadState(thread, state))
+	{
+		log("In DebugCore::setRegisters, setThreadState failed", LogType::Error);
+		return false;
+	}
+
+	return true;
+}
+
+bool DebugCore::getThreadState(ThreadId thread, ThreadState& state)
+{
+	std::lock_guard<std::mutex> lock(m_registersMtx);
+	if (thread != m_registers.thread)
+	{
+		return m_backend->getThreadState(thread, state);
+	}
+	if (!m_registers.valid)
+	{
+		if (!m_backend->getThreadState(thread, m_registers.state))
+		{
+			return false;
+		}
+		m_registers.valid = true;
+	}
+	state = m_registers.state;
+	return true;
+}
+
+bool DebugCore::setThreadState(ThreadId thread, ThreadState const& state)
+{
+	std::lock_guard<std::mutex> lock(m_registersMtx);
+	if (thread != m_registers.thread)
+	{
+		return m_backend->setThreadState(thread, state);
+	}
+	//没有变化时不标记为dirty
+	if (!m_registers.valid || std::memcmp(&m_registers.state, &state, sizeof(state)) != 0)
+	{
+		m_registers.state = state;
+		m_registers.valid = true;
+		m_registers.dirty = true;
+	}
+	return true;
+}
+
+bool DebugCore::getVectorState(ThreadId thread, VectorState& state)
+{
+	if (std::this_thread::get_id() != m_debugThread.get_id() && !requestVectorState())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_registersMtx);
+	auto vector = loadVectorState(thread);
+	if (!vector)
+	{
+		return false;
+	}
+	state = *vector;
+	return true;
+}
+
+bool DebugCore::readVectorRegister(ThreadId thread, int index, int offset, int size, uint64_t& value)
+{
+	if (std::this_thread::get_id() != m_debugThread.get_id() && !requestVectorState())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_registersMtx);
+	auto vector = loadVectorState(thread);
+	if (!vector || index < 0 || index >= vector->vectorCount || offset < 0 || size < 1 || size > 8
+		|| offset + size > vector->vectorSize)
+	{
+		return false;
+	}
+	value = 0;
+	std::memcpy(&value, vector->zmm[index] + offset, size);
+	return true;
+}
+
+VectorState const* DebugCore::loadVectorState(ThreadId thread)
+{
+	if (thread == 0 || thread != m_registers.thread)
+	{
+		return nullptr;
+	}
+	if (!m_registers.vectorValid)
+	{
+		if (std::this_thread::get_id() != m_debugThread.get_id()
+			|| !m_backend->getVectorState(thread, m_registers.vector))
+		{
+			return nullptr;
+		}
+		m_registers.vectorValid = true;
+	}
+	return &m_registers.vector;
+}
+
+bool DebugCore::requestVectorState()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_registersMtx);
+		if (m_registers.vectorValid)
+		{
+			return true;
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(m_continueMtx);
+	if (!m_waitingContinue)
+	{
+		return false;
+	}
+	m_vectorRequested = true;
+	m_continueCV.notify_all();
+	m_vectorCV.wait(lock, [this] { return !m_vectorRequested; });
+	return true;
+}
+
+bool DebugCore::flushRegisters(bool keep)
+{
+	std::lock_guard<std::mutex> lock(m_registersMtx);
+	bool ok = true;
+	if (m_registers.dirty)
+	{
+		ok = m_backend->setThreadState(m_registers.thread, m_registers.state);
+		if (!ok)
+		{
+			log("In DebugCore::flushRegisters, setThreadState failed", LogType::Error);
+		}
+		m_registers.dirty = false;
+	}
+	m_registers.valid = m_registers.valid && keep;
+	if (!keep)
+	{
+		//目标运行时直接访问后端
+		m_registers.thread = 0;
+		m_registers.vectorValid = false;
+	}
+	return ok;
 }
 
 
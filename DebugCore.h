@@ -2,31 +2,39 @@
 #pragma once
 
 #include <vector>
+#include <map>
 #include <thread>
 #include <memory>
 #include <string>
+#include <mutex>
+#include <shared_mutex>
 #include <condition_variable>
+#include <atomic>
 
 #include <sys/types.h>
 #include <unistd.h>
-#include <mach/mach_vm.h>
-#include <sys/ptrace.h>
-#include <sys/wait.h>
 
 #include <QObject>
+#include <QElapsedTimer>
 
 #include "Common.h"
 #include "Breakpoint.h"
-#include "TargetException.h"
+#include "TargetBackend.h"
+#include "PageCache.h"
+#include "InsnCache.h"
+#include "FlowAnalysis.h"
+#include "TraceRecorder.h"
+#include "AgentChannel.h"
 
 
-class DebugProcess;
-
 enum class ContinueType
 {
 	ContinueRun,
 	ContinueStepIn,
-	ContinueStepOver
+	ContinueStepOver,
+	ContinueStepOut,
+	ContinueRunTo,
+	ContinueTrace
 };
 
 class DebugCore : public std::enable_shared_from_this<DebugCore>
@@ -37,8 +45,12 @@ public:
 
 	std::vector<MemoryRegion> getMemoryMap();
     bool findRegion(uint64_t address, uint64_t& start, uint64_t& size);
-    bool readMemory(mach_vm_address_t address, void* buffer, mach_vm_size_t size, bool bypassBreakpoint = true);
-    bool writeMemory(mach_vm_address_t address, const void* buffer, mach_vm_size_t size, bool bypassBreakpoint = true);
+    bool readMemory(uint64_t address, void* buffer, uint64_t size, bool bypassBreakpoint = true);
+    bool writeMemory(uint64_t address, const void* buffer, uint64_t size, bool bypassBreakpoint = true);
+	//读取内存并解码一条指令,结果会被缓存,读取失败返回nullptr
+	std::shared_ptr<const DecodedInsn> decodeInsn(uint64_t address, int maxLen = 15);
+	//后台从入口点分析得到的函数和基本块,分析没有完成时只包含部分结果
+	std::shared_ptr<const FlowGraph> flowGraph() { return m_flowAnalysis.graph(); }
 
     bool debugNew(const QString &path, const QString &args);
 	bool attach(pid_t pid);
@@ -47,10 +59,28 @@ public:
     void continueDebug();
 	void stepIn();
 	void stepOver();
-    mach_vm_address_t findBaseAddress();
+	//运行到当前函数返回
+	void stepOut();
+	//运行到address处停下,address不可读时返回false
+	bool runTo(uint64_t address);
+	//单步执行最多count条指令并记录寄存器,期间不通知界面,遇到断点或其他异常时停止
+	void trace(uint64_t count);
+	TraceRecorder& traceRecorder() { return m_trace; }
     bool getEntryAndDataAddr();
-    Register getAllRegisterState(mach_port_t thread);
-	bool setRegisterState(mach_port_t thread, RegisterType type, uint64_t value);
+    Register getAllRegisterState(ThreadId thread);
+	bool setRegisterState(ThreadId thread, RegisterType type, uint64_t value);
+	struct RegisterValue
+	{
+		RegisterType type;
+		uint64_t value;
+	};
+	//一次修改多个寄存器,修改写入缓存,继续运行前和其他修改一起写回
+	bool setRegisters(ThreadId thread, std::vector<RegisterValue> const& values);
+	//读取停下的线程的x87/SSE/AVX/AVX-512寄存器,每次停止后第一次调用时读取
+	//可以在界面线程中调用,调试目标停下等待继续时由调试线程读取
+	bool getVectorState(ThreadId thread, VectorState& state);
+	//读取向量寄存器index中从offset开始的size(1/2/4/8)个字节,超出CPU支持的范围时返回false
+	bool readVectorRegister(ThreadId thread, int index, int offset, int size, uint64_t& value);
 
     using BreakpointPtr = std::shared_ptr<Breakpoint>;
 	using BreakpointWeakPtr = std::weak_ptr<Breakpoint>;
@@ -58,8 +88,39 @@ public:
 	bool removeBreakpoint(uint64_t address);
 	bool removeBreakpoint(BreakpointPtr bp);
     bool addOrEnableBreakpoint(uint64_t address, bool isHardware = false, bool oneTime = false);
+	//使用调试寄存器的断点,最多4个,size为1/2/4/8且address按size对齐,执行断点的size为1
+	bool addHardwareBreakpoint(uint64_t address, Breakpoint::HardwareType type, int size,
+		bool enabled = true, bool oneTime = false);
+	//由Breakpoint::setEnabled调用,分配或释放调试寄存器
+	bool setHardwareBreakpoint(Breakpoint* bp, bool enabled);
+	//批量启用(不存在则添加)或禁用断点,同一页内的修改合并为一次写入,只发送一次breakpointChanged
+	bool setBreakpoints(std::vector<uint64_t> const& addresses, bool enabled);
     BreakpointPtr findBreakpoint(uint64_t address);
 	std::vector<BreakpointPtr> const& breakpoints(){ return m_breakpoints; }
+	//使用注入到调试目标中的agent(SaberAgent)在函数入口记录命中,命中时不产生调试异常
+	//需要在debugNew()之前调用,library为agent动态库的路径,附加的进程不能使用
+	bool enableAgent(QString const& library);
+	bool agentEnabled() { return m_agent.isOpen(); }
+	//在address处安装inline hook,由agent在调试目标中异步完成,结果通过tracepointState()查询
+	//hook覆盖address开始的5字节,其他代码跳到这5字节中间时会出错,address应该是函数入口
+	bool addTracepoint(uint64_t address);
+	bool removeTracepoint(uint64_t address);
+	std::vector<uint64_t> const& tracepoints() { return m_tracepoints; }
+	AgentHookState tracepointState(uint64_t address) { return m_agent.state(address); }
+	//跳板中计数的命中次数,不受记录被覆盖的影响
+	uint64_t tracepointHits(uint64_t address) { return m_agent.hits(address); }
+	//[address, address + size)在跟踪点搬移的指令范围内,这里的0xCC会被agent复制到跳板或者在移除时被覆盖
+	bool overlapsTracepoint(uint64_t address, uint64_t size = 1);
+	//取出agent记录的每次命中的详细信息,调试目标运行时也可以调用,dropped加上来不及读取被覆盖的记录数
+	std::size_t drainTracepointHits(std::vector<AgentRecord>& records, uint64_t& dropped);
+	//不通知界面就继续运行的停止(条件不满足的断点,越过断点的单步,跟踪中的单步等)
+	//和这些停止中调试线程分配内存的次数,正常情况下每次停止为0
+	struct DispatchStats
+	{
+		uint64_t stops;
+		uint64_t allocations;
+	};
+	DispatchStats dispatchStats() { return DispatchStats{m_quietStops, m_quietAllocations}; }
 	uint64_t excAddr() { return m_excAddr; }
 	uint64_t entryAddr() { return m_entryAddr; }
 	uint64_t dataAddr() { return m_dataAddr; }
@@ -67,24 +128,80 @@ public:
 	ExceptionInfo const& excInfo() { return m_excInfo; }
 private:
     void debugLoop();
+	//异常回调,统计分配次数后调用handleException
+	bool onException(ExceptionInfo const& info);
     bool handleException(ExceptionInfo const& info);
 
     bool handleBreakpoint();
-private:
-//    QString m_path;
-//    QString m_args;
+	//从入口点所在的区域开始分析函数
+	void startFlowAnalysis();
 
-	bool m_isAttach;
+	//在m_breakpoints中二分查找
+	std::vector<BreakpointPtr>::iterator lowerBound(uint64_t address);
+	std::pair<std::vector<BreakpointPtr>::iterator, std::vector<BreakpointPtr>::iterator>
+		breakpointRange(uint64_t address, uint64_t size);
+private:
+	std::unique_ptr<TargetBackend> m_backend;
+	PageCache m_memCache;
+	InsnCache m_insnCache;
 
 	std::thread m_debugThread;
 
+	//DR0-DR3对应的硬件断点,断点析构时会访问,放在m_breakpoints前面
+	Breakpoint* m_hardwareSlots[4] = {};
+	DebugRegisters debugRegisters();
+	//debugStatus为DR6
+	Breakpoint* findHardwareBreakpoint(uint64_t debugStatus);
+
+    //按地址排序
     std::vector<BreakpointPtr> m_breakpoints;
+	//反汇编和流程分析线程通过readMemory读取m_breakpoints和m_stepBP,readMemory加共享锁
+	//修改只在UI和调试线程中进行,修改时加独占锁,这两个线程自己读取时不需要加锁
+	//新断点先加入再写入0xCC,删除时先恢复原始数据再移除
+	std::shared_timed_mutex m_breakpointsMtx;
+	//每次在独占锁内修改后加1,readMemory不加锁读取内存,替换断点时发现版本变化就重新读取
+	std::atomic<uint64_t> m_breakpointsVersion{0};
 
     std::vector<Segment> m_segments;
 
     void waitForContinue();
     std::mutex m_continueMtx;
     std::condition_variable m_continueCV;
+	//停下的线程的通用寄存器,停下后第一次访问时从后端读取,之后的读取和修改都在缓存中进行
+	//有修改时在继续运行前写回一次,其他线程直接访问后端
+	struct RegisterCache
+	{
+		ThreadId thread = 0;
+		bool valid = false;
+		bool dirty = false;
+		ThreadState state;
+		bool vectorValid = false;
+		VectorState vector;
+	};
+	bool getThreadState(ThreadId thread, ThreadState& state);
+	bool setThreadState(ThreadId thread, ThreadState const& state);
+	//写回修改过的寄存器,keep为false时目标即将继续运行,之后的访问都交给后端
+	bool flushRegisters(bool keep);
+	RegisterCache m_registers;
+	//界面线程修改寄存器时调试线程也可能在访问
+	std::mutex m_registersMtx;
+	//调用时持有m_registersMtx,只缓存停下的线程,只在调试线程中从后端读取
+	VectorState const* loadVectorState(ThreadId thread);
+	//界面线程请求停在waitForContinue()中的调试线程读取向量寄存器,Linux下只有调试线程能访问调试目标的线程
+	bool requestVectorState();
+	//以下由m_continueMtx保护
+	bool m_waitingContinue = false;
+	bool m_vectorRequested = false;
+	//stop()请求结束调试,设置时持有m_continueMtx,调试线程不再等待继续也不再让目标继续运行
+	std::atomic<bool> m_stopRequested{false};
+	std::condition_variable m_vectorCV;
+
+	//这次异常是否通知了界面
+	bool m_notified = false;
+	//没有打开SABER_COUNT_ALLOCATIONS时分配次数总是0
+	uint64_t m_lastAllocations = 0;
+	std::atomic<uint64_t> m_quietStops{0};
+	std::atomic<uint64_t> m_quietAllocations{0};
 
 	uint64_t m_entryAddr = 0;
 	uint64_t m_dataAddr = 0;
@@ -95,9 +212,92 @@ private:
 
 	ContinueType m_continueType = ContinueType::ContinueRun;
 	bool doContinueDebug();
+	bool resumeTarget();
+	//分离附加的进程前恢复所有断点处的原始数据
+	void restoreForDetach();
+	//清除TF后继续运行
+	bool resumeRunning();
+	//不需要停下的单步和断点异常在这里继续运行,返回false时按普通异常处理
+	bool resumeQuietly();
+	//恢复断点处的原始数据以便单步越过,断点仍然是启用状态,不发送breakpointChanged
+	bool suspendBreakpoint(BreakpointPtr const& bp);
+	//单步越过后重新写入0xCC
+	void resumeSuspendedBreakpoint();
 
-	DebugProcess* m_process;
+	//继续运行时不恢复断点处的原始数据,而是在调试目标中执行这条指令的副本,执行完后跳回原来的位置
+	//断点一直是启用状态,每次命中只有一次异常,副本在第一次命中时生成,之后重复使用
+	struct DisplacedInsn
+	{
+		//副本的地址,为0时这条指令不能搬移(比如int3和间接call),按单步越过处理
+		uint64_t slot = 0;
+		//不为0时是直接跳转,不需要副本,直接修改rip
+		uint64_t jumpTo = 0;
+		int size = 0;
+		//线程可能在副本中停下的位置(比如副本中的指令触发了数据断点)和对应的原始地址
+		int stopCount = 0;
+		uint64_t stopAt[4];
+		uint64_t origin[4];
+	};
+	//副本所在的页,每页按slotSize分为多个副本
+	struct ScratchPage
+	{
+		uint64_t address;
+		uint64_t used;
+	};
+	static const uint64_t slotSize = 64;
+	//修改state让线程从address处指令的副本开始执行,不能搬移时返回false
+	bool displaceInsn(uint64_t address, ThreadState& state);
+	DisplacedInsn relocateInsn(uint64_t address);
+	//near为true时副本必须在address的rip相对寻址范围内,address是指令访问的数据
+	bool allocateSlot(uint64_t address, bool near, uint64_t& slot);
+	//在address附近找一块没有映射的内存作为新页的地址
+	uint64_t findScratchHint(uint64_t address);
+	//线程停在副本中时把rip改回原来的地址,界面上不会看到副本
+	void fixDisplacedRip(ThreadId thread);
+	//按原始地址排序
+	std::map<uint64_t, DisplacedInsn> m_displaced;
+	std::vector<ScratchPage> m_scratchPages;
 
+	//单步步过使用的临时断点,不加入m_breakpoints,也不发送breakpointChanged
+	//读写内存时和普通断点一样对调用者隐藏
+	struct StepBreakpoint
+	{
+		uint64_t address = 0;
+		uint8_t orgByte = 0;
+		//只在这个线程回到下断点时的栈上时才算单步步过完成,stackPointer为0时任何线程执行到这里都停下
+		ThreadId thread = 0;
+		uint64_t stackPointer = 0;
+		bool active = false;
+		//被其他线程或更深的递归触发,正在单步越过,单步异常后重新写入0xCC
+		bool rearm = false;
+	};
+	bool setStepBreakpoint(uint64_t address, ThreadId thread, uint64_t stackPointer);
+	void clearStepBreakpoint();
+	//直接写入临时断点处的一个字节
+	bool writeStepByte(uint8_t byte);
+	//恢复临时断点处的原始数据,单步越过后重新写入0xCC
+	bool skipStepBreakpoint();
+	StepBreakpoint m_stepBP;
+	uint64_t m_runToAddress = 0;
+
+	//跟踪时处理单步异常,跟踪结束时返回false,按普通的单步停下
+	bool traceStep();
+	void finishTrace();
+	uint64_t m_traceRemaining = 0;
+	TraceRecorder m_trace;
+	QElapsedTimer m_traceTimer;
+
+	//从栈顶开始查找当前函数的返回地址,slot为返回地址在栈中的位置
+	bool findReturnAddress(uint64_t stackPointer, uint64_t& address, uint64_t& slot);
+
+	//正在单步越过的断点
 	BreakpointPtr m_currentHitBP;
+
+	AgentChannel m_agent;
+	//按地址排序
+	std::vector<uint64_t> m_tracepoints;
+
+	//工作线程会读取内存,放在最后最先析构
+	FlowAnalysis m_flowAnalysis;
 };
 
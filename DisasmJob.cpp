@@ -0,0 +1,250 @@
+#include "DisasmJob.h"
+#include "libasmx64.h"
+#include "global.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+
+//每段1024块(4MiB),一次读取超过PageCache的上限,不会把缓存冲掉
+static const uint64_t chunksPerSegment = 1024;
+static const uint64_t resyncOverlap = 64;
+static const uint64_t maxInsnSize = 15;
+
+DisasmJob::DisasmJob(uint64_t start, uint64_t size, InsnIndex::ReadMemory readMemory, QObject* parent)
+	: QObject(parent)
+	, m_start(start)
+	, m_size(size)
+	, m_readMemory(std::move(readMemory))
+	, m_nextSegment(0)
+	, m_remaining(0)
+	, m_cancel(false)
+{
+	m_segments.resize((chunkCount() + chunksPerSegment - 1) / chunksPerSegment);
+}
+
+DisasmJob::~DisasmJob()
+{
+	cancel();
+}
+
+void DisasmJob::start()
+{
+	m_remaining = m_segments.size();
+	auto count = std::max(1u, std::thread::hardware_concurrency());
+	count = std::min<std::size_t>(count, m_segments.size());
+	for (unsigned i = 0; i < count; ++i)
+	{
+		m_threads.emplace_back([this] { worker(); });
+	}
+}
+
+void DisasmJob::cancel()
+{
+	m_cancel = true;
+	for (auto& t : m_threads)
+	{
+		if (t.joinable())
+		{
+			t.join();
+		}
+	}
+	m_threads.clear();
+}
+
+std::vector<DisasmJob::Chunk> DisasmJob::takeResults()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	std::vector<Chunk> results;
+	results.swap(m_results);
+	return results;
+}
+
+void DisasmJob::worker()
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	for (;;)
+	{
+		auto segment = m_nextSegment++;
+		if (segment >= m_segments.size() || m_cancel)
+		{
+			return;
+		}
+
+		auto firstChunk = segment * chunksPerSegment;
+		auto segStart = m_start + firstChunk * InsnIndex::chunkSize;
+		auto from = segment == 0 ? segStart : segStart - resyncOverlap;
+
+		std::vector<Chunk> chunks;
+		if (!decodeChunks(from, firstChunk, std::min(firstChunk + chunksPerSegment, chunkCount()), chunks))
+		{
+			//读取失败的段交给InsnIndex按需处理
+			chunks.clear();
+		}
+
+		bool notify = false;
+		std::size_t joins[2];
+		std::size_t joinCount = 0;
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			auto& seg = m_segments[segment];
+			seg.done = true;
+			for (auto& c : chunks)
+			{
+				seg.chunkEnds.push_back(c.end);
+			}
+			notify = publish(chunks);
+
+			//和前后两段的衔接处
+			if (segment > 0 && claimJoin(segment))
+			{
+				joins[joinCount++] = segment;
+			}
+			if (segment + 1 < m_segments.size() && claimJoin(segment + 1))
+			{
+				joins[joinCount++] = segment + 1;
+			}
+		}
+
+		for (std::size_t i = 0; i < joinCount; ++i)
+		{
+			notify = resync(joins[i]) || notify;
+		}
+
+		if (notify)
+		{
+			emit progress();
+		}
+
+		if (--m_remaining == 0)
+		{
+			log(QString("后台反汇编完成: 0x%1, %2 字节, 耗时 %3 ms")
+				.arg(m_start, 0, 16).arg(m_size).arg(timer.elapsed()));
+			emit finished();
+		}
+	}
+}
+
+bool DisasmJob::decodeChunks(uint64_t from, uint64_t firstChunk, uint64_t lastChunk, std::vector<Chunk>& chunks)
+{
+	auto end = m_start + m_size;
+	auto rangeEnd = std::min(m_start + lastChunk * InsnIndex::chunkSize, end);
+	auto bufEnd = std::min(rangeEnd + maxInsnSize, end);
+
+	std::vector<uint8_t> buf(bufEnd - from);
+	if (!m_readMemory(from, buf.data(), buf.size()))
+	{
+		bufEnd = rangeEnd;
+		buf.resize(bufEnd - from);
+		if (!m_readMemory(from, buf.data(), buf.size()))
+		{
+			return false;
+		}
+	}
+
+	//批量解码,按块的边界切分结果
+	x86dis_rec recs[512];
+	std::size_t count = 0;
+	std::size_t next = 0;
+	auto pos = from;
+	for (auto index = firstChunk; index < lastChunk; ++index)
+	{
+		if (m_cancel)
+		{
+			return false;
+		}
+
+		auto cs = m_start + index * InsnIndex::chunkSize;
+		auto ce = std::min(cs + InsnIndex::chunkSize, end);
+		Chunk chunk;
+		chunk.index = index;
+		while (pos < ce)
+		{
+			if (next == count)
+			{
+				next = 0;
+				count = pos < bufEnd
+					? x64dis::decodeBatch(buf.data() + (pos - from), bufEnd - pos, pos, recs, 512, X86DIS_BATCH_LENGTH_ONLY)
+					: 0;
+			}
+
+			uint64_t size = next < count ? recs[next++].size : 1;
+			if (pos >= cs)
+			{
+				chunk.starts.push_back((uint16_t)(pos - cs));
+			}
+			pos += std::max<uint64_t>(size, 1);
+		}
+		chunk.end = pos;
+		chunks.emplace_back(std::move(chunk));
+	}
+
+	return true;
+}
+
+bool DisasmJob::claimJoin(std::size_t segment)
+{
+	auto& prev = m_segments[segment - 1];
+	auto& seg = m_segments[segment];
+	if (!prev.done || !seg.done || prev.chunkEnds.empty() || seg.chunkEnds.empty() || seg.joined)
+	{
+		return false;
+	}
+
+	seg.joined = true;
+	return true;
+}
+
+bool DisasmJob::resync(std::size_t segment)
+{
+	uint64_t pos;
+	std::vector<uint64_t> ends;
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		pos = m_segments[segment - 1].chunkEnds.back();
+		ends = m_segments[segment].chunkEnds;
+	}
+
+	//从前一段的结束位置逐块重新解码,块的结束位置和原来相同时说明已经重合
+	//段开头按重叠区域对齐正确时只需要重新解码第一块(结束位置相同但块内开头的几条指令可能不同,所以仍然发布)
+	auto firstChunk = segment * chunksPerSegment;
+	std::vector<Chunk> chunks;
+	std::size_t count = 0;
+	while (count < ends.size())
+	{
+		if (!decodeChunks(pos, firstChunk + count, firstChunk + count + 1, chunks))
+		{
+			break;
+		}
+
+		pos = chunks.back().end;
+		bool converged = ends[count] == pos;
+		ends[count++] = pos;
+		if (converged)
+		{
+			break;
+		}
+	}
+
+	if (chunks.empty())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto& seg = m_segments[segment];
+	std::copy(ends.begin(), ends.begin() + count, seg.chunkEnds.begin());
+	return publish(chunks);
+}
+
+bool DisasmJob::publish(std::vector<Chunk>& chunks)
+{
+	bool wasEmpty = m_results.empty();
+	for (auto& c : chunks)
+	{
+		m_results.emplace_back(std::move(c));
+	}
+	return wasEmpty && !m_results.empty();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "InsnIndex.h"
+
+#include <QObject>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//后台多线程线性扫描反汇编
+//区域按段分给多个线程解码
+//段的开头从前面一小段开始解码来对齐,相邻两段都完成后检查衔接处,不一致时从前一段的结束位置重新解码
+//解码结果按InsnIndex的块发布,通过progress()信号通知,在GUI线程调用takeResults()取走
+class DisasmJob : public QObject
+{
+	Q_OBJECT
+public:
+	struct Chunk
+	{
+		uint64_t index;
+		std::vector<uint16_t> starts;
+		uint64_t end;
+	};
+
+	DisasmJob(uint64_t start, uint64_t size, InsnIndex::ReadMemory readMemory, QObject* parent = nullptr);
+	~DisasmJob();
+
+	void start();
+	void cancel();
+	std::vector<Chunk> takeResults();
+
+signals:
+	void progress();
+	void finished();
+
+private:
+	struct Segment
+	{
+		bool done = false;
+		//和前一段的衔接处已经由某个线程认领,每个衔接处只重新解码一次
+		bool joined = false;
+		//每一块的结束位置,用于判断重新解码是否已经和原来的结果重合
+		std::vector<uint64_t> chunkEnds;
+	};
+
+	void worker();
+	uint64_t chunkCount() const { return (m_size + InsnIndex::chunkSize - 1) / InsnIndex::chunkSize; }
+	bool decodeChunks(uint64_t from, uint64_t firstChunk, uint64_t lastChunk, std::vector<Chunk>& chunks);
+	//在m_mtx内调用,segment和前一段都完成且衔接处没有被认领时认领并返回true
+	bool claimJoin(std::size_t segment);
+	//在m_mtx外解码,只在读取状态和发布结果时加锁
+	bool resync(std::size_t segment);
+	bool publish(std::vector<Chunk>& chunks);
+
+	uint64_t m_start;
+	uint64_t m_size;
+	InsnIndex::ReadMemory m_readMemory;
+
+	std::vector<std::thread> m_threads;
+	std::atomic<std::size_t> m_nextSegment;
+	std::atomic<std::size_t> m_remaining;
+	std::atomic<bool> m_cancel;
+
+	std::mutex m_mtx;
+	std::vector<Segment> m_segments;
+	std::vector<Chunk> m_results;
+};
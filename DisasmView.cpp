@@ -7,6 +7,8 @@
 
 #include <QtWidgets>
 
+#include <climits>
+
 DisasmView::DisasmView(QWidget *parent)
     : QAbstractScrollArea(parent),
       m_regionStart(0),m_regionSize(0)
@@ -18,6 +20,10 @@ DisasmView::DisasmView(QWidget *parent)
 					 viewport(), static_cast<void(QWidget::*)()>(&QWidget::update));
 	QObject::connect(EventDispatcher::instance(), &EventDispatcher::breakpointChanged,
 					 viewport(), static_cast<void(QWidget::*)()>(&QWidget::update));
+	QObject::connect(EventDispatcher::instance(), &EventDispatcher::flowGraphChanged, this, &DisasmView::onFlowGraphChanged);
+	QObject::connect(EventDispatcher::instance(), &EventDispatcher::memoryWritten, this, &DisasmView::onMemoryWritten);
+	QObject::connect(verticalScrollBar(), &QScrollBar::actionTriggered, this, &DisasmView::onScrollAction);
+	QObject::connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &DisasmView::onScrollValueChanged);
 }
 
 void DisasmView::gotoAddress(uint64_t address)
@@ -27,30 +33,18 @@ void DisasmView::gotoAddress(uint64_t address)
 	{
 		return;
 	}
-    m_currentAddress = address;
-    if (!(address >= m_regionStart && address <= (m_regionStart + m_regionSize)))
+    if (!m_index.contains(address))
     {
         setRegion(address);
-    }
-
-    m_foundIndex = false;
-    std::size_t i = 0;
-    for (; i < m_insnStart.size(); ++i)
-    {
-        auto tmp = m_insnStart[i];
-        if (tmp == address)
-        {
-            m_foundIndex = true;
-            break;
-        }
-        else if (tmp > address)
+        if (!m_index.contains(address))
         {
-            break;
+            return;
         }
     }
 
-    verticalScrollBar()->setValue(i);
-	viewport()->update();
+	//跳转的目标一定是指令边界
+	m_index.addAnchor(address);
+	setTopAddress(address);
 }
 
 void DisasmView::setRegion(uint64_t address)
@@ -77,26 +71,161 @@ void DisasmView::analysis()
 		return;
 	}
     log(QString("in analysis: %1, %2").arg(m_regionStart,0,16).arg(m_regionSize,0,16));
-    std::vector<uint8_t> buf(m_regionSize);
-    if (!dbgcore->readMemory(m_regionStart, buf.data(), buf.size()))
-    {
-        log("In DisasmView::analysis, readMemory failed", LogType::Warning);
-        return;
-    }
 
-    uint64_t addr = m_regionStart;
-    x64dis decoder;
-    for (int i = 0;i < buf.size();)
-    {
-        x86dis_insn* insn = decoder.decode(buf.data() + i, buf.size() - i, addr);
-        //const char* pcsIns = decoder.str(insn, DIS_STYLE_HEX_ASMSTYLE | DIS_STYLE_HEX_UPPERCASE | DIS_STYLE_HEX_NOZEROPAD | DIS_STYLE_SIGNED | X86DIS_STYLE_EXPLICIT_MEMSIZE);
-        //printf("0x%016" PRIX64 "\t%s\n", addr, pcsIns);
-        m_insnStart.emplace_back(addr);
-        addr += insn->size;
-        i += insn->size;
-    }
+	//显示时按需解码,同时在后台线程中解码整个区域
+	std::weak_ptr<DebugCore> weakCore = dbgcore;
+	auto readMemory = [weakCore](uint64_t address, void* buffer, uint64_t size)
+	{
+		auto dbgcore = weakCore.lock();
+		return dbgcore && dbgcore->readMemory(address, buffer, size);
+	};
+	m_job.reset();
+	m_index.reset(m_regionStart, m_regionSize, readMemory);
+	m_topAddress = m_regionStart;
+
+	m_job.reset(new DisasmJob(m_regionStart, m_regionSize, readMemory));
+	QObject::connect(m_job.get(), &DisasmJob::progress, this, &DisasmView::onDisasmProgress);
+	m_job->start();
+	m_flowBlocks = 0;
+	onFlowGraphChanged();
 
-    verticalScrollBar()->setMaximum(static_cast<int>(m_insnStart.size() - 1));
+	m_scrollShift = 0;
+	while (((m_regionSize - 1) >> m_scrollShift) > INT_MAX)
+	{
+		++m_scrollShift;
+	}
+	verticalScrollBar()->setMaximum(m_regionSize == 0 ? 0 : static_cast<int>((m_regionSize - 1) >> m_scrollShift));
+	verticalScrollBar()->setPageStep(std::max(1, (visibleLines() * 4) >> m_scrollShift));
+}
+
+void DisasmView::onDisasmProgress()
+{
+	if (!m_job)
+	{
+		return;
+	}
+
+	for (auto& chunk : m_job->takeResults())
+	{
+		m_index.setChunk(chunk.index, std::move(chunk.starts), chunk.end);
+	}
+
+	//第一行可能因为重新对齐不再是指令边界
+	if (m_index.contains(m_topAddress))
+	{
+		m_topAddress = m_index.ceil(m_topAddress);
+	}
+	viewport()->update();
+}
+
+void DisasmView::onMemoryWritten(uint64_t address, uint64_t size)
+{
+	//先取走后台解码的结果,它们可能是写入前的内容
+	if (m_job)
+	{
+		for (auto& chunk : m_job->takeResults())
+		{
+			m_index.setChunk(chunk.index, std::move(chunk.starts), chunk.end);
+		}
+	}
+
+	m_index.invalidate(address, size);
+	if (m_index.contains(m_topAddress))
+	{
+		m_topAddress = m_index.ceil(m_topAddress);
+	}
+	viewport()->update();
+}
+
+void DisasmView::onFlowGraphChanged()
+{
+	auto dbgcore = m_debugCore.lock();
+	if (!dbgcore)
+	{
+		return;
+	}
+
+	//块的开头一定是指令边界,作为锚点让线性扫描和递归下降的结果对齐
+	//新的结果只在后面追加块,之前加过的不再重复
+	auto graph = dbgcore->flowGraph();
+	auto& blocks = graph->blocks();
+	if (blocks.size() < m_flowBlocks)
+	{
+		m_flowBlocks = 0;
+	}
+	for (auto i = m_flowBlocks; i < blocks.size(); ++i)
+	{
+		m_index.addAnchor(blocks[i].start);
+	}
+	m_flowBlocks = blocks.size();
+
+	if (m_index.contains(m_topAddress))
+	{
+		m_topAddress = m_index.ceil(m_topAddress);
+	}
+	viewport()->update();
+}
+
+void DisasmView::setTopAddress(uint64_t address)
+{
+	m_topAddress = address;
+	verticalScrollBar()->setValue(scrollValue(address));
+	viewport()->update();
+}
+
+int DisasmView::scrollValue(uint64_t address)
+{
+	return static_cast<int>((address - m_regionStart) >> m_scrollShift);
+}
+
+int DisasmView::visibleLines()
+{
+	return std::max(1, viewport()->height() / viewport()->fontMetrics().height());
+}
+
+void DisasmView::onScrollAction(int action)
+{
+	//按行和按页滚动需要按指令边界移动,不能直接按字节移动
+	uint64_t top = m_topAddress;
+	switch (action)
+	{
+	case QAbstractSlider::SliderSingleStepAdd:
+		top = m_index.next(m_topAddress);
+		break;
+	case QAbstractSlider::SliderSingleStepSub:
+		top = m_index.prev(m_topAddress);
+		break;
+	case QAbstractSlider::SliderPageStepAdd:
+		top = m_index.next(m_topAddress, visibleLines() - 1);
+		break;
+	case QAbstractSlider::SliderPageStepSub:
+		top = m_index.prev(m_topAddress, visibleLines() - 1);
+		break;
+	default:
+		return;
+	}
+
+	if (top >= m_index.end())
+	{
+		top = m_topAddress;
+	}
+	m_topAddress = top;
+	verticalScrollBar()->setSliderPosition(scrollValue(top));
+	viewport()->update();
+}
+
+void DisasmView::onScrollValueChanged(int value)
+{
+	//拖动滚动条时对齐到该位置之后的第一条指令
+	if (value != scrollValue(m_topAddress))
+	{
+		auto top = m_index.ceil(m_regionStart + ((uint64_t)value << m_scrollShift));
+		if (top < m_index.end())
+		{
+			m_topAddress = top;
+		}
+	}
+	viewport()->update();
 }
 
 void DisasmView::paintEvent(QPaintEvent * e)
@@ -107,22 +236,14 @@ void DisasmView::paintEvent(QPaintEvent * e)
 		return;
 	}
 
-    if (m_insnStart.size() <= verticalScrollBar()->value())
+    if (!m_index.contains(m_topAddress))
     {
         return;
     }
     QPainter p(viewport());
+	auto graph = dbgcore->flowGraph();
 
-    x64dis decoder;
-    uint64_t addr = 0;
-    if (!m_foundIndex)
-    {
-        addr = m_currentAddress;
-    }
-    else
-    {
-        addr = m_insnStart[verticalScrollBar()->value()];
-    }
+    uint64_t addr = m_topAddress;
 
     int h = viewport()->fontMetrics().height();
     for (int i = 0; i < viewport()->height(); i += h)
@@ -131,13 +252,9 @@ void DisasmView::paintEvent(QPaintEvent * e)
         {
             break;
         }
-        int size = std::min(15ull, m_regionStart + m_regionSize - addr);
-        uint8_t buff[15];
-        //FIXME:判断读取是否成功
-		dbgcore->readMemory(addr, buff, size);
-        x86dis_insn* insn = decoder.decode(buff, size, addr);
-        const char* insnStr = decoder.str(insn, DIS_STYLE_HEX_ASMSTYLE | DIS_STYLE_HEX_UPPERCASE | DIS_STYLE_HEX_NOZEROPAD | DIS_STYLE_SIGNED | X86DIS_STYLE_EXPLICIT_MEMSIZE);
-        //printf("0x%016" PRIX64 "\t%s\n", addr, pcsIns);
+        int size = std::min<uint64_t>(15, m_regionStart + m_regionSize - addr);
+        auto insn = dbgcore->decodeInsn(addr, size);
+        const char* insnStr = insn ? insn->text.c_str() : "??";
 
         QRect rc(0, i, viewport()->width(), h);
 		auto bp = dbgcore->findBreakpoint(addr);
@@ -161,7 +278,12 @@ void DisasmView::paintEvent(QPaintEvent * e)
             p.fillRect(rc, Qt::lightGray);
         }
         p.drawText(rc, 0, QString::number(addr, 16).append("\t\t").append(insnStr));
-        addr += insn->size;
+		if (graph->functionAt(addr))
+		{
+			//函数开头画一条分隔线
+			p.drawLine(rc.topLeft(), rc.topRight());
+		}
+        addr = m_index.next(addr);
     }
 
     QAbstractScrollArea::paintEvent(e);
@@ -176,42 +298,16 @@ void DisasmView::mousePressEvent(QMouseEvent *event)
 		return;
 	}
 
-    if (m_insnStart.size() <= verticalScrollBar()->value())
+    if (!m_index.contains(m_topAddress))
     {
         return;
     }
 
-    x64dis decoder;
-    uint64_t addr = 0;
-    if (!m_foundIndex)
-    {
-        addr = m_currentAddress;
-    }
-    else
-    {
-        addr = m_insnStart[verticalScrollBar()->value()];
-    }
-
     int h = viewport()->fontMetrics().height();
-    auto y = event->pos().y();
-    for (int i = 0; i < viewport()->height(); i += h)
+    auto addr = m_index.next(m_topAddress, event->pos().y() / h);
+    if (addr < m_index.end())
     {
-        if ((m_regionStart + m_regionSize) <= addr)
-        {
-            break;
-        }
-        int size = std::min(15ull, m_regionStart + m_regionSize - addr);
-        uint8_t buff[15];
-        //FIXME:判断读取是否成功
-		dbgcore->readMemory(addr, buff, size);
-        x86dis_insn* insn = decoder.decode(buff, size, addr);
-
-        if (y >= i && y < i + h)
-        {
-            g_highlightAddress = addr;
-            break;
-        }
-        addr += insn->size;
+        g_highlightAddress = addr;
     }
 
     viewport()->update();
@@ -221,6 +317,11 @@ void DisasmView::mousePressEvent(QMouseEvent *event)
 void DisasmView::setDebugCore(std::shared_ptr<DebugCore> debugCore)
 {
     m_debugCore = debugCore;
+	m_job.reset();
+	m_regionStart = 0;
+	m_regionSize = 0;
+	m_index.reset(0, 0, nullptr);
+	m_flowBlocks = 0;
 }
 
 DisasmView::~DisasmView()
@@ -229,8 +330,14 @@ DisasmView::~DisasmView()
 
 void DisasmView::wheelEvent(QWheelEvent *event)
 {
-    m_foundIndex = true;
-    QAbstractScrollArea::wheelEvent(event);
+	//每一格滚动3行
+	auto lines = event->angleDelta().y() / 40;
+	auto top = lines > 0 ? m_index.prev(m_topAddress, lines) : m_index.next(m_topAddress, -lines);
+	if (top < m_index.end())
+	{
+		setTopAddress(top);
+	}
+	event->accept();
 }
 
 void DisasmView::updateContent()
@@ -4,6 +4,8 @@
 
 #include <vector>
 #include "DebugCore.h"
+#include "InsnIndex.h"
+#include "DisasmJob.h"
 
 class DebugCore;
 
@@ -26,13 +28,25 @@ protected:
 	virtual void wheelEvent(QWheelEvent *event) override;
 
 private:
+	void onDisasmProgress();
+	void onMemoryWritten(uint64_t address, uint64_t size);
+	void onFlowGraphChanged();
+	void setTopAddress(uint64_t address);
+	void onScrollAction(int action);
+	void onScrollValueChanged(int value);
+	int scrollValue(uint64_t address);
+	int visibleLines();
+
     uint64_t m_regionStart;
     uint64_t m_regionSize;
 
-    std::vector<uint64_t> m_insnStart;
-
-    uint64_t m_currentAddress;
-    bool m_foundIndex;
+    InsnIndex m_index;
+	std::unique_ptr<DisasmJob> m_job;
+	//已经作为锚点加入m_index的基本块数
+	std::size_t m_flowBlocks = 0;
+	//第一行的地址,滚动条的值是它在区域内的偏移(右移m_scrollShift位)
+	uint64_t m_topAddress = 0;
+	int m_scrollShift = 0;
 
 	std::weak_ptr<DebugCore> m_debugCore;
 };
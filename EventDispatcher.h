@@ -24,10 +24,15 @@ signals:
 	void showRegisters(Register regs);
 	void refreshDisasmView();
 	void breakpointChanged();
+	//后台函数分析有新的结果
+	void flowGraphChanged();
+	//指令跟踪结束
+	void traceChanged();
+	//调试目标的内存被修改,不包括设置和删除断点
+	void memoryWritten(uint64_t address, uint64_t size);
 	void setMemoryViewAddress(uint64_t address);
 	void setStackAddress(uint64_t address);
 	void updateUI();
 	void debugEvent();
-	void addLog(QString msg, LogType t);
 };
 
@@ -0,0 +1,609 @@
+#include "Expression.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+
+struct RegisterName
+{
+	const char* name;
+	int field;
+};
+
+static const RegisterName registerNames[] =
+{
+	{ "rax", offsetof(ThreadState, rax) / sizeof(uint64_t) },
+	{ "rbx", offsetof(ThreadState, rbx) / sizeof(uint64_t) },
+	{ "rcx", offsetof(ThreadState, rcx) / sizeof(uint64_t) },
+	{ "rdx", offsetof(ThreadState, rdx) / sizeof(uint64_t) },
+	{ "rdi", offsetof(ThreadState, rdi) / sizeof(uint64_t) },
+	{ "rsi", offsetof(ThreadState, rsi) / sizeof(uint64_t) },
+	{ "rbp", offsetof(ThreadState, rbp) / sizeof(uint64_t) },
+	{ "rsp", offsetof(ThreadState, rsp) / sizeof(uint64_t) },
+	{ "r8", offsetof(ThreadState, r8) / sizeof(uint64_t) },
+	{ "r9", offsetof(ThreadState, r9) / sizeof(uint64_t) },
+	{ "r10", offsetof(ThreadState, r10) / sizeof(uint64_t) },
+	{ "r11", offsetof(ThreadState, r11) / sizeof(uint64_t) },
+	{ "r12", offsetof(ThreadState, r12) / sizeof(uint64_t) },
+	{ "r13", offsetof(ThreadState, r13) / sizeof(uint64_t) },
+	{ "r14", offsetof(ThreadState, r14) / sizeof(uint64_t) },
+	{ "r15", offsetof(ThreadState, r15) / sizeof(uint64_t) },
+	{ "rip", offsetof(ThreadState, rip) / sizeof(uint64_t) },
+	{ "rflags", offsetof(ThreadState, rflags) / sizeof(uint64_t) },
+	{ "cs", offsetof(ThreadState, cs) / sizeof(uint64_t) },
+	{ "fs", offsetof(ThreadState, fs) / sizeof(uint64_t) },
+	{ "gs", offsetof(ThreadState, gs) / sizeof(uint64_t) },
+};
+
+//递归下降,每一层对应一级优先级,直接生成字节码
+class Expression::Parser
+{
+public:
+	Parser(const char* text, std::vector<Insn>& code)
+		: m_pos(text)
+		, m_code(code)
+	{
+	}
+
+	bool parse(QString& error)
+	{
+		if (!parseBinary(0) || !atEnd())
+		{
+			//前面没有出错时才是多余的字符
+			fail("多余的字符");
+			error = QString("%1: %2").arg(m_error).arg(m_pos);
+			return false;
+		}
+		return true;
+	}
+
+private:
+	struct BinaryOp
+	{
+		const char* token;
+		Op op;
+		int level;
+	};
+
+	//按优先级从低到高
+	static const int levelCount = 10;
+
+	bool fail(const char* message)
+	{
+		if (m_error.isEmpty())
+		{
+			m_error = message;
+		}
+		return false;
+	}
+
+	void skipSpace()
+	{
+		while (std::isspace((unsigned char)*m_pos))
+		{
+			++m_pos;
+		}
+	}
+
+	bool atEnd()
+	{
+		skipSpace();
+		return *m_pos == 0;
+	}
+
+	bool accept(const char* token)
+	{
+		skipSpace();
+		auto len = std::strlen(token);
+		if (std::strncmp(m_pos, token, len) != 0)
+		{
+			return false;
+		}
+		m_pos += len;
+		return true;
+	}
+
+	void add(Op op, uint64_t operand = 0)
+	{
+		m_code.push_back(Insn{op, operand});
+	}
+
+	//&&和||要求左边是0或1,其他二元运算符按优先级匹配,注意先匹配长的
+	bool matchBinary(int level, Op& op)
+	{
+		static const BinaryOp ops[] =
+		{
+			{ "||", OpOr, 0 }, { "&&", OpAnd, 1 },
+			{ "==", OpEq, 5 }, { "!=", OpNe, 5 },
+			{ "<<", OpShl, 7 }, { ">>", OpShr, 7 },
+			{ "<=", OpLe, 6 }, { ">=", OpGe, 6 }, { "<", OpLt, 6 }, { ">", OpGt, 6 },
+			{ "|", OpOr, 2 }, { "^", OpXor, 3 }, { "&", OpAnd, 4 },
+			{ "+", OpAdd, 8 }, { "-", OpSub, 8 },
+			{ "*", OpMul, 9 }, { "/", OpDiv, 9 }, { "%", OpMod, 9 },
+		};
+
+		skipSpace();
+		for (auto const& it : ops)
+		{
+			auto len = std::strlen(it.token);
+			if (std::strncmp(m_pos, it.token, len) == 0)
+			{
+				if (it.level != level)
+				{
+					return false;
+				}
+				m_pos += len;
+				op = it.op;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parseBinary(int level)
+	{
+		if (level == levelCount)
+		{
+			return parseUnary();
+		}
+
+		if (!parseBinary(level + 1))
+		{
+			return false;
+		}
+
+		Op op;
+		while (matchBinary(level, op))
+		{
+			//逻辑运算短路求值,右边的内存读取只在需要时进行
+			if (level <= 1)
+			{
+				add(OpToBool);
+				auto jump = m_code.size();
+				add(level == 0 ? OpJumpIfTrue : OpJumpIfFalse);
+				if (!parseBinary(level + 1))
+				{
+					return false;
+				}
+				add(OpToBool);
+				m_code[jump].operand = m_code.size();
+				continue;
+			}
+
+			if (!parseBinary(level + 1))
+			{
+				return false;
+			}
+			add(op);
+		}
+		return true;
+	}
+
+	bool parseUnary()
+	{
+		if (accept("-"))
+		{
+			if (!parseUnary())
+			{
+				return false;
+			}
+			add(OpNeg);
+			return true;
+		}
+		if (accept("~"))
+		{
+			if (!parseUnary())
+			{
+				return false;
+			}
+			add(OpNot);
+			return true;
+		}
+		if (accept("!"))
+		{
+			if (!parseUnary())
+			{
+				return false;
+			}
+			add(OpLogicalNot);
+			return true;
+		}
+		return parsePrimary();
+	}
+
+	bool parseMemory(uint64_t size)
+	{
+		if (!parseBinary(0))
+		{
+			return false;
+		}
+		if (!accept("]"))
+		{
+			return fail("缺少 ]");
+		}
+		add(OpLoad, size);
+		return true;
+	}
+
+	bool parsePrimary()
+	{
+		skipSpace();
+		if (accept("("))
+		{
+			if (!parseBinary(0))
+			{
+				return false;
+			}
+			return accept(")") || fail("缺少 )");
+		}
+
+		if (accept("["))
+		{
+			return parseMemory(8);
+		}
+
+		if (std::isdigit((unsigned char)*m_pos))
+		{
+			char* end;
+			auto value = std::strtoull(m_pos, &end, m_pos[0] == '0' && (m_pos[1] == 'x' || m_pos[1] == 'X') ? 16 : 10);
+			if (std::isalnum((unsigned char)*end) || *end == '_')
+			{
+				return fail("无效的数字");
+			}
+			m_pos = end;
+			add(OpConst, value);
+			return true;
+		}
+
+		if (!std::isalpha((unsigned char)*m_pos) && *m_pos != '$')
+		{
+			return fail("需要表达式");
+		}
+
+		auto start = m_pos;
+		++m_pos;
+		while (std::isalnum((unsigned char)*m_pos) || *m_pos == '_')
+		{
+			++m_pos;
+		}
+		std::string name(start, m_pos);
+		for (auto& c : name)
+		{
+			c = (char)std::tolower((unsigned char)c);
+		}
+
+		if (name == "$hits")
+		{
+			add(OpHits);
+			return true;
+		}
+
+		for (auto const& it : registerNames)
+		{
+			if (name == it.name)
+			{
+				add(OpReg, it.field);
+				return true;
+			}
+		}
+
+		int width = vectorWidth(name);
+		if (width)
+		{
+			return parseVector(name, width);
+		}
+
+		static const char* const sizeNames[] = { "byte", "word", "dword", "qword" };
+		for (int i = 0; i < 4; ++i)
+		{
+			if (name == sizeNames[i])
+			{
+				skipSpace();
+				if (std::strncmp(m_pos, "ptr", 3) == 0 && !std::isalnum((unsigned char)m_pos[3]))
+				{
+					m_pos += 3;
+				}
+				if (!accept("["))
+				{
+					return fail("缺少 [");
+				}
+				return parseMemory(1ull << i);
+			}
+		}
+
+		m_pos = start;
+		return fail("未知的名称");
+	}
+
+	//xmm/ymm/zmm加上0-31的序号时返回寄存器的字节数,否则返回0
+	static int vectorWidth(std::string const& name)
+	{
+		static const char* const prefixes[] = { "xmm", "ymm", "zmm" };
+		for (int i = 0; i < 3; ++i)
+		{
+			if (name.size() < 4 || name.size() > 5 || name.compare(0, 3, prefixes[i]) != 0)
+			{
+				continue;
+			}
+			if (!std::all_of(name.begin() + 3, name.end(), [](char c) { return std::isdigit((unsigned char)c); })
+				|| (name.size() == 5 && name[3] == '0') || std::stoi(name.substr(3)) >= 32)
+			{
+				return 0;
+			}
+			return 16 << i;
+		}
+		return 0;
+	}
+
+	//名字后面可以跟.b/.w/.d/.q和元素序号,默认取低8字节
+	bool parseVector(std::string const& name, int width)
+	{
+		int index = std::stoi(name.substr(3));
+		int size = 8;
+		int element = 0;
+		if (*m_pos == '.')
+		{
+			static const char sizeNames[] = "bwdq";
+			auto p = std::strchr(sizeNames, std::tolower((unsigned char)m_pos[1]));
+			if (!m_pos[1] || !p || !std::isdigit((unsigned char)m_pos[2]))
+			{
+				return fail("无效的向量寄存器元素");
+			}
+			size = 1 << (p - sizeNames);
+			char* end;
+			element = (int)std::strtol(m_pos + 2, &end, 10);
+			if (std::isalnum((unsigned char)*end) || *end == '_')
+			{
+				return fail("无效的向量寄存器元素");
+			}
+			m_pos = end;
+		}
+		if (element >= width / size)
+		{
+			return fail("向量寄存器元素超出范围");
+		}
+		add(OpVector, ((uint64_t)index << 16) | ((uint64_t)(element * size) << 8) | size);
+		return true;
+	}
+
+	const char* m_pos;
+	std::vector<Insn>& m_code;
+	QString m_error;
+};
+
+bool Expression::compile(QString const& text, QString& error)
+{
+	auto utf8 = text.toUtf8();
+	std::vector<Insn> code;
+	Parser parser(utf8.constData(), code);
+	if (!parser.parse(error))
+	{
+		return false;
+	}
+
+	//检查栈的最大深度,跳转只会跳过把栈恢复原样的代码,按顺序模拟即可
+	int depth = 0;
+	for (auto const& insn : code)
+	{
+		switch (insn.op)
+		{
+		case OpConst:
+		case OpReg:
+		case OpVector:
+		case OpHits:
+			++depth;
+			break;
+		case OpMul: case OpDiv: case OpMod: case OpAdd: case OpSub: case OpShl: case OpShr:
+		case OpLt: case OpLe: case OpGt: case OpGe: case OpEq: case OpNe: case OpAnd: case OpXor: case OpOr:
+		case OpJumpIfFalse:
+		case OpJumpIfTrue:
+			--depth;
+			break;
+		default:
+			break;
+		}
+		if (depth > maxStack)
+		{
+			error = "表达式太复杂";
+			return false;
+		}
+	}
+
+	m_text = text;
+	m_code = std::move(code);
+	return true;
+}
+
+bool Expression::evaluate(ThreadState const& state, uint64_t hits, ReadMemory const& readMemory, ReadVector const& readVector,
+	uint64_t& result) const
+{
+	uint64_t fields[sizeof(ThreadState) / sizeof(uint64_t)];
+	std::memcpy(fields, &state, sizeof(fields));
+
+	uint64_t stack[maxStack];
+	int sp = 0;
+	for (std::size_t pc = 0; pc < m_code.size(); ++pc)
+	{
+		auto const& insn = m_code[pc];
+		switch (insn.op)
+		{
+		case OpConst:
+			stack[sp++] = insn.operand;
+			continue;
+		case OpReg:
+			stack[sp++] = fields[insn.operand];
+			continue;
+		case OpVector:
+			if (!readVector((int)(insn.operand >> 16), (int)(insn.operand >> 8) & 0xff, (int)insn.operand & 0xff, stack[sp]))
+			{
+				return false;
+			}
+			++sp;
+			continue;
+		case OpHits:
+			stack[sp++] = hits;
+			continue;
+		case OpLoad:
+		{
+			uint64_t value = 0;
+			if (!readMemory(stack[sp - 1], &value, insn.operand))
+			{
+				return false;
+			}
+			stack[sp - 1] = value;
+			continue;
+		}
+		case OpNeg:
+			stack[sp - 1] = 0 - stack[sp - 1];
+			continue;
+		case OpNot:
+			stack[sp - 1] = ~stack[sp - 1];
+			continue;
+		case OpLogicalNot:
+			stack[sp - 1] = !stack[sp - 1];
+			continue;
+		case OpToBool:
+			stack[sp - 1] = stack[sp - 1] != 0;
+			continue;
+		case OpJumpIfFalse:
+		case OpJumpIfTrue:
+			if ((stack[sp - 1] != 0) == (insn.op == OpJumpIfTrue))
+			{
+				pc = insn.operand - 1;
+			}
+			else
+			{
+				--sp;
+			}
+			continue;
+		default:
+			break;
+		}
+
+		auto b = stack[--sp];
+		auto& a = stack[sp - 1];
+		switch (insn.op)
+		{
+		case OpMul: a *= b; break;
+		case OpDiv:
+		case OpMod:
+			if (b == 0)
+			{
+				return false;
+			}
+			a = insn.op == OpDiv ? a / b : a % b;
+			break;
+		case OpAdd: a += b; break;
+		case OpSub: a -= b; break;
+		case OpShl: a = b < 64 ? a << b : 0; break;
+		case OpShr: a = b < 64 ? a >> b : 0; break;
+		case OpLt: a = a < b; break;
+		case OpLe: a = a <= b; break;
+		case OpGt: a = a > b; break;
+		case OpGe: a = a >= b; break;
+		case OpEq: a = a == b; break;
+		case OpNe: a = a != b; break;
+		case OpAnd: a &= b; break;
+		case OpXor: a ^= b; break;
+		case OpOr: a |= b; break;
+		default: break;
+		}
+	}
+
+	result = sp ? stack[0] : 0;
+	return true;
+}
+
+bool LogFormat::compile(QString const& text, QString& error)
+{
+	std::vector<Part> parts;
+	QString literal;
+	for (int i = 0; i < text.size(); ++i)
+	{
+		auto c = text[i];
+		if ((c == '{' || c == '}') && i + 1 < text.size() && text[i + 1] == c)
+		{
+			literal += c;
+			++i;
+			continue;
+		}
+		if (c == '}')
+		{
+			error = "多余的 }";
+			return false;
+		}
+		if (c != '{')
+		{
+			literal += c;
+			continue;
+		}
+
+		auto end = text.indexOf('}', i + 1);
+		if (end < 0)
+		{
+			error = "缺少 }";
+			return false;
+		}
+
+		Part part;
+		auto expression = text.mid(i + 1, end - i - 1).trimmed();
+		if (expression.endsWith(":d") || expression.endsWith(":x"))
+		{
+			part.decimal = expression.endsWith(":d");
+			expression.chop(2);
+		}
+
+		QString expressionError;
+		if (!part.expression.compile(expression, expressionError))
+		{
+			error = QString("{%1}: %2").arg(expression).arg(expressionError);
+			return false;
+		}
+
+		part.literal = literal;
+		literal.clear();
+		parts.push_back(std::move(part));
+		i = end;
+	}
+
+	if (!literal.isEmpty())
+	{
+		Part part;
+		part.literal = literal;
+		parts.push_back(std::move(part));
+	}
+
+	m_text = text;
+	m_parts = std::move(parts);
+	return true;
+}
+
+QString LogFormat::format(ThreadState const& state, uint64_t hits, Expression::ReadMemory const& readMemory,
+	Expression::ReadVector const& readVector) const
+{
+	QString msg;
+	for (auto const& part : m_parts)
+	{
+		msg += part.literal;
+		if (part.expression.empty())
+		{
+			continue;
+		}
+
+		uint64_t value;
+		if (!part.expression.evaluate(state, hits, readMemory, readVector, value))
+		{
+			msg += "???";
+		}
+		else if (part.decimal)
+		{
+			msg += QString::number(value);
+		}
+		else
+		{
+			msg += "0x" + QString::number(value, 16);
+		}
+	}
+	return msg;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Common.h"
+
+#include <QString>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//寄存器和内存上的表达式,编译为栈式字节码,在调试线程中求值时不分配内存
+//语法和C相同,所有运算按64位无符号数进行:
+//	常量: 123, 0x7b    寄存器: rax ... r15, rip, rflags, cs, fs, gs    命中次数: $hits
+//	向量寄存器: xmm0 ... xmm31, ymm0 ... ymm31, zmm0 ... zmm31取低8字节, xmm1.d2按b/w/d/q取第2个元素(无符号整数)
+//	内存: [expr]读取8字节, byte/word/dword/qword [expr](可以加ptr)读取指定大小
+//	运算符: 单目 - ~ !, * / %, + -, << >>, < <= > >=, == !=, &, ^, |, &&, ||
+class Expression
+{
+public:
+	//读取调试目标的内存,失败返回false
+	using ReadMemory = std::function<bool(uint64_t address, void* buffer, uint64_t size)>;
+	//读取向量寄存器index中从offset开始的size个字节,只在表达式用到向量寄存器时调用
+	using ReadVector = std::function<bool(int index, int offset, int size, uint64_t& value)>;
+
+	//编译失败时返回false,error为错误信息,之前的字节码保持不变
+	bool compile(QString const& text, QString& error);
+	bool empty() const { return m_code.empty(); }
+	QString const& text() const { return m_text; }
+
+	//内存或向量寄存器不可读,或者除以0时返回false
+	bool evaluate(ThreadState const& state, uint64_t hits, ReadMemory const& readMemory, ReadVector const& readVector,
+		uint64_t& result) const;
+
+private:
+	enum Op : uint8_t
+	{
+		OpConst, OpReg, OpVector, OpHits, OpLoad,
+		OpNeg, OpNot, OpLogicalNot, OpToBool,
+		OpMul, OpDiv, OpMod, OpAdd, OpSub, OpShl, OpShr,
+		OpLt, OpLe, OpGt, OpGe, OpEq, OpNe, OpAnd, OpXor, OpOr,
+		//栈顶为0时跳到operand,否则弹出栈顶,用于&&的短路
+		OpJumpIfFalse,
+		//栈顶不为0时跳到operand,否则弹出栈顶,用于||的短路
+		OpJumpIfTrue,
+	};
+
+	struct Insn
+	{
+		Op op;
+		//OpConst为常量,OpReg为ThreadState的字段序号,OpLoad为读取的字节数,跳转为目标位置
+		//OpVector为(寄存器序号 << 16) | (字节偏移 << 8) | 字节数
+		uint64_t operand;
+	};
+
+	//求值时使用固定大小的栈
+	static const int maxStack = 32;
+
+	class Parser;
+
+	QString m_text;
+	std::vector<Insn> m_code;
+};
+
+//日志点的消息格式,{}中为表达式,默认按十六进制输出,{expr:d}按十进制输出,{{和}}输出括号本身
+class LogFormat
+{
+public:
+	bool compile(QString const& text, QString& error);
+	QString const& text() const { return m_text; }
+
+	//求值失败的表达式输出为???
+	QString format(ThreadState const& state, uint64_t hits, Expression::ReadMemory const& readMemory,
+		Expression::ReadVector const& readVector) const;
+
+private:
+	struct Part
+	{
+		//表达式前面的文字
+		QString literal;
+		Expression expression;
+		bool decimal = false;
+	};
+
+	QString m_text;
+	std::vector<Part> m_parts;
+};
@@ -0,0 +1,420 @@
+#include "FlowAnalysis.h"
+#include "libasmx64.h"
+#include "global.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cstring>
+
+static const uint64_t pageSize = 4096;
+static const uint64_t maxInsnSize = 15;
+//两次生成快照的最小间隔(ms),队列为空时立即生成
+static const qint64 publishInterval = 100;
+
+FlowAnalysis::FlowAnalysis(InsnIndex::ReadMemory readMemory, QObject* parent)
+	: QObject(parent)
+	, m_readMemory(std::move(readMemory))
+	, m_cancel(false)
+	, m_graph(std::make_shared<FlowGraph>())
+{
+}
+
+FlowAnalysis::~FlowAnalysis()
+{
+	cancel();
+}
+
+void FlowAnalysis::start(uint64_t start, uint64_t size, uint64_t entry)
+{
+	cancel();
+
+	m_work = FlowGraph();
+	m_claimed.clear();
+	m_pages.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_start = start;
+		m_size = size;
+		m_root = entry;
+		m_queue.clear();
+		m_entries.clear();
+		m_graph = std::make_shared<FlowGraph>();
+		if (contains(entry))
+		{
+			m_queue.push_back(entry);
+			m_entries.insert(entry);
+		}
+	}
+
+	m_cancel = false;
+	m_thread = std::thread([this] { worker(); });
+}
+
+void FlowAnalysis::cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		m_cancel = true;
+	}
+	m_cv.notify_all();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+void FlowAnalysis::addEntry(uint64_t entry)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		if (!contains(entry) || !m_entries.insert(entry).second)
+		{
+			return;
+		}
+		m_queue.push_back(entry);
+	}
+	m_cv.notify_one();
+}
+
+std::shared_ptr<const FlowGraph> FlowAnalysis::graph()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_graph;
+}
+
+void FlowAnalysis::worker()
+{
+	QElapsedTimer timer;
+	timer.start();
+	QElapsedTimer sincePublish;
+	sincePublish.start();
+
+	for (;;)
+	{
+		uint64_t entry;
+		{
+			std::unique_lock<std::mutex> lock(m_mtx);
+			m_cv.wait(lock, [this] { return m_cancel || !m_queue.empty(); });
+			if (m_cancel)
+			{
+				return;
+			}
+			entry = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		analyzeFunction(entry);
+		if (m_cancel)
+		{
+			return;
+		}
+
+		bool idle;
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+			idle = m_queue.empty();
+		}
+		if (idle || sincePublish.elapsed() >= publishInterval)
+		{
+			publish();
+			sincePublish.restart();
+			emit progress();
+		}
+		if (idle)
+		{
+			log(QString("函数分析完成: 0x%1, %2 个函数, %3 个基本块, 耗时 %4 ms")
+				.arg(m_start, 0, 16).arg(m_work.functions().size()).arg(m_work.blocks().size()).arg(timer.elapsed()));
+			emit finished();
+		}
+	}
+}
+
+void FlowAnalysis::analyzeFunction(uint64_t entry)
+{
+	//入口已经在其他函数中(比如之前被当成跳转目标)时不再单独分析
+	if (claimed(entry))
+	{
+		return;
+	}
+
+	//第一遍沿着控制流解码,记录指令和块的开头
+	std::map<uint64_t, Insn> insns;
+	std::set<uint64_t> leaders{entry};
+	//在这条指令之后停止的原因,FlowGraph::BlockFlags
+	std::map<uint64_t, uint8_t> stops;
+	std::vector<uint64_t> work{entry};
+
+	auto followBranch = [&](uint64_t from, uint64_t target)
+	{
+		if (!contains(target) || isOtherEntry(target, entry))
+		{
+			stops[from] |= FlowGraph::BlockTailCall;
+		}
+		else if (claimed(target))
+		{
+			stops[from] |= FlowGraph::BlockShared;
+		}
+		else
+		{
+			leaders.insert(target);
+			work.push_back(target);
+		}
+	};
+
+	while (!work.empty() && !m_cancel)
+	{
+		auto address = work.back();
+		work.pop_back();
+		uint64_t prev = 0;
+		for (;;)
+		{
+			if (insns.count(address))
+			{
+				leaders.insert(address);
+				break;
+			}
+			if (prev && (!contains(address) || claimed(address)))
+			{
+				stops[prev] |= contains(address) ? FlowGraph::BlockShared : FlowGraph::BlockInvalid;
+				break;
+			}
+
+			uint8_t code[maxInsnSize];
+			x86dis_insn decoded;
+			auto len = fetch(address, code);
+			if (len == 0 || !x64dis::decode(code, len, address, decoded))
+			{
+				if (prev)
+				{
+					stops[prev] |= FlowGraph::BlockInvalid;
+				}
+				break;
+			}
+
+			Insn insn{(uint8_t)decoded.size, (uint8_t)x64dis::flowKind(decoded), 0, 0};
+			if (x64dis::branchTarget(decoded, insn.target))
+			{
+				insn.flags = X86DIS_REC_TARGET;
+			}
+			insns[address] = insn;
+			prev = address;
+
+			auto next = address + insn.size;
+			bool hasTarget = (insn.flags & X86DIS_REC_TARGET) != 0;
+			uint64_t pointer;
+			if (entry == m_root && isCodePointer(decoded, pointer))
+			{
+				//_start通过参数把main的地址传给__libc_start_main
+				//其他函数中取的地址也可能是和代码在同一个段中的字符串或常量,不作为入口
+				addEntry(pointer);
+			}
+			else if (insn.kind == X86_FLOW_CALL && hasTarget)
+			{
+				addEntry(insn.target);
+			}
+			else if (insn.kind == X86_FLOW_JMP)
+			{
+				if (hasTarget)
+				{
+					followBranch(address, insn.target);
+				}
+				break;
+			}
+			else if (insn.kind == X86_FLOW_JCC)
+			{
+				if (hasTarget)
+				{
+					followBranch(address, insn.target);
+				}
+				leaders.insert(next);
+			}
+			else if (insn.kind == X86_FLOW_RET || insn.kind == X86_FLOW_HALT)
+			{
+				break;
+			}
+			address = next;
+		}
+	}
+
+	if (m_cancel || insns.empty())
+	{
+		return;
+	}
+
+	//第二遍按地址顺序把指令分成块
+	std::vector<FlowGraph::Block> blocks;
+	std::vector<uint64_t> lastInsns;
+	std::vector<uint8_t> sizes;
+	bool blockEnded = true;
+	for (auto& it : insns)
+	{
+		auto address = it.first;
+		auto& insn = it.second;
+		if (blockEnded || address != blocks.back().end() || leaders.count(address))
+		{
+			FlowGraph::Block block{};
+			block.start = address;
+			block.firstInsn = (uint32_t)sizes.size();
+			blocks.push_back(block);
+			lastInsns.push_back(address);
+		}
+
+		auto& block = blocks.back();
+		block.size += insn.size;
+		block.insnCount++;
+		block.kind = insn.kind;
+		lastInsns.back() = address;
+		sizes.push_back(insn.size);
+
+		auto stop = stops.find(address);
+		blockEnded = insn.kind == X86_FLOW_JMP || insn.kind == X86_FLOW_JCC || insn.kind == X86_FLOW_RET
+			|| insn.kind == X86_FLOW_HALT || stop != stops.end();
+	}
+
+	//后继用函数内的块序号表示
+	std::vector<uint32_t> succs;
+	auto addSucc = [&](FlowGraph::Block& block, uint64_t target)
+	{
+		auto it = std::lower_bound(blocks.begin(), blocks.end(), target,
+			[](FlowGraph::Block const& b, uint64_t target) { return b.start < target; });
+		if (it != blocks.end() && it->start == target)
+		{
+			succs.push_back((uint32_t)(it - blocks.begin()));
+			block.succCount++;
+		}
+	};
+
+	for (std::size_t i = 0; i < blocks.size(); ++i)
+	{
+		auto& block = blocks[i];
+		auto last = lastInsns[i];
+		auto& insn = insns[last];
+		auto stop = stops.find(last);
+		block.flags = stop != stops.end() ? stop->second : 0;
+		block.firstSucc = (uint32_t)succs.size();
+
+		bool hasTarget = (insn.flags & X86DIS_REC_TARGET) != 0;
+		switch (insn.kind)
+		{
+		case X86_FLOW_JMP:
+			if (hasTarget)
+			{
+				addSucc(block, insn.target);
+			}
+			else
+			{
+				block.flags |= FlowGraph::BlockIndirect;
+			}
+			break;
+		case X86_FLOW_JCC:
+			if (hasTarget)
+			{
+				addSucc(block, insn.target);
+			}
+			addSucc(block, block.end());
+			break;
+		case X86_FLOW_RET:
+		case X86_FLOW_HALT:
+			break;
+		default:
+			if (stop == stops.end())
+			{
+				addSucc(block, block.end());
+			}
+			break;
+		}
+
+		m_claimed[block.start] = block.end();
+	}
+
+	m_work.addFunction(entry, std::move(blocks), succs, sizes);
+}
+
+int FlowAnalysis::fetch(uint64_t address, uint8_t* code)
+{
+	auto n = std::min(maxInsnSize, m_start + m_size - address);
+	uint64_t got = 0;
+	while (got < n)
+	{
+		auto a = address + got;
+		auto pageAddr = a - a % pageSize;
+		auto it = m_pages.find(pageAddr);
+		if (it == m_pages.end())
+		{
+			//页的一部分可能在区域外面
+			auto from = std::max(pageAddr, m_start);
+			auto to = std::min(pageAddr + pageSize, m_start + m_size);
+			std::vector<uint8_t> page(pageSize);
+			if (!m_readMemory(from, page.data() + (from - pageAddr), to - from))
+			{
+				page.clear();
+			}
+			it = m_pages.emplace(pageAddr, std::move(page)).first;
+		}
+
+		auto& page = it->second;
+		if (page.empty())
+		{
+			break;
+		}
+		auto count = std::min(n - got, pageAddr + pageSize - a);
+		std::memcpy(code + got, page.data() + (a - pageAddr), count);
+		got += count;
+	}
+
+	return (int)got;
+}
+
+bool FlowAnalysis::claimed(uint64_t address) const
+{
+	auto it = m_claimed.upper_bound(address);
+	if (it == m_claimed.begin())
+	{
+		return false;
+	}
+	--it;
+	return address < it->second;
+}
+
+bool FlowAnalysis::isCodePointer(x86dis_insn const& insn, uint64_t& address) const
+{
+	if (insn.opcodeclass != 0)
+	{
+		return false;
+	}
+
+	//lea reg, [rip + disp]
+	if (insn.opcode == 0x8d)
+	{
+		return x64dis::absoluteAddress(insn.op[1], address) && contains(address);
+	}
+
+	//mov reg, imm32
+	bool movImm = (insn.opcode >= 0xb8 && insn.opcode <= 0xbf) || insn.opcode == 0xc7;
+	if (movImm && insn.op[0].type == X86_OPTYPE_REG && insn.op[1].type == X86_OPTYPE_IMM)
+	{
+		address = insn.op[1].imm;
+		return contains(address);
+	}
+	return false;
+}
+
+bool FlowAnalysis::isOtherEntry(uint64_t address, uint64_t entry)
+{
+	if (address == entry)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_entries.count(address) != 0;
+}
+
+void FlowAnalysis::publish()
+{
+	m_work.sortIndex();
+	auto graph = std::make_shared<const FlowGraph>(m_work);
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_graph = graph;
+}
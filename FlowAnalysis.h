@@ -0,0 +1,90 @@
+#pragma once
+
+#include "FlowGraph.h"
+#include "InsnIndex.h"
+#include "libasmx64.h"
+
+#include <QObject>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//后台线程中从入口点开始递归下降反汇编,恢复函数和基本块
+//直接调用的目标作为新的函数继续分析,只分析start()指定的区域
+//每分析完一批函数就生成新的FlowGraph快照,通过progress()信号通知,graph()取得当前的快照
+//分析完成后线程等待addEntry()添加新的入口
+class FlowAnalysis : public QObject
+{
+	Q_OBJECT
+public:
+	//readMemory在分析线程中调用,必须是线程安全的,读到的数据中不能有断点的0xCC
+	explicit FlowAnalysis(InsnIndex::ReadMemory readMemory, QObject* parent = nullptr);
+	~FlowAnalysis();
+
+	//丢弃之前的结果,从entry开始分析[start, start + size)
+	void start(uint64_t start, uint64_t size, uint64_t entry);
+	void cancel();
+	//添加一个函数入口,已经分析过或不在区域内的忽略
+	void addEntry(uint64_t entry);
+
+	//没有开始分析时返回空的FlowGraph
+	std::shared_ptr<const FlowGraph> graph();
+
+signals:
+	void progress();
+	void finished();
+
+private:
+	//函数分析过程中的指令
+	struct Insn
+	{
+		uint8_t size;
+		uint8_t kind;
+		uint8_t flags;
+		uint64_t target;
+	};
+
+	void worker();
+	void analyzeFunction(uint64_t entry);
+	//读取address开始最多15字节,返回读到的字节数
+	int fetch(uint64_t address, uint8_t* code);
+	//address是否在已经分析过的函数的块中
+	bool claimed(uint64_t address) const;
+	//lea或mov取区域内的地址
+	bool isCodePointer(x86dis_insn const& insn, uint64_t& address) const;
+	//address是否是entry以外的函数入口,跳转到这里按尾调用处理
+	bool isOtherEntry(uint64_t address, uint64_t entry);
+	bool contains(uint64_t address) const { return address >= m_start && address - m_start < m_size; }
+	void publish();
+
+	InsnIndex::ReadMemory m_readMemory;
+	uint64_t m_start = 0;
+	uint64_t m_size = 0;
+	//start()指定的入口
+	uint64_t m_root = 0;
+
+	std::thread m_thread;
+	std::atomic<bool> m_cancel;
+
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::deque<uint64_t> m_queue;
+	//所有加入过队列的入口
+	std::set<uint64_t> m_entries;
+	std::shared_ptr<const FlowGraph> m_graph;
+
+	//以下只在工作线程中使用
+	FlowGraph m_work;
+	//已分析的块,起始地址 -> 结束地址
+	std::map<uint64_t, uint64_t> m_claimed;
+	//按页缓存读取的代码,空的表示页不可读
+	std::unordered_map<uint64_t, std::vector<uint8_t>> m_pages;
+};
@@ -0,0 +1,126 @@
+#include "FlowGraph.h"
+
+#include <algorithm>
+
+FlowGraph::Block const* FlowGraph::findBlock(uint64_t address) const
+{
+	//块不重叠,只需要检查起始地址不大于address的最后一个块
+	auto it = std::upper_bound(m_blockOrder.begin(), m_blockOrder.end(), address,
+		[this](uint64_t address, uint32_t index) { return address < m_blocks[index].start; });
+	if (it == m_blockOrder.begin())
+	{
+		return nullptr;
+	}
+
+	auto& block = m_blocks[*(it - 1)];
+	return block.contains(address) ? &block : nullptr;
+}
+
+FlowGraph::Function const* FlowGraph::findFunction(uint64_t address) const
+{
+	auto block = findBlock(address);
+	return block ? &m_functions[block->function] : nullptr;
+}
+
+FlowGraph::Function const* FlowGraph::functionAt(uint64_t entry) const
+{
+	auto it = std::lower_bound(m_functionOrder.begin(), m_functionOrder.end(), entry,
+		[this](uint32_t index, uint64_t entry) { return m_functions[index].entry < entry; });
+	if (it == m_functionOrder.end() || m_functions[*it].entry != entry)
+	{
+		return nullptr;
+	}
+	return &m_functions[*it];
+}
+
+bool FlowGraph::isInsnStart(uint64_t address) const
+{
+	auto block = findBlock(address);
+	if (!block)
+	{
+		return false;
+	}
+
+	auto pos = block->start;
+	auto sizes = m_insnSizes.data() + block->firstInsn;
+	for (uint32_t i = 0; i < block->insnCount && pos < address; ++i)
+	{
+		pos += sizes[i];
+	}
+	return pos == address;
+}
+
+uint64_t FlowGraph::nextInsn(uint64_t address) const
+{
+	auto block = findBlock(address);
+	if (!block)
+	{
+		return 0;
+	}
+
+	auto pos = block->start;
+	auto sizes = m_insnSizes.data() + block->firstInsn;
+	for (uint32_t i = 0; i < block->insnCount; ++i)
+	{
+		pos += sizes[i];
+		if (pos > address)
+		{
+			return pos;
+		}
+	}
+	return 0;
+}
+
+void FlowGraph::addFunction(uint64_t entry, std::vector<Block> blocks, std::vector<uint32_t> const& succs,
+	std::vector<uint8_t> const& insnSizes)
+{
+	if (blocks.empty())
+	{
+		return;
+	}
+
+	Function func;
+	func.entry = entry;
+	func.start = blocks.front().start;
+	func.end = 0;
+	func.firstBlock = (uint32_t)m_blocks.size();
+	func.blockCount = (uint32_t)blocks.size();
+
+	auto succBase = (uint32_t)m_succs.size();
+	auto insnBase = (uint32_t)m_insnSizes.size();
+	for (auto& b : blocks)
+	{
+		func.end = std::max(func.end, b.end());
+		b.function = (uint32_t)m_functions.size();
+		b.firstSucc += succBase;
+		b.firstInsn += insnBase;
+		m_blocks.push_back(b);
+	}
+
+	//函数内的块序号转换为全局下标
+	for (auto s : succs)
+	{
+		m_succs.push_back(func.firstBlock + s);
+	}
+	m_insnSizes.insert(m_insnSizes.end(), insnSizes.begin(), insnSizes.end());
+	m_functions.push_back(func);
+}
+
+void FlowGraph::sortIndex()
+{
+	m_functionOrder.resize(m_functions.size());
+	for (uint32_t i = 0; i < m_functionOrder.size(); ++i)
+	{
+		m_functionOrder[i] = i;
+	}
+	std::sort(m_functionOrder.begin(), m_functionOrder.end(),
+		[this](uint32_t a, uint32_t b) { return m_functions[a].entry < m_functions[b].entry; });
+
+	m_blockOrder.resize(m_blocks.size());
+	for (uint32_t i = 0; i < m_blockOrder.size(); ++i)
+	{
+		m_blockOrder[i] = i;
+	}
+	std::sort(m_blockOrder.begin(), m_blockOrder.end(),
+		[this](uint32_t a, uint32_t b) { return m_blocks[a].start < m_blocks[b].start; });
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//递归下降分析得到的函数和基本块
+//所有数据放在几个连续的数组中,块和边用下标互相引用;每个函数的块连续存放,按地址排序
+//基本块之间不重叠,一个块只属于第一个分析到它的函数
+//生成后不再修改,可以在多个线程中同时查询
+class FlowGraph
+{
+public:
+	//块的结束原因
+	enum BlockFlags : uint8_t
+	{
+		BlockInvalid = 0x01,	//后面是无效指令或无法读取的内存
+		BlockIndirect = 0x02,	//以间接跳转结束,后继未知
+		BlockTailCall = 0x04,	//跳转到另一个函数
+		BlockShared = 0x08,		//执行到已属于其他函数的代码
+	};
+
+	struct Block
+	{
+		uint64_t start;
+		uint32_t size;
+		uint32_t function;
+		uint32_t firstSucc;
+		//m_insnSizes中的下标
+		uint32_t firstInsn;
+		uint32_t insnCount;
+		uint8_t succCount;
+		//最后一条指令的X86FlowKind
+		uint8_t kind;
+		uint8_t flags;
+
+		uint64_t end() const { return start + size; }
+		bool contains(uint64_t address) const { return address >= start && address - start < size; }
+	};
+
+	struct Function
+	{
+		uint64_t entry;
+		//所有块覆盖的范围,中间可能有不属于这个函数的代码
+		uint64_t start;
+		uint64_t end;
+		uint32_t firstBlock;
+		uint32_t blockCount;
+	};
+
+	std::vector<Function> const& functions() const { return m_functions; }
+	std::vector<Block> const& blocks() const { return m_blocks; }
+	uint32_t const* successors(Block const& block) const { return m_succs.data() + block.firstSucc; }
+
+	//以下查询都是O(log n)
+	//包含address的块,没有返回nullptr
+	Block const* findBlock(uint64_t address) const;
+	//包含address的块所属的函数
+	Function const* findFunction(uint64_t address) const;
+	//入口为entry的函数
+	Function const* functionAt(uint64_t entry) const;
+	//address是否是已分析代码中的指令开头,在块内时需要遍历块的指令长度
+	bool isInsnStart(uint64_t address) const;
+	//已分析代码中address之后的下一条指令,不知道时返回0
+	uint64_t nextInsn(uint64_t address) const;
+
+	//供FlowAnalysis使用
+	//blocks按地址排序,其中的firstSucc是succs中的下标,successors是函数内的块序号,firstInsn是insnSizes中的下标
+	void addFunction(uint64_t entry, std::vector<Block> blocks, std::vector<uint32_t> const& succs,
+		std::vector<uint8_t> const& insnSizes);
+	//添加函数后重建按地址排序的索引
+	void sortIndex();
+
+private:
+	std::vector<Function> m_functions;
+	std::vector<Block> m_blocks;
+	std::vector<uint32_t> m_succs;
+	std::vector<uint8_t> m_insnSizes;
+
+	//按入口地址排序的函数下标,按起始地址排序的块下标
+	std::vector<uint32_t> m_functionOrder;
+	std::vector<uint32_t> m_blockOrder;
+};
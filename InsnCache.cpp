@@ -0,0 +1,101 @@
+#include "InsnCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+InsnCache::InsnCache(std::size_t capacity)
+	: m_capacity(capacity)
+{
+}
+
+std::shared_ptr<const DecodedInsn> InsnCache::decode(uint64_t address, uint8_t const* code, int len)
+{
+	len = std::min(len, 15);
+	{
+		std::lock_guard<std::mutex> lock(m_mtx);
+		auto it = m_map.find(address);
+		if (it != m_map.end())
+		{
+			auto const& entry = *it->second;
+			//有效指令只比较指令本身的字节,无效指令的结果和代码长度有关
+			bool hit = entry->insn.invalid
+				? (len == entry->codeLen && std::memcmp(code, entry->code, len) == 0)
+				: (len >= entry->size && std::memcmp(code, entry->code, entry->size) == 0);
+			if (hit)
+			{
+				m_lru.splice(m_lru.begin(), m_lru, it->second);
+				return entry;
+			}
+		}
+	}
+
+	//解码不需要持有锁
+	auto decoded = std::make_shared<DecodedInsn>();
+	decoded->address = address;
+	std::memcpy(decoded->code, code, len);
+	decoded->codeLen = len;
+	x64dis::decode(decoded->code, len, address, decoded->insn);
+	decoded->size = decoded->insn.size;
+	char text[256];
+	x64dis::str(decoded->insn, insnStyle, text, sizeof text);
+	decoded->text = text;
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto it = m_map.find(address);
+	if (it != m_map.end())
+	{
+		m_lru.erase(it->second);
+		m_map.erase(it);
+	}
+	m_lru.emplace_front(decoded);
+	m_map[address] = m_lru.begin();
+	if (m_lru.size() > m_capacity)
+	{
+		m_map.erase(m_lru.back()->address);
+		m_lru.pop_back();
+	}
+
+	return decoded;
+}
+
+void InsnCache::invalidate(uint64_t address, uint64_t size)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	//从address前面开始的指令也可能覆盖到被修改的内存
+	auto first = address - std::min<uint64_t>(address, 14);
+	auto last = address + size;
+	if (last - first > m_map.size())
+	{
+		for (auto it = m_lru.begin(); it != m_lru.end();)
+		{
+			auto insnAddr = (*it)->address;
+			if (insnAddr >= first && insnAddr < last)
+			{
+				m_map.erase(insnAddr);
+				it = m_lru.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+		return;
+	}
+
+	for (auto a = first; a < last; ++a)
+	{
+		auto it = m_map.find(a);
+		if (it != m_map.end())
+		{
+			m_lru.erase(it->second);
+			m_map.erase(it);
+		}
+	}
+}
+
+void InsnCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_lru.clear();
+	m_map.clear();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "libasmx64.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct DecodedInsn
+{
+	uint64_t address;
+	x86dis_insn insn;
+	std::string text;
+	int size;
+	//解码时使用的代码,用于判断缓存是否还有效
+	uint8_t code[15];
+	int codeLen;
+};
+
+//已解码指令的LRU缓存,以地址和代码为键
+//反汇编窗口的绘制和单步步过都通过这里解码
+class InsnCache
+{
+public:
+	static const int insnStyle = DIS_STYLE_HEX_ASMSTYLE | DIS_STYLE_HEX_UPPERCASE | DIS_STYLE_HEX_NOZEROPAD
+		| DIS_STYLE_SIGNED | X86DIS_STYLE_EXPLICIT_MEMSIZE;
+
+	explicit InsnCache(std::size_t capacity = 8192);
+
+	std::shared_ptr<const DecodedInsn> decode(uint64_t address, uint8_t const* code, int len);
+	void invalidate(uint64_t address, uint64_t size);
+	void clear();
+
+private:
+	using Entry = std::shared_ptr<const DecodedInsn>;
+
+	std::size_t m_capacity;
+	std::mutex m_mtx;
+	//最近使用的在前面
+	std::list<Entry> m_lru;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> m_map;
+};
@@ -0,0 +1,233 @@
+#include "InsnIndex.h"
+#include "libasmx64.h"
+
+#include <algorithm>
+
+//上一块未解码时,从块前面这么多字节开始解码,以便和前面的指令对齐
+static const uint64_t resyncOverlap = 64;
+static const uint64_t maxInsnSize = 15;
+
+const uint64_t InsnIndex::chunkSize;
+
+void InsnIndex::reset(uint64_t start, uint64_t size, ReadMemory readMemory)
+{
+	m_start = start;
+	m_size = size;
+	m_readMemory = std::move(readMemory);
+	m_chunks.clear();
+	m_anchors.clear();
+}
+
+void InsnIndex::invalidate(uint64_t address, uint64_t size)
+{
+	//前一块的最后一条指令可能跨进被修改的范围
+	auto first = std::max(address, m_start + maxInsnSize - 1) - (maxInsnSize - 1);
+	auto last = std::min(address + size, end());
+	if (size == 0 || first >= last)
+	{
+		return;
+	}
+
+	//重新解码时检查后一块是否还和它对齐
+	m_chunks.erase(m_chunks.lower_bound((first - m_start) / chunkSize),
+				   m_chunks.upper_bound((last - 1 - m_start) / chunkSize));
+}
+
+void InsnIndex::addAnchor(uint64_t address)
+{
+	if (!contains(address) || !m_anchors.insert(address).second)
+	{
+		return;
+	}
+
+	auto index = (address - m_start) / chunkSize;
+	auto it = m_chunks.find(index);
+	if (it == m_chunks.end())
+	{
+		return;
+	}
+
+	auto& starts = it->second.starts;
+	auto cs = chunkStart(index);
+	if (std::binary_search(starts.begin(), starts.end(), (uint16_t)(address - cs)))
+	{
+		return;
+	}
+
+	//锚点不在当前的解码结果中,从块的第一条指令重新解码
+	decodeChunk(index, starts.empty() ? cs : cs + starts.front());
+	resync(index + 1);
+}
+
+uint64_t InsnIndex::ceil(uint64_t address)
+{
+	address = std::max(address, m_start);
+	while (address < end())
+	{
+		auto index = (address - m_start) / chunkSize;
+		auto cs = chunkStart(index);
+		auto& starts = chunk(index).starts;
+		auto it = std::lower_bound(starts.begin(), starts.end(), (uint16_t)(address - cs));
+		if (it != starts.end())
+		{
+			return cs + *it;
+		}
+
+		address = chunkStart(index + 1);
+	}
+
+	return end();
+}
+
+uint64_t InsnIndex::next(uint64_t address, int n)
+{
+	for (int i = 0; i < n && address < end(); ++i)
+	{
+		address = ceil(address + 1);
+	}
+
+	return std::min(address, end());
+}
+
+uint64_t InsnIndex::prev(uint64_t address, int n)
+{
+	for (int i = 0; i < n && address > m_start; ++i)
+	{
+		auto index = (std::min(address, end()) - 1 - m_start) / chunkSize;
+		for (;;)
+		{
+			auto cs = chunkStart(index);
+			auto& starts = chunk(index).starts;
+			auto it = std::lower_bound(starts.begin(), starts.end(), (uint16_t)std::min(address - cs, chunkSize));
+
+			if (it != starts.begin())
+			{
+				address = cs + *(it - 1);
+				break;
+			}
+
+			if (index == 0)
+			{
+				address = m_start;
+				break;
+			}
+			--index;
+		}
+	}
+
+	return address;
+}
+
+void InsnIndex::setChunk(uint64_t index, std::vector<uint16_t> starts, uint64_t end)
+{
+	auto cs = chunkStart(index);
+	auto& c = m_chunks[index];
+	c.starts = std::move(starts);
+	c.end = end;
+
+	//后台解码不知道锚点,有锚点不在结果中时按锚点重新解码
+	for (auto it = m_anchors.lower_bound(cs); it != m_anchors.end() && *it < cs + chunkSize; ++it)
+	{
+		if (!std::binary_search(c.starts.begin(), c.starts.end(), (uint16_t)(*it - cs)))
+		{
+			decodeChunk(index, c.starts.empty() ? cs : cs + c.starts.front());
+			break;
+		}
+	}
+
+	resync(index + 1);
+}
+
+InsnIndex::Chunk& InsnIndex::chunk(uint64_t index)
+{
+	auto it = m_chunks.find(index);
+	if (it != m_chunks.end())
+	{
+		return it->second;
+	}
+
+	auto cs = chunkStart(index);
+	uint64_t from = std::max(m_start, cs - std::min(cs, resyncOverlap));
+	auto prevIt = index > 0 ? m_chunks.find(index - 1) : m_chunks.end();
+	if (prevIt != m_chunks.end())
+	{
+		from = prevIt->second.end;
+	}
+
+	decodeChunk(index, from);
+	resync(index + 1);
+	return m_chunks[index];
+}
+
+void InsnIndex::decodeChunk(uint64_t index, uint64_t from)
+{
+	auto cs = chunkStart(index);
+	auto ce = std::min(cs + chunkSize, end());
+
+	auto bufEnd = std::min(ce + maxInsnSize, end());
+	std::vector<uint8_t> buf(bufEnd - from);
+	bool readable = m_readMemory(from, buf.data(), buf.size());
+	if (!readable && bufEnd > ce)
+	{
+		//块末尾的下一页可能不可读
+		bufEnd = ce;
+		buf.resize(bufEnd - from);
+		readable = m_readMemory(from, buf.data(), buf.size());
+	}
+
+	Chunk& c = m_chunks[index];
+	c.starts.clear();
+
+	auto anchor = m_anchors.upper_bound(from);
+	auto pos = from;
+	while (pos < ce)
+	{
+		uint64_t size = 1;
+		if (readable && pos < bufEnd)
+		{
+			auto len = (int)std::min(maxInsnSize, bufEnd - pos);
+			size = x64dis::length(buf.data() + (pos - from), len);
+		}
+
+		auto nextPos = pos + size;
+		while (anchor != m_anchors.end() && *anchor <= pos)
+		{
+			++anchor;
+		}
+		if (anchor != m_anchors.end() && *anchor < nextPos)
+		{
+			//跨过锚点的指令截断,从锚点继续解码
+			nextPos = *anchor;
+		}
+
+		if (pos >= cs)
+		{
+			c.starts.emplace_back((uint16_t)(pos - cs));
+		}
+		pos = nextPos;
+	}
+
+	c.end = pos;
+}
+
+void InsnIndex::resync(uint64_t index)
+{
+	for (; index < chunkCount(); ++index)
+	{
+		auto it = m_chunks.find(index);
+		auto prevIt = m_chunks.find(index - 1);
+		if (it == m_chunks.end() || prevIt == m_chunks.end())
+		{
+			return;
+		}
+
+		auto& starts = it->second.starts;
+		auto expected = prevIt->second.end;
+		if (!starts.empty() && chunkStart(index) + starts.front() == expected)
+		{
+			return;
+		}
+
+		decodeChunk(index, expected);
+	}
+}
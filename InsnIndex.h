@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+//内存区域的指令边界索引
+//按块(chunk)按需解码,只保存解码过的块,不需要一次解码整个区域
+//块的第一条指令从上一块的结束位置开始;上一块未解码时从块前面一小段开始解码,依靠x86指令的自同步对齐
+//锚点(如rip,跳转目标)一定是指令边界
+class InsnIndex
+{
+public:
+	using ReadMemory = std::function<bool(uint64_t address, void* buffer, uint64_t size)>;
+
+	static const uint64_t chunkSize = 4096;
+
+	void reset(uint64_t start, uint64_t size, ReadMemory readMemory);
+	//内存被修改后丢弃受影响的块,锚点保留,之后访问时重新解码
+	void invalidate(uint64_t address, uint64_t size);
+
+	uint64_t start() const { return m_start; }
+	uint64_t end() const { return m_start + m_size; }
+	bool contains(uint64_t address) const { return address >= m_start && address < m_start + m_size; }
+
+	void addAnchor(uint64_t address);
+
+	//address及之后的第一个指令边界,没有则返回end()
+	uint64_t ceil(uint64_t address);
+	//address之后的第n个指令边界,没有则返回end()
+	uint64_t next(uint64_t address, int n = 1);
+	//address之前的第n个指令边界,没有则返回start()
+	uint64_t prev(uint64_t address, int n = 1);
+
+	//供后台解码使用,直接设置某一块的解码结果
+	void setChunk(uint64_t index, std::vector<uint16_t> starts, uint64_t end);
+	bool hasChunk(uint64_t index) const { return m_chunks.count(index) != 0; }
+
+private:
+	struct Chunk
+	{
+		//块内指令起始地址相对块起始地址的偏移,升序
+		std::vector<uint16_t> starts;
+		//最后一条指令的结束地址,可能在下一块中
+		uint64_t end;
+	};
+
+	uint64_t chunkStart(uint64_t index) const { return m_start + index * chunkSize; }
+	uint64_t chunkCount() const { return (m_size + chunkSize - 1) / chunkSize; }
+	Chunk& chunk(uint64_t index);
+	void decodeChunk(uint64_t index, uint64_t from);
+	void resync(uint64_t index);
+
+	uint64_t m_start = 0;
+	uint64_t m_size = 0;
+	ReadMemory m_readMemory;
+
+	std::map<uint64_t, Chunk> m_chunks;
+	std::set<uint64_t> m_anchors;
+};
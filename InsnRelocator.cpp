@@ -0,0 +1,162 @@
+#include "InsnRelocator.h"
+
+#include <cstring>
+
+static bool fitsInt32(int64_t value)
+{
+	return value == (int32_t)value;
+}
+
+int InsnRelocator::writeJump(uint8_t* code, uint64_t target)
+{
+	static const uint8_t jmp[] = {0xff, 0x25, 0, 0, 0, 0};
+	std::memcpy(code, jmp, sizeof(jmp));
+	std::memcpy(code + sizeof(jmp), &target, sizeof(target));
+	return sizeof(jmp) + sizeof(target);
+}
+
+bool InsnRelocator::relocatable(x86dis_insn const& insn)
+{
+	if (insn.invalid)
+	{
+		return false;
+	}
+	uint64_t target;
+	auto flow = x64dis::flowKind(insn);
+	return flow != X86_FLOW_INT && flow != X86_FLOW_HALT
+		&& (flow != X86_FLOW_CALL || x64dis::branchTarget(insn, target));
+}
+
+bool InsnRelocator::ripRelative(x86dis_insn const& insn, uint8_t const* code, uint64_t address, int& pos, uint64_t& target)
+{
+	//换一个地址重新解码,rip相对寻址的地址会跟着变化,不带寄存器的绝对地址不变
+	pos = -1;
+	x86dis_insn moved;
+	const uint64_t delta = 0x1000;
+	if (!x64dis::decode(code, insn.size, address + delta, moved))
+	{
+		return false;
+	}
+
+	auto next = address + insn.size;
+	for (int i = 0; i < 5; ++i)
+	{
+		uint64_t opTarget, movedTarget;
+		if (!x64dis::absoluteAddress(insn.op[i], opTarget)
+			|| !x64dis::absoluteAddress(moved.op[i], movedTarget) || movedTarget - opTarget != delta)
+		{
+			continue;
+		}
+
+		//disp32紧跟在mod=00 rm=101的ModRM后面,立即数在disp32后面
+		auto disp = (int32_t)(opTarget - next);
+		for (int i = 1; i + 4 <= insn.size; ++i)
+		{
+			int32_t value;
+			std::memcpy(&value, code + i, sizeof(value));
+			if ((code[i - 1] & 0xc7) == 0x05 && value == disp)
+			{
+				pos = i;
+				target = opTarget;
+				return true;
+			}
+		}
+		return false;
+	}
+	return true;
+}
+
+bool InsnRelocator::relocate(x86dis_insn const& insn, uint8_t const* code, uint64_t address, uint64_t to,
+	uint8_t* out, Relocation& result)
+{
+	if (!relocatable(insn))
+	{
+		return false;
+	}
+
+	auto size = insn.size;
+	auto next = address + size;
+	auto flow = x64dis::flowKind(insn);
+	uint64_t target = 0;
+	bool direct = x64dis::branchTarget(insn, target);
+	result = Relocation();
+	result.stopOffset[0] = 0;
+	result.origin[0] = address;
+	result.stopCount = 1;
+
+	if (flow == X86_FLOW_JMP && direct)
+	{
+		result.size = writeJump(out, target);
+	}
+	else if (flow == X86_FLOW_CALL)
+	{
+		//push qword ptr [rip+6]压入返回地址,jmp qword ptr [rip+8]跳到目标
+		static const uint8_t stub[] = {0xff, 0x35, 6, 0, 0, 0, 0xff, 0x25, 8, 0, 0, 0};
+		std::memcpy(out, stub, sizeof(stub));
+		std::memcpy(out + sizeof(stub), &next, sizeof(next));
+		std::memcpy(out + sizeof(stub) + sizeof(next), &target, sizeof(target));
+		result.size = sizeof(stub) + sizeof(next) + sizeof(target);
+		result.stopOffset[1] = 6;
+		result.origin[1] = target;
+		result.stopCount = 2;
+	}
+	else if (flow == X86_FLOW_JCC)
+	{
+		//条件成立时跳过后面的jmp short,执行绝对跳转,不成立时跳过绝对跳转继续执行后面的代码
+		//rel8和rel32都改为2
+		auto rel = (int64_t)(target - next);
+		int relSize = 0;
+		if (size >= 6 && code[size - 6] == 0x0f && (code[size - 5] & 0xf0) == 0x80)
+		{
+			int32_t rel32;
+			std::memcpy(&rel32, code + size - 4, sizeof(rel32));
+			relSize = rel32 == rel ? 4 : 0;
+		}
+		else if ((int8_t)code[size - 1] == rel)
+		{
+			relSize = 1;
+		}
+		if (!direct || !relSize)
+		{
+			return false;
+		}
+
+		std::memcpy(out, code, size);
+		std::memset(out + size - relSize, 0, relSize);
+		out[size - relSize] = 2;
+		out[size] = 0xeb;
+		out[size + 1] = jumpSize;
+		result.size = size + 2 + writeJump(out + size + 2, target);
+		result.fallsThrough = true;
+		result.stopOffset[1] = size;
+		result.origin[1] = next;
+		result.stopOffset[2] = size + 2;
+		result.origin[2] = target;
+		result.stopCount = 3;
+	}
+	else
+	{
+		//其他指令原样复制,rip相对寻址的偏移改为相对新地址,ret和间接跳转不会执行到后面的代码
+		int pos;
+		uint64_t dataAddress;
+		if (!ripRelative(insn, code, address, pos, dataAddress))
+		{
+			return false;
+		}
+
+		std::memcpy(out, code, size);
+		if (pos >= 0)
+		{
+			auto disp = (int64_t)(dataAddress - (to + size));
+			if (!fitsInt32(disp))
+			{
+				return false;
+			}
+			auto disp32 = (int32_t)disp;
+			std::memcpy(out + pos, &disp32, sizeof(disp32));
+		}
+		result.size = size;
+		result.fallsThrough = flow == X86_FLOW_NONE;
+	}
+	return true;
+}
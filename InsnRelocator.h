@@ -0,0 +1,40 @@
+#pragma once
+
+#include "libasmx64.h"
+
+#include <cstdint>
+
+//一条指令搬移到新地址后的代码
+struct Relocation
+{
+	//写入的字节数
+	int size = 0;
+	//执行完后继续执行后面的代码,调用者需要在后面接跳回下一条指令的jmp
+	bool fallsThrough = false;
+	//线程可能停在搬移后代码中的位置(相对开头的偏移)和对应的原始地址
+	int stopCount = 0;
+	int stopOffset[3];
+	uint64_t origin[3];
+};
+
+//把指令搬移到其他地址执行: rip相对寻址的偏移改为相对新地址,直接跳转和调用改为绝对跳转
+//DebugCore用它生成断点处指令的副本, SaberAgent用它生成inline hook跳板中被覆盖的指令,不依赖Qt
+class InsnRelocator
+{
+public:
+	//搬移后最长的代码: jcc加上跳过绝对跳转的jmp和一个绝对跳转
+	static const int maxSize = 15 + 2 + 14;
+	//jmp qword ptr [rip]的长度,后面8字节是目标地址
+	static const int jumpSize = 14;
+
+	static int writeJump(uint8_t* code, uint64_t target);
+	//int3/syscall等在别处执行时看到的地址不对,间接call压入的返回地址不对,不能搬移
+	static bool relocatable(x86dis_insn const& insn);
+	//pos为rip相对寻址的disp32在指令中的位置,没有时为-1,这时不修改target
+	//是rip相对寻址但找不到disp32时返回false
+	static bool ripRelative(x86dis_insn const& insn, uint8_t const* code, uint64_t address, int& pos, uint64_t& target);
+	//把address处的指令(code为它的字节)搬移到to,out至少maxSize字节
+	//不能搬移或者rip相对寻址超出范围时返回false
+	static bool relocate(x86dis_insn const& insn, uint8_t const* code, uint64_t address, uint64_t to,
+		uint8_t* out, Relocation& result);
+};
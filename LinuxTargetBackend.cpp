@@ -0,0 +1,1294 @@
+#include "LinuxTargetBackend.h"
+#include "global.h"
+
+#include <QFile>
+#include <QRegExp>
+#include <QStringList>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <cpuid.h>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+std::unique_ptr<TargetBackend> createTargetBackend()
+{
+	return std::unique_ptr<TargetBackend>(new LinuxTargetBackend);
+}
+
+static void toThreadState(user_regs_struct const& regs, ThreadState& state)
+{
+	state.rax = regs.rax;
+	state.rbx = regs.rbx;
+	state.rcx = regs.rcx;
+	state.rdx = regs.rdx;
+	state.rdi = regs.rdi;
+	state.rsi = regs.rsi;
+	state.rbp = regs.rbp;
+	state.rsp = regs.rsp;
+	state.r8 = regs.r8;
+	state.r9 = regs.r9;
+	state.r10 = regs.r10;
+	state.r11 = regs.r11;
+	state.r12 = regs.r12;
+	state.r13 = regs.r13;
+	state.r14 = regs.r14;
+	state.r15 = regs.r15;
+	state.rip = regs.rip;
+	state.rflags = regs.eflags;
+	state.cs = regs.cs;
+	state.fs = regs.fs;
+	state.gs = regs.gs;
+}
+
+static void fromThreadState(ThreadState const& state, user_regs_struct& regs)
+{
+	regs.rax = state.rax;
+	regs.rbx = state.rbx;
+	regs.rcx = state.rcx;
+	regs.rdx = state.rdx;
+	regs.rdi = state.rdi;
+	regs.rsi = state.rsi;
+	regs.rbp = state.rbp;
+	regs.rsp = state.rsp;
+	regs.r8 = state.r8;
+	regs.r9 = state.r9;
+	regs.r10 = state.r10;
+	regs.r11 = state.r11;
+	regs.r12 = state.r12;
+	regs.r13 = state.r13;
+	regs.r14 = state.r14;
+	regs.r15 = state.r15;
+	regs.rip = state.rip;
+	regs.eflags = state.rflags;
+	regs.cs = state.cs;
+	regs.fs = state.fs;
+	regs.gs = state.gs;
+}
+
+static void* debugRegisterOffset(int index)
+{
+	return (void*)(offsetof(struct user, u_debugreg) + index * sizeof(uint64_t));
+}
+
+static int parseProtection(QByteArray const& perms)
+{
+	int prot = ProtNone;
+	if (perms.size() >= 3)
+	{
+		if (perms[0] == 'r') prot |= ProtRead;
+		if (perms[1] == 'w') prot |= ProtWrite;
+		if (perms[2] == 'x') prot |= ProtExecute;
+	}
+	return prot;
+}
+
+LinuxTargetBackend::LinuxTargetBackend()
+	: m_pid(0), m_stop(false)
+{
+	std::memset(&m_stoppedRegs, 0, sizeof(m_stoppedRegs));
+	std::memset(&m_debugRegs, 0, sizeof(m_debugRegs));
+}
+
+LinuxTargetBackend::~LinuxTargetBackend()
+{
+	if (m_memFd >= 0)
+	{
+		close(m_memFd);
+	}
+}
+
+void LinuxTargetBackend::setExceptionCallback(ExceptionCallback callback)
+{
+	m_callback = std::move(callback);
+}
+
+bool LinuxTargetBackend::debugNew(QString const& path, QString const& args)
+{
+	//ptrace要求由tracer线程fork调试目标,实际的启动在run()中完成
+	m_path = path;
+	m_args = args;
+	m_isAttach = false;
+	return true;
+}
+
+void LinuxTargetBackend::setEnvironment(QString const& name, QString const& value)
+{
+	m_environment[name.toLocal8Bit().constData()] = value.toLocal8Bit().constData();
+}
+
+void LinuxTargetBackend::preloadLibrary(QString const& path)
+{
+	std::string value = path.toLocal8Bit().constData();
+	auto it = m_environment.find("LD_PRELOAD");
+	auto old = it != m_environment.end() ? it->second.c_str() : getenv("LD_PRELOAD");
+	if (old && *old)
+	{
+		value += ":";
+		value += old;
+	}
+	m_environment["LD_PRELOAD"] = value;
+}
+
+bool LinuxTargetBackend::attach(pid_t pid)
+{
+	m_pid = pid;
+	m_isAttach = true;
+	return true;
+}
+
+bool LinuxTargetBackend::pause()
+{
+	return kill(m_pid, SIGINT) == 0;
+}
+
+void LinuxTargetBackend::stop()
+{
+	m_stop = true;
+	if (m_isAttach)
+	{
+		//附加的进程不结束,让tracer线程从waitpid中返回,在run()中分离所有线程
+		if (syscall(SYS_tgkill, m_pid.load(), m_pid.load(), SIGSTOP) != 0)
+		{
+			log(QString("Stop debug SIGSTOP failed: %1").arg(std::strerror(errno)), LogType::Warning);
+		}
+		return;
+	}
+
+	auto ret = kill(m_pid, SIGKILL);
+	if (ret != 0)
+	{
+		log(QString("Stop debug SIGKILL failed: %1").arg(ret), LogType::Warning);
+	}
+}
+
+bool LinuxTargetBackend::isTracerThread() const
+{
+	return std::this_thread::get_id() == m_tracerThread;
+}
+
+bool LinuxTargetBackend::startProcess()
+{
+	auto path = m_path.toLocal8Bit();
+	std::vector<QByteArray> args;
+	args.emplace_back(path);
+	for (auto const& arg : m_args.split(QRegExp("\\s+"), QString::SkipEmptyParts))
+	{
+		args.emplace_back(arg.toLocal8Bit());
+	}
+	std::vector<char*> argv;
+	for (auto& arg : args)
+	{
+		argv.emplace_back(arg.data());
+	}
+	argv.emplace_back(nullptr);
+
+	//fork之后不能分配内存,环境变量在这里准备好
+	std::vector<std::string> env;
+	for (auto e = environ; *e; ++e)
+	{
+		auto name = std::string(*e, std::strcspn(*e, "="));
+		if (!m_environment.count(name))
+		{
+			env.emplace_back(*e);
+		}
+	}
+	for (auto const& it : m_environment)
+	{
+		env.emplace_back(it.first + "=" + it.second);
+	}
+	std::vector<char*> envp;
+	for (auto& e : env)
+	{
+		envp.emplace_back(&e[0]);
+	}
+	envp.emplace_back(nullptr);
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		log(QString("fork() failed: %1 启动调试进程失败").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		//子进程, exec之后会因为PTRACE_TRACEME产生SIGTRAP
+		ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+		setpgid(0, 0);
+		execve(argv[0], argv.data(), envp.data());
+		_exit(127);
+	}
+
+	m_pid = pid;
+	return true;
+}
+
+bool LinuxTargetBackend::attachThreads()
+{
+	auto pid = m_pid.load();
+	if (ptrace(PTRACE_ATTACH, pid, nullptr, nullptr) != 0)
+	{
+		log(QString("ptrace PTRACE_ATTACH failed: %1, 附加目标进程失败").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	m_attaching.insert(pid);
+
+	//附加的线程在停下之前可能创建新线程,重新读取直到没有新的线程
+	auto path = QString("/proc/%1/task").arg(pid).toLocal8Bit();
+	for (bool added = true; added;)
+	{
+		added = false;
+		auto dir = opendir(path.constData());
+		if (!dir)
+		{
+			log(QString("打开 %1 失败：%2").arg(path.constData()).arg(std::strerror(errno)), LogType::Warning);
+			break;
+		}
+
+		while (auto entry = readdir(dir))
+		{
+			auto tid = (pid_t)std::atoi(entry->d_name);
+			if (tid <= 0 || m_attaching.count(tid))
+			{
+				continue;
+			}
+
+			//失败时线程已经退出
+			if (ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) == 0)
+			{
+				m_attaching.insert(tid);
+				added = true;
+			}
+		}
+		closedir(dir);
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::openMemory()
+{
+	if (m_memFd >= 0)
+	{
+		close(m_memFd);
+	}
+
+	auto path = QString("/proc/%1/mem").arg(m_pid.load()).toLocal8Bit();
+	m_memFd = open(path.constData(), O_RDWR | O_CLOEXEC);
+	if (m_memFd < 0)
+	{
+		log(QString("打开 %1 失败：%2").arg(path.constData()).arg(std::strerror(errno)), LogType::Warning);
+		return false;
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::run()
+{
+	m_tracerThread = std::this_thread::get_id();
+	m_stop = false;
+	m_execSeen = m_isAttach;
+	m_attaching.clear();
+
+	if (m_isAttach)
+	{
+		if (!attachThreads())
+		{
+			return false;
+		}
+	}
+	else if (!startProcess())
+	{
+		return false;
+	}
+	m_threads.insert(m_pid);
+
+	//调试器退出时只结束自己启动的进程
+	auto options = PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | (m_isAttach ? 0 : PTRACE_O_EXITKILL);
+	bool optionsSet = false;
+	//stop()之后停下的线程和它的waitpid状态,-1表示回调已经处理过
+	pid_t stoppedThread = 0;
+	int stoppedStatus = -1;
+	for (;;)
+	{
+		int status = 0;
+		pid_t tid = waitpid(-1, &status, __WALL);
+		if (tid < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		if (WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			m_threads.erase(tid);
+			m_debugApplied.erase(tid);
+			m_syncStops.erase(tid);
+			if (tid == m_pid)
+			{
+				log(QString("调试目标已退出。"));
+				break;
+			}
+			continue;
+		}
+
+		if (!WIFSTOPPED(status))
+		{
+			continue;
+		}
+
+		if (m_stop && m_isAttach)
+		{
+			//stop()为了让waitpid返回发送了SIGSTOP,这次停止在分离时处理
+			stoppedThread = tid;
+			stoppedStatus = status;
+			break;
+		}
+
+		if (!optionsSet)
+		{
+			ptrace(PTRACE_SETOPTIONS, tid, nullptr, (void*)(intptr_t)options);
+			optionsSet = true;
+		}
+
+		if (m_attaching.count(tid))
+		{
+			//附加的线程第一次停下时设置选项,除主线程外初始的SIGSTOP不通知回调
+			ptrace(PTRACE_SETOPTIONS, tid, nullptr, (void*)(intptr_t)options);
+			if ((status >> 16) == 0 && WSTOPSIG(status) == SIGSTOP)
+			{
+				m_attaching.erase(tid);
+				if (tid != m_pid)
+				{
+					m_threads.insert(tid);
+					applyDebugRegisters(tid);
+					ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+					continue;
+				}
+			}
+		}
+
+		if (m_threads.count(tid) == 0)
+		{
+			//PTRACE_O_TRACECLONE自动附加的新线程,以SIGSTOP开始,调试寄存器不会从创建它的线程继承
+			m_threads.insert(tid);
+			applyDebugRegisters(tid);
+			ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+			continue;
+		}
+
+		if ((status >> 16) == 0 && WSTOPSIG(status) == SIGSTOP && m_syncStops.erase(tid))
+		{
+			applyDebugRegisters(tid);
+			ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+			continue;
+		}
+
+		if ((status >> 16) == PTRACE_EVENT_CLONE)
+		{
+			ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+			continue;
+		}
+
+		ExceptionInfo info;
+		if (!translateStop(tid, status, info))
+		{
+			ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+			continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_stateMtx);
+			m_stoppedThread = tid;
+			m_stoppedDebugStatus = info.debugStatus;
+			m_stateDirty = false;
+			m_resumed = false;
+			if (ptrace(PTRACE_GETREGS, tid, nullptr, &m_stoppedRegs) != 0)
+			{
+				log(QString("PTRACE_GETREGS failed: %1").arg(std::strerror(errno)), LogType::Error);
+			}
+		}
+
+		bool handled = m_callback ? m_callback(info) : false;
+
+		if (m_stop)
+		{
+			stoppedThread = m_resumed ? 0 : tid;
+			break;
+		}
+
+		if (!m_resumed)
+		{
+			//回调没有让目标继续运行,未处理的signal交给调试目标自己处理
+			flushThreadState();
+			int sig = 0;
+			if (!handled && (info.exceptionType == ExceptionType::Signal || info.exceptionType == ExceptionType::Fault))
+			{
+				sig = info.signal;
+			}
+			syncDebugRegisters(tid);
+			ptrace(PTRACE_CONT, tid, nullptr, (void*)(intptr_t)sig);
+		}
+
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		m_stoppedThread = 0;
+	}
+
+	if (m_stop && m_isAttach)
+	{
+		detachThreads(stoppedThread, stoppedStatus);
+	}
+	else if (m_stop)
+	{
+		reapThreads();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		m_stoppedThread = 0;
+	}
+	m_threads.clear();
+	m_attaching.clear();
+	m_debugApplied.clear();
+	m_syncStops.clear();
+	m_pid = 0;
+	return true;
+}
+
+void LinuxTargetBackend::detachThreads(pid_t current, int status)
+{
+	auto pid = m_pid.load();
+	//每个线程都在自己的SIGSTOP的signal-delivery-stop中分离,SIGSTOP不会留给调试目标
+	//ready: 已经在SIGSTOP中停下; held: 因为其他原因停下,SIGSTOP还在等待,值为waitpid状态
+	std::set<pid_t> ready;
+	std::map<pid_t, int> held;
+	auto onStop = [&](pid_t tid, int st)
+	{
+		if (WIFEXITED(st) || WIFSIGNALED(st))
+		{
+			m_threads.erase(tid);
+			m_attaching.erase(tid);
+			ready.erase(tid);
+			held.erase(tid);
+			return;
+		}
+		if (!WIFSTOPPED(st))
+		{
+			return;
+		}
+
+		//clone出来的新线程以SIGSTOP开始
+		m_threads.insert(tid);
+		int sig = WSTOPSIG(st);
+		if ((st >> 16) != 0)
+		{
+			ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+		}
+		else if (sig == SIGSTOP)
+		{
+			ready.insert(tid);
+		}
+		else if (sig == SIGTRAP)
+		{
+			//断点恢复后才能决定怎样继续
+			held[tid] = st;
+		}
+		else
+		{
+			ptrace(PTRACE_CONT, tid, nullptr, (void*)(intptr_t)sig);
+		}
+	};
+	auto allStopped = [&]
+	{
+		for (auto tid : m_threads)
+		{
+			if (!ready.count(tid) && !held.count(tid))
+			{
+				return false;
+			}
+		}
+		return true;
+	};
+	auto waitStops = [&]
+	{
+		while (!allStopped())
+		{
+			int st = 0;
+			auto tid = waitpid(-1, &st, __WALL);
+			if (tid < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				break;
+			}
+			onStop(tid, st);
+		}
+	};
+
+	for (auto tid : m_attaching)
+	{
+		m_threads.insert(tid);
+	}
+	if (current && status == -1)
+	{
+		flushThreadState();
+		held[current] = -1;
+	}
+	else if (current)
+	{
+		onStop(current, status);
+	}
+
+	//主线程已经由stop()发送,已经附加但还没有收到初始SIGSTOP的线程和为了写入调试寄存器发送过的线程也不需要再发送
+	for (auto tid : m_threads)
+	{
+		if (tid != pid && !ready.count(tid) && !m_attaching.count(tid) && !m_syncStops.count(tid))
+		{
+			syscall(SYS_tgkill, pid, tid, SIGSTOP);
+		}
+	}
+	waitStops();
+
+	//所有线程都停下后由DebugCore恢复断点处的原始数据
+	if (m_callback)
+	{
+		ExceptionInfo info;
+		info.threadId = 0;
+		info.exceptionType = ExceptionType::Detach;
+		info.signal = 0;
+		m_callback(info);
+	}
+
+	//清除调试寄存器和TF,停在已经删除的int3上的线程回到断点地址
+	bool clearDebugRegisters;
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		clearDebugRegisters = m_debugVersion != 0;
+	}
+	std::map<pid_t, int> pendingSignals;
+	for (auto tid : m_threads)
+	{
+		if (clearDebugRegisters)
+		{
+			ptrace(PTRACE_POKEUSER, tid, debugRegisterOffset(7), nullptr);
+		}
+
+		user_regs_struct regs;
+		if (ptrace(PTRACE_GETREGS, tid, nullptr, &regs) != 0)
+		{
+			continue;
+		}
+		bool modified = (regs.eflags & 0x100) != 0;
+		regs.eflags &= ~0x100ull;
+
+		auto it = held.find(tid);
+		siginfo_t si;
+		if (it != held.end() && it->second != -1
+			&& ptrace(PTRACE_GETSIGINFO, tid, nullptr, &si) == 0 && (si.si_code == SI_KERNEL || si.si_code == TRAP_BRKPT))
+		{
+			uint8_t byte = 0;
+			if (readMemory(regs.rip - 1, &byte, 1) && byte != 0xCC)
+			{
+				--regs.rip;
+				modified = true;
+			}
+			else
+			{
+				//调试目标自己的int3
+				pendingSignals[tid] = SIGTRAP;
+			}
+		}
+
+		if (modified && ptrace(PTRACE_SETREGS, tid, nullptr, &regs) != 0)
+		{
+			log(QString("PTRACE_SETREGS failed: %1").arg(std::strerror(errno)), LogType::Warning);
+		}
+	}
+
+	//停在其他原因上的线程继续运行,立即在等待的SIGSTOP上停下
+	for (auto const& it : held)
+	{
+		auto sig = pendingSignals.count(it.first) ? pendingSignals[it.first] : 0;
+		ptrace(PTRACE_CONT, it.first, nullptr, (void*)(intptr_t)sig);
+	}
+	held.clear();
+	waitStops();
+
+	//stop()的SIGSTOP可能在另一个SIGSTOP停止之后才发出,分离前消费掉还在等待的SIGSTOP,否则调试目标会整体停止
+	for (;;)
+	{
+		bool pending = false;
+		for (auto tid : std::vector<pid_t>(ready.begin(), ready.end()))
+		{
+			if (isSignalPending(tid, SIGSTOP))
+			{
+				ready.erase(tid);
+				ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+				pending = true;
+			}
+		}
+		if (!pending)
+		{
+			break;
+		}
+		waitStops();
+	}
+
+	for (auto tid : ready)
+	{
+		if (ptrace(PTRACE_DETACH, tid, nullptr, nullptr) != 0)
+		{
+			log(QString("PTRACE_DETACH %1 failed: %2").arg(tid).arg(std::strerror(errno)), LogType::Warning);
+		}
+	}
+	log(QString("已分离调试目标 %1").arg(pid));
+}
+
+bool LinuxTargetBackend::isSignalPending(pid_t tid, int sig)
+{
+	//线程私有的等待信号在SigPnd中
+	QFile file(QString("/proc/%1/task/%2/status").arg(m_pid.load()).arg(tid));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+
+	for (auto const& line : file.readAll().split('\n'))
+	{
+		if (line.startsWith("SigPnd:"))
+		{
+			return (line.mid(7).trimmed().toULongLong(nullptr, 16) >> (sig - 1)) & 1;
+		}
+	}
+	return false;
+}
+
+void LinuxTargetBackend::reapThreads()
+{
+	//stop()已经发送SIGKILL,等待主线程退出
+	for (;;)
+	{
+		int status = 0;
+		auto tid = waitpid(-1, &status, __WALL);
+		if (tid < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+		if (tid == m_pid && (WIFEXITED(status) || WIFSIGNALED(status)))
+		{
+			break;
+		}
+	}
+}
+
+bool LinuxTargetBackend::translateStop(pid_t tid, int status, ExceptionInfo& info)
+{
+	int sig = WSTOPSIG(status);
+	info.threadId = tid;
+	info.signal = sig;
+	info.debugStatus = 0;
+	info.exceptionDataCount = 0;
+	info.addExceptionData(sig);
+
+	if ((status >> 16) == PTRACE_EVENT_EXEC)
+	{
+		info.exceptionType = ExceptionType::Exec;
+		m_execSeen = true;
+		openMemory();
+		return true;
+	}
+
+	if (sig == SIGTRAP)
+	{
+		if (!m_execSeen)
+		{
+			//PTRACE_TRACEME之后第一次exec产生的SIGTRAP
+			info.exceptionType = ExceptionType::Exec;
+			m_execSeen = true;
+			openMemory();
+			return true;
+		}
+
+		siginfo_t si;
+		if (ptrace(PTRACE_GETSIGINFO, tid, nullptr, &si) != 0)
+		{
+			return false;
+		}
+		info.addExceptionData(si.si_code);
+		switch (si.si_code)
+		{
+		case SI_KERNEL:
+		case TRAP_BRKPT:
+			info.exceptionType = ExceptionType::Breakpoint;
+			break;
+		case TRAP_TRACE:
+		case TRAP_HWBKPT:
+		{
+			info.exceptionType = ExceptionType::SingleStep;
+			{
+				std::lock_guard<std::mutex> lock(m_stateMtx);
+				if (!(m_debugRegs.dr7 & 0xff))
+				{
+					break;
+				}
+			}
+
+			//同时是单步和硬件断点时si_code为TRAP_TRACE,从DR6中判断是否有硬件断点触发
+			errno = 0;
+			auto dr6 = (uint64_t)ptrace(PTRACE_PEEKUSER, tid, debugRegisterOffset(6), nullptr);
+			if (errno == 0 && (dr6 & 0xf))
+			{
+				info.exceptionType = ExceptionType::HardwareBreakpoint;
+				info.debugStatus = (dr6 & 0xf) | (si.si_code == TRAP_TRACE ? dr6SingleStep : 0);
+				info.addExceptionData(dr6);
+			}
+			break;
+		}
+		default:
+			info.exceptionType = ExceptionType::Signal;
+			break;
+		}
+		return true;
+	}
+
+	if (m_memFd < 0)
+	{
+		openMemory();
+	}
+
+	switch (sig)
+	{
+	case SIGSEGV:
+	case SIGBUS:
+	case SIGILL:
+	case SIGFPE:
+		info.exceptionType = ExceptionType::Fault;
+		break;
+	default:
+		info.exceptionType = ExceptionType::Signal;
+		break;
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::readMemory(uint64_t address, void* buffer, uint64_t size)
+{
+	iovec local{buffer, size};
+	iovec remote{(void*)address, size};
+	auto n = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+	if (n == (ssize_t)size)
+	{
+		return true;
+	}
+
+	//process_vm_readv不能读取没有读权限的页, 通过/proc/pid/mem再试一次
+	if (m_memFd < 0 || pread(m_memFd, buffer, size, address) != (ssize_t)size)
+	{
+		log(QString("读取内存失败 address: 0x%1 size: %2").arg(address, 0, 16).arg(size), LogType::Warning);
+		return false;
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::writeMemory(uint64_t address, const void* buffer, uint64_t size)
+{
+	//写/proc/pid/mem可以忽略页面的写保护, 用于写入代码段中的断点
+	if (m_memFd < 0 || pwrite(m_memFd, buffer, size, address) != (ssize_t)size)
+	{
+		log(QString("写入内存失败 address: 0x%1 size: %2").arg(address, 0, 16).arg(size), LogType::Warning);
+		return false;
+	}
+	return true;
+}
+
+std::vector<MemoryRegion> LinuxTargetBackend::getMemoryMap()
+{
+	std::vector<MemoryRegion> memoryRegions;
+	QFile file(QString("/proc/%1/maps").arg(m_pid.load()));
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return memoryRegions;
+	}
+
+	for (auto const& line : file.readAll().split('\n'))
+	{
+		auto fields = line.simplified().split(' ');
+		if (fields.size() < 2)
+		{
+			continue;
+		}
+		auto range = fields[0].split('-');
+		if (range.size() != 2)
+		{
+			continue;
+		}
+		uint64_t start = range[0].toULongLong(nullptr, 16);
+		uint64_t end = range[1].toULongLong(nullptr, 16);
+		int prot = parseProtection(fields[1]);
+		memoryRegions.emplace_back(MemoryRegion{start, end - start, prot, prot});
+	}
+	return memoryRegions;
+}
+
+bool LinuxTargetBackend::findRegion(uint64_t address, MemoryRegion& region)
+{
+	for (auto const& it : getMemoryMap())
+	{
+		if (address < it.start + it.size)
+		{
+			region = it;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LinuxTargetBackend::allocateMemory(ThreadId thread, uint64_t hint, uint64_t size, uint64_t& address)
+{
+	//让停止的线程执行mmap: 把入口点临时改为syscall后单步执行一次,入口点的代码在启动后不会再被执行
+	auto tid = (pid_t)thread;
+	if (!isTracerThread() || tid != m_stoppedThread)
+	{
+		log(QString("线程 %1 没有停止, 分配内存失败。").arg(thread), LogType::Error);
+		return false;
+	}
+
+	static const uint8_t syscallCode[2] = {0x0f, 0x05};
+	uint64_t entry;
+	uint8_t orgCode[sizeof(syscallCode)];
+	user_regs_struct saved;
+	if (!readEntryAddress(entry) || !readMemory(entry, orgCode, sizeof(orgCode)))
+	{
+		return false;
+	}
+	if (ptrace(PTRACE_GETREGS, tid, nullptr, &saved) != 0)
+	{
+		log(QString("PTRACE_GETREGS error: \"%1\" 分配内存失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	if (!writeMemory(entry, syscallCode, sizeof(syscallCode)))
+	{
+		return false;
+	}
+
+	auto regs = saved;
+	regs.rip = entry;
+	//orig_rax为-1时内核不会把它当成被打断的系统调用重新执行
+	regs.orig_rax = (uint64_t)-1;
+	regs.rax = SYS_mmap;
+	regs.rdi = hint;
+	regs.rsi = size;
+	regs.rdx = PROT_READ | PROT_EXEC;
+	regs.r10 = MAP_PRIVATE | MAP_ANONYMOUS;
+	regs.r8 = (uint64_t)-1;
+	regs.r9 = 0;
+
+	bool stepped = false;
+	int pendingSignal = 0;
+	if (ptrace(PTRACE_SETREGS, tid, nullptr, &regs) == 0)
+	{
+		while (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) == 0)
+		{
+			int status = 0;
+			auto ret = waitpid(tid, &status, __WALL);
+			if (ret < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (ret != tid || !WIFSTOPPED(status))
+			{
+				break;
+			}
+			if (WSTOPSIG(status) == SIGTRAP)
+			{
+				stepped = ptrace(PTRACE_GETREGS, tid, nullptr, &regs) == 0;
+				break;
+			}
+			//单步期间收到的signal在恢复现场后重新发送
+			pendingSignal = WSTOPSIG(status);
+		}
+	}
+
+	ptrace(PTRACE_SETREGS, tid, nullptr, &saved);
+	writeMemory(entry, orgCode, sizeof(orgCode));
+	if (pendingSignal)
+	{
+		syscall(SYS_tgkill, m_pid.load(), tid, pendingSignal);
+	}
+
+	if (!stepped || regs.rip != entry + sizeof(syscallCode) || regs.rax >= (uint64_t)-4095)
+	{
+		log(QString("在调试目标中执行mmap失败: 0x%1").arg(regs.rax, 0, 16), LogType::Warning);
+		return false;
+	}
+	address = regs.rax;
+	return true;
+}
+
+bool LinuxTargetBackend::getThreadState(ThreadId thread, ThreadState& state)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		if ((pid_t)thread == m_stoppedThread)
+		{
+			toThreadState(m_stoppedRegs, state);
+			return true;
+		}
+	}
+
+	if (!isTracerThread())
+	{
+		log(QString("线程 %1 没有停止, 获取通用寄存器状态失败。").arg(thread), LogType::Error);
+		return false;
+	}
+
+	user_regs_struct regs;
+	if (ptrace(PTRACE_GETREGS, (pid_t)thread, nullptr, &regs) != 0)
+	{
+		log(QString("PTRACE_GETREGS error: \"%1\" 获取通用寄存器状态失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	toThreadState(regs, state);
+	return true;
+}
+
+bool LinuxTargetBackend::setThreadState(ThreadId thread, ThreadState const& state)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		if ((pid_t)thread == m_stoppedThread)
+		{
+			fromThreadState(state, m_stoppedRegs);
+			m_stateDirty = true;
+			return true;
+		}
+	}
+
+	if (!isTracerThread())
+	{
+		log(QString("线程 %1 没有停止, 设置通用寄存器状态失败。").arg(thread), LogType::Error);
+		return false;
+	}
+
+	user_regs_struct regs;
+	if (ptrace(PTRACE_GETREGS, (pid_t)thread, nullptr, &regs) != 0)
+	{
+		log(QString("PTRACE_GETREGS error: \"%1\" 设置通用寄存器状态失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	fromThreadState(state, regs);
+	if (ptrace(PTRACE_SETREGS, (pid_t)thread, nullptr, &regs) != 0)
+	{
+		log(QString("PTRACE_SETREGS error: \"%1\" 设置通用寄存器状态失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	return true;
+}
+
+//XSAVE区域的前512字节和FXSAVE相同,后面是XSAVE头
+static const uint64_t xsaveHeaderOffset = 512;
+//ptrace输出的XSAVE区域中,内核在FXSAVE的保留区域(偏移464)写入XCR0
+static const uint64_t xcr0Offset = 464;
+static const uint64_t xcr0Avx = 1 << 2;
+static const uint64_t xcr0Avx512 = 7 << 5;
+
+bool LinuxTargetBackend::getVectorState(ThreadId thread, VectorState& state)
+{
+	if (!isTracerThread())
+	{
+		log(QString("线程 %1 的向量寄存器只能在调试线程中读取。").arg(thread), LogType::Error);
+		return false;
+	}
+
+	//内核按非压缩格式输出XSAVE区域,大小和各部分的偏移由CPUID 0xD给出,虚拟机中CPUID很慢,只查询一次
+	if (m_xsave.empty())
+	{
+		unsigned int eax, ebx, ecx, edx;
+		bool xsave = __get_cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx) && ecx > xsaveHeaderOffset;
+		m_xsave.resize(xsave ? ecx : sizeof(user_fpregs_struct));
+		for (int i = 2; xsave && i < 8; ++i)
+		{
+			if (__get_cpuid_count(0xd, i, &eax, &ebx, &ecx, &edx) && eax)
+			{
+				m_xsaveOffsets[i] = ebx;
+			}
+		}
+	}
+	//不支持XSAVE时只有FXSAVE格式的x87/SSE
+	uint64_t size = 0;
+	iovec iov{m_xsave.data(), m_xsave.size()};
+	if (m_xsave.size() > sizeof(user_fpregs_struct) && ptrace(PTRACE_GETREGSET, (pid_t)thread, (void*)NT_X86_XSTATE, &iov) == 0)
+	{
+		size = iov.iov_len;
+	}
+	else if (ptrace(PTRACE_GETFPREGS, (pid_t)thread, nullptr, m_xsave.data()) == 0)
+	{
+		size = sizeof(user_fpregs_struct);
+	}
+	else
+	{
+		log(QString("PTRACE_GETFPREGS error: \"%1\" 获取向量寄存器失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+
+	auto fx = m_xsave.data();
+	std::memset(&state, 0, sizeof(state));
+	std::memcpy(&state.fcw, fx, sizeof(state.fcw));
+	std::memcpy(&state.fsw, fx + 2, sizeof(state.fsw));
+	state.ftw = fx[4];
+	std::memcpy(&state.fop, fx + 6, sizeof(state.fop));
+	std::memcpy(&state.fip, fx + 8, sizeof(state.fip));
+	std::memcpy(&state.fdp, fx + 16, sizeof(state.fdp));
+	std::memcpy(&state.mxcsr, fx + 24, sizeof(state.mxcsr));
+	std::memcpy(&state.mxcsrMask, fx + 28, sizeof(state.mxcsrMask));
+	for (int i = 0; i < 8; ++i)
+	{
+		std::memcpy(state.st[i], fx + 32 + i * 16, 10);
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		std::memcpy(state.zmm[i], fx + 160 + i * 16, 16);
+	}
+	state.vectorSize = 16;
+	state.vectorCount = 16;
+	if (size < xsaveHeaderOffset + 64)
+	{
+		return true;
+	}
+
+	uint64_t xcr0;
+	uint64_t xstateBv;
+	std::memcpy(&xcr0, fx + xcr0Offset, sizeof(xcr0));
+	std::memcpy(&xstateBv, fx + xsaveHeaderOffset, sizeof(xstateBv));
+
+	//XSTATE_BV中没有置位的部分处于初始状态,全为0
+	auto component = [&](int index, uint64_t componentSize) -> const uint8_t*
+	{
+		auto offset = m_xsaveOffsets[index];
+		if (!(xstateBv & (1ull << index)) || !offset || offset + componentSize > size)
+		{
+			return nullptr;
+		}
+		return fx + offset;
+	};
+
+	if (xcr0 & xcr0Avx)
+	{
+		state.vectorSize = 32;
+		if (auto ymmHigh = component(2, 16 * 16))
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				std::memcpy(state.zmm[i] + 16, ymmHigh + i * 16, 16);
+			}
+		}
+	}
+	if ((xcr0 & xcr0Avx512) == xcr0Avx512)
+	{
+		state.vectorSize = 64;
+		state.vectorCount = 32;
+		if (auto opmask = component(5, sizeof(state.k)))
+		{
+			std::memcpy(state.k, opmask, sizeof(state.k));
+		}
+		if (auto zmmHigh = component(6, 16 * 32))
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				std::memcpy(state.zmm[i] + 32, zmmHigh + i * 32, 32);
+			}
+		}
+		if (auto zmm16 = component(7, 16 * 64))
+		{
+			std::memcpy(state.zmm[16], zmm16, 16 * 64);
+		}
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::flushThreadState()
+{
+	std::lock_guard<std::mutex> lock(m_stateMtx);
+	if (!m_stateDirty)
+	{
+		return true;
+	}
+
+	m_stateDirty = false;
+	if (ptrace(PTRACE_SETREGS, m_stoppedThread, nullptr, &m_stoppedRegs) != 0)
+	{
+		log(QString("PTRACE_SETREGS error: \"%1\" 设置通用寄存器状态失败。").arg(std::strerror(errno)), LogType::Error);
+		return false;
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::resume(ThreadId thread)
+{
+	flushThreadState();
+	syncDebugRegisters((pid_t)thread);
+	m_resumed = true;
+	return ptrace(PTRACE_CONT, (pid_t)thread, nullptr, nullptr) == 0;
+}
+
+bool LinuxTargetBackend::readEntryAddress(uint64_t& entryAddr)
+{
+	QFile auxv(QString("/proc/%1/auxv").arg(m_pid.load()));
+	if (!auxv.open(QIODevice::ReadOnly))
+	{
+		log("读取auxv失败, 获取入口点失败", LogType::Error);
+		return false;
+	}
+
+	auto data = auxv.readAll();
+	auto entries = reinterpret_cast<const Elf64_auxv_t*>(data.constData());
+	for (std::size_t i = 0; i < data.size() / sizeof(Elf64_auxv_t); ++i)
+	{
+		if (entries[i].a_type == AT_ENTRY)
+		{
+			entryAddr = entries[i].a_un.a_val;
+			return true;
+		}
+	}
+	log("auxv中没有AT_ENTRY, 获取入口点失败", LogType::Error);
+	return false;
+}
+
+bool LinuxTargetBackend::getEntryAndDataAddr(uint64_t& entryAddr, uint64_t& dataAddr)
+{
+	if (!readEntryAddress(entryAddr))
+	{
+		return false;
+	}
+	log(QString("entry: 0x%1").arg(QString::number(entryAddr, 16)), LogType::Info);
+
+	//主程序的第一个可写映射作为数据段
+	char exePath[4096];
+	auto exeLink = QString("/proc/%1/exe").arg(m_pid.load()).toLocal8Bit();
+	auto len = readlink(exeLink.constData(), exePath, sizeof(exePath) - 1);
+	if (len <= 0)
+	{
+		return true;
+	}
+	exePath[len] = 0;
+
+	QFile maps(QString("/proc/%1/maps").arg(m_pid.load()));
+	if (!maps.open(QIODevice::ReadOnly))
+	{
+		return true;
+	}
+	for (auto const& line : maps.readAll().split('\n'))
+	{
+		auto fields = line.simplified().split(' ');
+		if (fields.size() < 6 || fields[5] != exePath || !(parseProtection(fields[1]) & ProtWrite))
+		{
+			continue;
+		}
+		dataAddr = fields[0].split('-')[0].toULongLong(nullptr, 16);
+		log(QString("data addr is %1").arg(dataAddr));
+		break;
+	}
+	return true;
+}
+
+bool LinuxTargetBackend::getDebugRegisters(ThreadId thread, DebugRegisters& regs)
+{
+	//所有线程的调试寄存器相同,DR6只有停止的线程有意义
+	std::lock_guard<std::mutex> lock(m_stateMtx);
+	regs = m_debugRegs;
+	regs.dr6 = (pid_t)thread == m_stoppedThread ? m_stoppedDebugStatus : 0;
+	return true;
+}
+
+bool LinuxTargetBackend::setDebugRegisters(DebugRegisters const& regs)
+{
+	std::lock_guard<std::mutex> lock(m_stateMtx);
+	m_debugRegs = regs;
+	++m_debugVersion;
+	return true;
+}
+
+bool LinuxTargetBackend::applyDebugRegisters(pid_t tid)
+{
+	DebugRegisters regs;
+	uint64_t version;
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		regs = m_debugRegs;
+		version = m_debugVersion;
+	}
+
+	auto& applied = m_debugApplied[tid];
+	if (applied == version)
+	{
+		return true;
+	}
+	applied = version;
+
+	//先禁用全部,内核在写入地址时会按DR7中的长度检查对齐
+	if (ptrace(PTRACE_POKEUSER, tid, debugRegisterOffset(7), nullptr) != 0)
+	{
+		log(QString("PTRACE_POKEUSER error: \"%1\" 设置线程 %2 的调试寄存器失败。").arg(std::strerror(errno)).arg(tid), LogType::Error);
+		return false;
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		if (ptrace(PTRACE_POKEUSER, tid, debugRegisterOffset(i), (void*)regs.dr[i]) != 0)
+		{
+			log(QString("PTRACE_POKEUSER error: \"%1\" 设置 DR%2 为 0x%3 失败。").arg(std::strerror(errno)).arg(i).arg(regs.dr[i], 0, 16), LogType::Error);
+			return false;
+		}
+	}
+	if (ptrace(PTRACE_POKEUSER, tid, debugRegisterOffset(7), (void*)regs.dr7) != 0)
+	{
+		log(QString("PTRACE_POKEUSER error: \"%1\" 设置 DR7 为 0x%2 失败。").arg(std::strerror(errno)).arg(regs.dr7, 0, 16), LogType::Error);
+		return false;
+	}
+	return true;
+}
+
+void LinuxTargetBackend::syncDebugRegisters(pid_t current)
+{
+	applyDebugRegisters(current);
+
+	uint64_t version;
+	{
+		std::lock_guard<std::mutex> lock(m_stateMtx);
+		version = m_debugVersion;
+	}
+	if (version == m_syncedVersion)
+	{
+		return;
+	}
+	m_syncedVersion = version;
+
+	for (auto tid : m_threads)
+	{
+		if (tid != current && m_debugApplied[tid] != version && !m_syncStops.count(tid)
+			&& syscall(SYS_tgkill, m_pid.load(), tid, SIGSTOP) == 0)
+		{
+			m_syncStops.insert(tid);
+		}
+	}
+}
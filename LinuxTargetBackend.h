@@ -0,0 +1,109 @@
+#pragma once
+
+#include "TargetBackend.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/user.h>
+
+//基于ptrace的Linux实现
+//ptrace请求只能由tracer线程(即执行run()的调试线程)发出,
+//其他线程访问停止线程的寄存器时使用停止时保存的快照,修改在继续运行前写回
+class LinuxTargetBackend : public TargetBackend
+{
+public:
+	LinuxTargetBackend();
+	~LinuxTargetBackend();
+
+	void setExceptionCallback(ExceptionCallback callback) override;
+
+	bool debugNew(QString const& path, QString const& args) override;
+	void setEnvironment(QString const& name, QString const& value) override;
+	void preloadLibrary(QString const& path) override;
+	bool attach(pid_t pid) override;
+	bool pause() override;
+	void stop() override;
+	bool run() override;
+	pid_t pid() const override { return m_pid; }
+	bool stopsAllThreads() const override { return false; }
+
+	bool readMemory(uint64_t address, void* buffer, uint64_t size) override;
+	bool writeMemory(uint64_t address, const void* buffer, uint64_t size) override;
+	bool findRegion(uint64_t address, MemoryRegion& region) override;
+	std::vector<MemoryRegion> getMemoryMap() override;
+	bool allocateMemory(ThreadId thread, uint64_t hint, uint64_t size, uint64_t& address) override;
+
+	bool getThreadState(ThreadId thread, ThreadState& state) override;
+	bool setThreadState(ThreadId thread, ThreadState const& state) override;
+	bool getVectorState(ThreadId thread, VectorState& state) override;
+	bool resume(ThreadId thread) override;
+
+	bool getDebugRegisters(ThreadId thread, DebugRegisters& regs) override;
+	bool setDebugRegisters(DebugRegisters const& regs) override;
+
+	bool getEntryAndDataAddr(uint64_t& entryAddr, uint64_t& dataAddr) override;
+
+private:
+	bool isTracerThread() const;
+	bool startProcess();
+	//附加/proc/<pid>/task中的所有线程,直到没有新的线程出现
+	bool attachThreads();
+	//停止调试附加的进程: 让所有线程停下,通过回调恢复断点,然后分离所有线程,调试目标继续运行
+	//current为run()中已经停下的线程,status为它的waitpid状态,-1表示回调已经处理过这次停止
+	void detachThreads(pid_t current, int status);
+	//读取/proc判断线程是否有还没有处理的信号
+	bool isSignalPending(pid_t tid, int sig);
+	//结束debugNew()启动的进程,回收所有线程
+	void reapThreads();
+	bool openMemory();
+	//从auxv中读取主程序的入口点
+	bool readEntryAddress(uint64_t& entryAddr);
+	bool flushThreadState();
+	bool translateStop(pid_t tid, int status, ExceptionInfo& info);
+	//调试寄存器只能在线程停止时写入
+	bool applyDebugRegisters(pid_t tid);
+	//写入当前线程,并让其他还没有写入的线程停下,停下后在run()中写入
+	void syncDebugRegisters(pid_t current);
+
+	ExceptionCallback m_callback;
+
+	QString m_path;
+	QString m_args;
+	//debugNew()启动的进程添加或覆盖的环境变量
+	std::map<std::string, std::string> m_environment;
+	bool m_isAttach = false;
+	//附加时已经发出PTRACE_ATTACH,还没有收到初始SIGSTOP的线程
+	std::set<pid_t> m_attaching;
+	std::atomic<pid_t> m_pid;
+	std::atomic<bool> m_stop;
+	std::thread::id m_tracerThread;
+	int m_memFd = -1;
+
+	//已经消费过初始SIGSTOP的线程
+	std::set<pid_t> m_threads;
+	bool m_execSeen = false;
+
+	std::mutex m_stateMtx;
+	pid_t m_stoppedThread = 0;
+	user_regs_struct m_stoppedRegs;
+	bool m_stateDirty = false;
+	bool m_resumed = false;
+
+	//所有线程共用的调试寄存器,每次修改后m_debugVersion加1,由m_stateMtx保护
+	DebugRegisters m_debugRegs;
+	uint64_t m_debugVersion = 0;
+	uint64_t m_stoppedDebugStatus = 0;
+	//以下只在tracer线程中访问: 各线程已经写入的版本,为了写入调试寄存器发送了SIGSTOP的线程
+	std::map<pid_t, uint64_t> m_debugApplied;
+	std::set<pid_t> m_syncStops;
+	uint64_t m_syncedVersion = 0;
+	//读取向量寄存器的XSAVE区域和其中各部分的偏移,第一次读取时通过CPUID获得,只在tracer线程中访问
+	std::vector<uint8_t> m_xsave;
+	uint32_t m_xsaveOffsets[8] = {};
+};
@@ -0,0 +1,61 @@
+#include "LogQueue.h"
+
+LogQueue* LogQueue::instance()
+{
+	static LogQueue queue;
+	return &queue;
+}
+
+LogQueue::LogQueue()
+{
+	auto stub = new Node;
+	m_head = stub;
+	m_tail = stub;
+}
+
+LogQueue::~LogQueue()
+{
+	while (m_tail)
+	{
+		auto next = m_tail->next.load(std::memory_order_relaxed);
+		delete m_tail;
+		m_tail = next;
+	}
+}
+
+void LogQueue::push(QString const& msg, LogType type)
+{
+	if (m_size.fetch_add(1, std::memory_order_relaxed) >= maxSize)
+	{
+		m_size.fetch_sub(1, std::memory_order_relaxed);
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	auto node = new Node;
+	node->entry.msg = msg;
+	node->entry.type = type;
+	//先占据队尾再链接,两步之间读取的线程会认为队列在这里结束,下次再读
+	auto prev = m_head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+bool LogQueue::pop(Entry& entry)
+{
+	auto next = m_tail->next.load(std::memory_order_acquire);
+	if (!next)
+	{
+		return false;
+	}
+
+	entry = std::move(next->entry);
+	delete m_tail;
+	m_tail = next;
+	m_size.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+uint64_t LogQueue::takeDropped()
+{
+	return m_dropped.exchange(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Common.h"
+
+#include <atomic>
+#include <cstdint>
+
+//多个线程写入,界面线程定时批量读取的无锁队列
+//调试线程记录日志时不经过Qt的事件循环,日志点每秒命中很多次时界面也不会被信号淹没
+class LogQueue
+{
+public:
+	struct Entry
+	{
+		QString msg;
+		LogType type;
+	};
+
+	static LogQueue* instance();
+
+	LogQueue();
+	~LogQueue();
+	LogQueue(const LogQueue&) = delete;
+	LogQueue& operator=(const LogQueue&) = delete;
+
+	//可以在任意线程调用,队列已满时丢弃
+	void push(QString const& msg, LogType type);
+	//只能在一个线程调用,队列为空时返回false
+	bool pop(Entry& entry);
+	//返回并清零上次调用以来丢弃的条数
+	uint64_t takeDropped();
+
+	//没有读取时最多保留的条数
+	static const int64_t maxSize = 1 << 20;
+
+private:
+	struct Node
+	{
+		std::atomic<Node*> next{nullptr};
+		Entry entry;
+	};
+
+	//m_head是最后写入的节点,m_tail是已经读取的节点,它的next才是下一个要读取的
+	std::atomic<Node*> m_head;
+	Node* m_tail;
+	std::atomic<int64_t> m_size{0};
+	std::atomic<uint64_t> m_dropped{0};
+};
@@ -0,0 +1,671 @@
+#include "MachTargetBackend.h"
+#include "TargetException.h"
+#include "global.h"
+#include "utils.h"
+
+#include <QProcess>
+
+#include <cstddef>
+#include <cstring>
+
+#include <spawn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/ptrace.h>
+#include <mach/mach_vm.h>
+#include <mach-o/loader.h>
+
+task_port_t g_task = 0;
+pid_t g_pid = 0;
+
+static_assert(sizeof(ThreadState) == sizeof(x86_thread_state64_t), "ThreadState layout mismatch");
+static_assert(offsetof(ThreadState, rip) == offsetof(x86_thread_state64_t, __rip), "ThreadState layout mismatch");
+static_assert(offsetof(ThreadState, gs) == offsetof(x86_thread_state64_t, __gs), "ThreadState layout mismatch");
+static_assert(sizeof(DebugRegisters) == sizeof(x86_debug_state64_t), "DebugRegisters layout mismatch");
+static_assert(offsetof(DebugRegisters, dr7) == offsetof(x86_debug_state64_t, __dr7), "DebugRegisters layout mismatch");
+
+class DebugProcess : public QProcess
+{
+public:
+    DebugProcess()
+    {}
+
+    // QProcess interface
+protected:
+    void setupChildProcess() override;
+};
+
+void DebugProcess::setupChildProcess()
+{
+    //--------------------------------------------------------------
+    // Child process
+    //--------------------------------------------------------------
+    ptrace (PT_TRACE_ME, 0, 0, 0);    // Debug this process
+    ptrace (PT_SIGEXC, 0, 0, 0);    // Get BSD signals as mach exceptions
+
+    // If our parent is setgid, lets make sure we don't inherit those
+    // extra powers due to nepotism.
+    if (setgid (getgid ()) == 0)
+    {
+
+        // Let the child have its own process group. We need to execute
+        // this call in both the child and parent to avoid a race condition
+        // between the two processes.
+        setpgid (0, 0);    // Set the child process group to match its pid
+
+        // Sleep a bit to before the exec call
+        sleep (1);
+    }
+}
+
+std::unique_ptr<TargetBackend> createTargetBackend()
+{
+	return std::unique_ptr<TargetBackend>(new MachTargetBackend);
+}
+
+MachTargetBackend::MachTargetBackend()
+{
+
+}
+
+MachTargetBackend::~MachTargetBackend()
+{
+
+}
+
+void MachTargetBackend::setExceptionCallback(ExceptionCallback callback)
+{
+	m_callback = std::move(callback);
+}
+
+bool MachTargetBackend::debugNew(const QString &path, const QString &args)
+{
+	//TODO: 检查文件是否是64位程序,不是则停止调试
+
+    m_process = new DebugProcess; //TODO: 泄露怎么处理??
+    QString command = path + " " + args;
+	m_process->setProcessEnvironment(m_environment);
+	m_process->start(command);
+    g_pid = (pid_t)m_process->pid();
+
+    if (g_pid <= 0)
+    {
+        log(QString("启动调试进程失败：%1").arg(m_process->errorString()), LogType::Error);
+        return false;
+    }
+
+    //父进程执行
+    kern_return_t err = task_for_pid(mach_task_self(), g_pid, &g_task);
+    if (err != KERN_SUCCESS)
+    {
+        log(QString("task_for_pid() error: %1 启动调试进程失败").arg(mach_error_string(err)), LogType::Error);
+        return false;
+    }
+
+	if (!TargetException::instance().setExceptionCallback(m_callback))
+    {
+        log("setExceptionCallback failed, 启动调试进程失败", LogType::Error);
+        return false;
+    }
+
+	m_isAttach = false;
+    return true;
+}
+
+void MachTargetBackend::setEnvironment(QString const& name, QString const& value)
+{
+	m_environment.insert(name, value);
+}
+
+void MachTargetBackend::preloadLibrary(QString const& path)
+{
+	auto old = m_environment.value("DYLD_INSERT_LIBRARIES");
+	m_environment.insert("DYLD_INSERT_LIBRARIES", old.isEmpty() ? path : path + ":" + old);
+}
+
+bool MachTargetBackend::attach(pid_t pid)
+{
+	g_pid = pid;
+	kern_return_t err = task_for_pid(mach_task_self(), g_pid, &g_task);
+	if (err != KERN_SUCCESS)
+	{
+		log(QString("task_for_pid() error: %1 附加目标进程失败").arg(mach_error_string(err)), LogType::Error);
+		return false;
+	}
+
+	if (!TargetException::instance().setExceptionCallback(m_callback))
+	{
+		log("setExceptionCallback failed, 附加目标进城失败", LogType::Error);
+		return false;
+	}
+
+	if (ptrace(PT_ATTACHEXC, pid, 0, 0) != 0)
+	{
+		log("ptrace PT_ATTACHEXC failed, 附加目标进城失败", LogType::Error);
+		return false;
+	}
+
+	m_isAttach = true;
+	return true;
+}
+
+bool MachTargetBackend::pause()
+{
+	return kill(g_pid, SIGINT) == 0;
+}
+
+void MachTargetBackend::stop()
+{
+	//只结束由调试器启动的进程,附加的进程分离后继续运行
+	if (!m_isAttach)
+	{
+		auto ret = kill(g_pid, SIGKILL);
+		if (ret != 0)
+		{
+			log(QString("Stop debug SIGKILL failed: %1").arg(ret), LogType::Warning);
+		}
+	}
+	TargetException::instance().stop();
+
+	if (m_isAttach)
+	{
+		//TODO: 删除所有断点
+		if (ptrace(PT_DETACH, g_pid, (caddr_t)1, 0) != 0)
+		{
+			log("Stop debug detach failed", LogType::Error);
+		}
+	}
+	else
+	{
+		auto ret = ptrace(PT_KILL, g_pid, 0, 0);
+		if (ret != -1)
+		{
+			log(QString("Stop debug ptrace kill failed: %1").arg(ret), LogType::Error);
+		}
+	}
+}
+
+bool MachTargetBackend::run()
+{
+	auto ret = TargetException::instance().run();
+	g_pid = 0;
+	return ret;
+}
+
+bool MachTargetBackend::readMemory(uint64_t address, void* buffer, uint64_t size)
+{
+	mach_vm_address_t regionAddress = address;
+	mach_vm_size_t regionSize = 0;
+	natural_t depth = 0;
+	vm_region_submap_short_info_data_64_t info;
+	mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
+	bool needRestore = false;
+	auto _ = finally([&needRestore, &address, &size, &info]
+	{
+		if (!needRestore)
+		{
+			return;
+		}
+		log("restore");
+		kern_return_t kr = mach_vm_protect(g_task, address, size, 0, info.protection);
+		if (kr != KERN_SUCCESS)
+		{
+			log(QString("mach_vm_protect还原内存属性失败：").append(mach_error_string(kr)), LogType::Warning);
+		}
+	});
+
+	kern_return_t kr = mach_vm_region_recurse(g_task, &regionAddress, &regionSize, &depth, (vm_region_recurse_info_t)&info, &count);
+	if (kr != KERN_SUCCESS)
+	{
+		log(QString("读取内存失败，mach_vm_region_recurse：").append(mach_error_string(kr)), LogType::Warning);
+		return false;
+	}
+
+	//outputMessage(QString("region: %1").arg(regionAddress, 0, 16), MessageType::Info);
+	if ((info.protection & VM_PROT_READ) == 0)
+	{
+		kr = mach_vm_protect(g_task, address, size, 0, info.protection | VM_PROT_READ);
+		if (kr != KERN_SUCCESS)
+		{
+			log(QString("读取内存失败，mach_vm_protect：").append(mach_error_string(kr)), LogType::Warning);
+			return false;
+		}
+		needRestore = true;
+	}
+
+    /* read memory - vm_read_overwrite because we supply the buffer */
+    mach_vm_size_t nread;
+    kr = mach_vm_read_overwrite(g_task, address, size, (mach_vm_address_t)buffer, &nread);
+    if (kr != KERN_SUCCESS)
+    {
+        log(QString("mach_vm_read_overwrite failed at address: 0x%1 with error: %2").arg(address, 0, 16).arg(mach_error_string(kr)), LogType::Warning);
+        return false;
+    }
+    else if (nread != size)
+    {
+        log(QString("mach_vm_read_overwrite failed, requested size: %1 read: %2").arg(size).arg(nread), LogType::Warning);
+        return false;
+    }
+
+	return true;
+}
+
+bool MachTargetBackend::writeMemory(uint64_t address, const void *buffer, uint64_t size)
+{
+    mach_vm_address_t regionAddress = address;
+    mach_vm_size_t regionSize = 0;
+    natural_t depth = 0;
+    vm_region_submap_short_info_data_64_t info;
+    mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
+	bool needRestore = false;
+	auto _ = finally([&needRestore, &address, &size, &info]
+	{
+		if (!needRestore)
+		{
+			return;
+		}
+		log("restore");
+		kern_return_t kr = mach_vm_protect(g_task, address, size, 0, info.protection);
+		if (kr != KERN_SUCCESS)
+		{
+			log(QString("mach_vm_protect还原内存属性失败：").append(mach_error_string(kr)), LogType::Warning);
+		}
+	});
+    kern_return_t kr = mach_vm_region_recurse(g_task, &regionAddress, &regionSize, &depth, (vm_region_recurse_info_t)&info, &count);
+    if (kr != KERN_SUCCESS)
+    {
+        log(QString("写入内存失败，mach_vm_region_recurse：").append(mach_error_string(kr)), LogType::Warning);
+        return false;
+    }
+
+    //outputMessage(QString("region: %1").arg(regionAddress, 0, 16), MessageType::Info);
+    if ((info.protection & VM_PROT_WRITE) == 0)
+    {
+        kr = mach_vm_protect(g_task, address, size, 0, info.protection | VM_PROT_WRITE);
+        if (kr != KERN_SUCCESS)
+        {
+            log(QString("写入内存失败，mach_vm_protect：").append(mach_error_string(kr)), LogType::Warning);
+            return false;
+        }
+
+		needRestore = true;
+    }
+
+    kr = mach_vm_write(g_task, address, (vm_offset_t)buffer, size);
+    if (kr != KERN_SUCCESS)
+    {
+        log(QString("mach_vm_write() failed: %1, address: 0x%2").arg(mach_error_string(kr)).arg(QString::number(address, 16)), LogType::Warning);
+        return false;
+    }
+
+    return true;
+}
+
+bool MachTargetBackend::findRegion(uint64_t address, MemoryRegion& region)
+{
+    mach_vm_address_t start = address;
+    mach_vm_size_t size = 0;
+    natural_t depth = 0;
+    vm_region_submap_short_info_data_64_t info;
+    mach_msg_type_number_t count = VM_REGION_SUBMAP_SHORT_INFO_COUNT_64;
+
+    if (mach_vm_region_recurse(g_task, &start, &size,
+       &depth, (vm_region_recurse_info_t)&info, &count) != KERN_SUCCESS)
+    {
+        return false;
+    }
+
+    region = MemoryRegion{start, size, info.protection, info.max_protection};
+    return true;
+}
+
+std::vector<MemoryRegion> MachTargetBackend::getMemoryMap()
+{
+	std::vector<MemoryRegion> memoryRegions;
+	vm_region_submap_short_info_data_64_t prevInfo;
+    mach_vm_address_t start = 0;
+    do
+    {
+        mach_vm_size_t size = 0;
+        natural_t depth = 0;
+        vm_region_submap_short_info_data_64_t info;
+        mach_msg_type_number_t count = VM_REGION_SUBMAP_SHORT_INFO_COUNT_64;
+
+        kern_return_t kr = mach_vm_region_recurse(g_task, &start, &size,
+                              &depth, (vm_region_recurse_info_t)&info, &count);
+        if (kr != KERN_SUCCESS)
+        {
+            break;
+        }
+
+        bool needAdd = true;
+        if (!memoryRegions.empty())
+        {
+            auto& region = memoryRegions.back();
+            if (start == region.start + region.size)
+            {
+                if ((info.protection != prevInfo.protection)
+                    || (info.max_protection != prevInfo.max_protection)
+                    || (info.inheritance != prevInfo.inheritance)
+                    || (info.share_mode != prevInfo.share_mode))
+                {
+                    region.size += size;
+                    needAdd = false;
+                }
+            }
+        }
+        if (needAdd)
+        {
+            memoryRegions.emplace_back(MemoryRegion{start, size, info.protection, info.max_protection});
+            prevInfo = info;
+        }
+
+        start += size;
+
+    } while (start != 0);
+
+	return memoryRegions;
+}
+
+bool MachTargetBackend::allocateMemory(ThreadId, uint64_t hint, uint64_t size, uint64_t& address)
+{
+	//hint处已被占用时由系统选择地址
+	mach_vm_address_t start = hint;
+	kern_return_t kr = KERN_INVALID_ADDRESS;
+	if (hint)
+	{
+		kr = mach_vm_allocate(g_task, &start, size, VM_FLAGS_FIXED);
+	}
+	if (kr != KERN_SUCCESS)
+	{
+		start = 0;
+		kr = mach_vm_allocate(g_task, &start, size, VM_FLAGS_ANYWHERE);
+	}
+	if (kr != KERN_SUCCESS)
+	{
+		log(QString("分配内存失败，mach_vm_allocate：").append(mach_error_string(kr)), LogType::Warning);
+		return false;
+	}
+
+	kr = mach_vm_protect(g_task, start, size, 0, VM_PROT_READ | VM_PROT_EXECUTE);
+	if (kr != KERN_SUCCESS)
+	{
+		log(QString("分配内存失败，mach_vm_protect：").append(mach_error_string(kr)), LogType::Warning);
+		mach_vm_deallocate(g_task, start, size);
+		return false;
+	}
+
+	address = start;
+	return true;
+}
+
+bool MachTargetBackend::getThreadState(ThreadId thread, ThreadState& state)
+{
+    mach_msg_type_number_t stateCount = x86_THREAD_STATE64_COUNT;
+    auto err = thread_get_state((mach_port_t)thread, x86_THREAD_STATE64, (thread_state_t)&state, &stateCount);
+    if (err != KERN_SUCCESS)
+    {
+        log(QString("thread_get_state() error: \"%1\" 获取通用寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
+        return false;
+    }
+
+	return true;
+}
+
+bool MachTargetBackend::setThreadState(ThreadId thread, ThreadState const& state)
+{
+    auto err = thread_set_state((mach_port_t)thread, x86_THREAD_STATE64, (thread_state_t)&state, x86_THREAD_STATE64_COUNT);
+    if (err != KERN_SUCCESS)
+    {
+        log(QString("thread_set_state() error: \"%1\" 设置通用寄存器状态失败。").arg(mach_error_string(err)), LogType::Error);
+        return false;
+    }
+
+	return true;
+}
+
+//x86_avx512_state64_t和x86_avx_state64_t开头的x87/SSE部分和x86_float_state64_t相同
+template <typename T>
+static void copyFloatState(T const& fp, VectorState& state)
+{
+	std::memcpy(&state.fcw, &fp.__fpu_fcw, sizeof(state.fcw));
+	std::memcpy(&state.fsw, &fp.__fpu_fsw, sizeof(state.fsw));
+	state.ftw = fp.__fpu_ftw;
+	state.fop = fp.__fpu_fop;
+	state.fip = fp.__fpu_ip;
+	state.fdp = fp.__fpu_dp;
+	state.mxcsr = fp.__fpu_mxcsr;
+	state.mxcsrMask = fp.__fpu_mxcsrmask;
+	auto stmm = &fp.__fpu_stmm0;
+	for (int i = 0; i < 8; ++i)
+	{
+		std::memcpy(state.st[i], stmm[i].__mmst_reg, 10);
+	}
+	auto xmm = &fp.__fpu_xmm0;
+	for (int i = 0; i < 16; ++i)
+	{
+		std::memcpy(state.zmm[i], xmm[i].__xmm_reg, 16);
+	}
+}
+
+template <typename T>
+static void copyYmmHigh(T const& avx, VectorState& state)
+{
+	auto ymmh = &avx.__fpu_ymmh0;
+	for (int i = 0; i < 16; ++i)
+	{
+		std::memcpy(state.zmm[i] + 16, ymmh[i].__xmm_reg, 16);
+	}
+}
+
+bool MachTargetBackend::getVectorState(ThreadId thread, VectorState& state)
+{
+	//从大到小尝试,CPU不支持的flavor返回错误
+	std::memset(&state, 0, sizeof(state));
+	x86_avx512_state64_t avx512;
+	mach_msg_type_number_t stateCount = x86_AVX512_STATE64_COUNT;
+	if (thread_get_state((mach_port_t)thread, x86_AVX512_STATE64, (thread_state_t)&avx512, &stateCount) == KERN_SUCCESS)
+	{
+		copyFloatState(avx512, state);
+		copyYmmHigh(avx512, state);
+		auto k = &avx512.__fpu_k0;
+		for (int i = 0; i < 8; ++i)
+		{
+			std::memcpy(&state.k[i], k[i].__opmask_reg, sizeof(state.k[i]));
+		}
+		auto zmmh = &avx512.__fpu_zmmh0;
+		for (int i = 0; i < 16; ++i)
+		{
+			std::memcpy(state.zmm[i] + 32, zmmh[i].__ymm_reg, 32);
+		}
+		auto zmm = &avx512.__fpu_zmm16;
+		for (int i = 0; i < 16; ++i)
+		{
+			std::memcpy(state.zmm[16 + i], zmm[i].__zmm_reg, 64);
+		}
+		state.vectorSize = 64;
+		state.vectorCount = 32;
+		return true;
+	}
+
+	x86_avx_state64_t avx;
+	stateCount = x86_AVX_STATE64_COUNT;
+	if (thread_get_state((mach_port_t)thread, x86_AVX_STATE64, (thread_state_t)&avx, &stateCount) == KERN_SUCCESS)
+	{
+		copyFloatState(avx, state);
+		copyYmmHigh(avx, state);
+		state.vectorSize = 32;
+		state.vectorCount = 16;
+		return true;
+	}
+
+	x86_float_state64_t fp;
+	stateCount = x86_FLOAT_STATE64_COUNT;
+	auto err = thread_get_state((mach_port_t)thread, x86_FLOAT_STATE64, (thread_state_t)&fp, &stateCount);
+	if (err != KERN_SUCCESS)
+	{
+		log(QString("thread_get_state() error: \"%1\" 获取向量寄存器失败。").arg(mach_error_string(err)), LogType::Error);
+		return false;
+	}
+	copyFloatState(fp, state);
+	state.vectorSize = 16;
+	state.vectorCount = 16;
+	return true;
+}
+
+bool MachTargetBackend::resume(ThreadId thread)
+{
+	//异常消息被回复后线程才会继续运行, PT_CONTINUE只对处于signal停止状态的进程有效
+	return ptrace(PT_CONTINUE, g_pid, (caddr_t)1, 0) == -1;
+}
+
+bool MachTargetBackend::getDebugRegisters(ThreadId thread, DebugRegisters& regs)
+{
+    mach_msg_type_number_t stateCount = x86_DEBUG_STATE64_COUNT;
+    auto err = thread_get_state((mach_port_t)thread, x86_DEBUG_STATE64, (thread_state_t)&regs, &stateCount);
+    if (err != KERN_SUCCESS)
+    {
+        log(QString("thread_get_state() error: \"%1\" 获取调试寄存器失败。").arg(mach_error_string(err)), LogType::Error);
+        return false;
+    }
+
+	return true;
+}
+
+bool MachTargetBackend::setDebugRegisters(DebugRegisters const& regs)
+{
+	//task的调试寄存器由之后创建的线程继承,已有的线程逐个设置
+	auto state = regs;
+	state.dr6 = 0;
+	auto err = task_set_state(g_task, x86_DEBUG_STATE64, (thread_state_t)&state, x86_DEBUG_STATE64_COUNT);
+	if (err != KERN_SUCCESS)
+	{
+		log(QString("task_set_state() error: \"%1\" 设置调试寄存器失败。").arg(mach_error_string(err)), LogType::Error);
+		return false;
+	}
+
+	thread_act_array_t threads;
+	mach_msg_type_number_t threadCount;
+	err = task_threads(g_task, &threads, &threadCount);
+	if (err != KERN_SUCCESS)
+	{
+		log(QString("task_threads() error: \"%1\" 设置调试寄存器失败。").arg(mach_error_string(err)), LogType::Error);
+		return false;
+	}
+
+	bool ok = true;
+	for (mach_msg_type_number_t i = 0; i < threadCount; ++i)
+	{
+		err = thread_set_state(threads[i], x86_DEBUG_STATE64, (thread_state_t)&state, x86_DEBUG_STATE64_COUNT);
+		if (err != KERN_SUCCESS)
+		{
+			log(QString("thread_set_state() error: \"%1\" 设置调试寄存器失败。").arg(mach_error_string(err)), LogType::Error);
+			ok = false;
+		}
+		mach_port_deallocate(mach_task_self(), threads[i]);
+	}
+	vm_deallocate(mach_task_self(), (vm_address_t)threads, threadCount * sizeof(thread_act_t));
+	return ok;
+}
+
+mach_vm_address_t MachTargetBackend::findBaseAddress()
+{
+    mach_vm_address_t addr = 0;
+    for (;;)
+    {
+        mach_header mh = {0};
+        mach_vm_size_t size = 0;
+        uint32_t depth;
+        vm_region_submap_short_info_data_64_t info;
+        mach_msg_type_number_t count = VM_REGION_SUBMAP_INFO_COUNT_64;
+
+        kern_return_t kr = mach_vm_region_recurse(g_task, &addr, &size, &depth, (vm_region_recurse_info_t)&info, &count);
+        if (kr != KERN_SUCCESS)
+        {
+            log(QString("查找基地址失败，vm_region_recurse_64：").append(mach_error_string(kr)), LogType::Error);
+            return 0;
+        }
+
+        if (!readMemory(addr, &mh, sizeof(struct mach_header)))
+        {
+            log(QString("查找基地址失败，readMemory() error"), LogType::Error);
+            return 0;
+        }
+        /* only one image with MH_EXECUTE filetype */
+        if (mh.filetype == MH_EXECUTE)
+        {
+			if (mh.magic == MH_MAGIC)
+			{
+				log("调试目标是32位程序,暂不支持调试32位程序", LogType::Error);
+				return 0;
+			}
+
+			if (mh.magic == MH_MAGIC_64)
+			{
+				return addr;
+			}
+        }
+
+        addr += size;
+    }
+}
+
+bool MachTargetBackend::getEntryAndDataAddr(uint64_t& entryAddr, uint64_t& dataAddr)
+{
+    mach_vm_address_t aslrBase = findBaseAddress();
+	if (aslrBase == 0)
+	{
+		return false;
+	}
+    mach_header header = {0};
+    if (!readMemory(aslrBase, &header, sizeof(header)))
+	{
+		return false;
+	}
+
+    std::vector<char> cmdBuff(header.sizeofcmds);
+    auto p = cmdBuff.data();
+    if (!readMemory(aslrBase + sizeof(mach_header_64), p, cmdBuff.size()))
+	{
+		return false;
+	}
+
+    for (int i = 0; i < header.ncmds; ++i)
+    {
+        load_command* cmd = (load_command*)p;
+		log(QString("cmd->cmd: %1").arg(cmd->cmd, 8, 16));
+        if (cmd->cmd == LC_MAIN)
+        {
+            entry_point_command* epcmd = (entry_point_command*)p;
+            entryAddr = aslrBase + epcmd->entryoff;
+            log(QString("aslr base: 0x%1, entry: 0x%2").arg(QString::number(aslrBase, 16)).arg(QString::number(entryAddr, 16)), LogType::Info);
+        }
+		else if (cmd->cmd == LC_UNIXTHREAD || cmd->cmd == LC_THREAD)
+		{
+			//LC_UNIXTHREAD和LC_THREAD对应的结构体thread_commant不完整,这里直接通过偏移找到
+			entryAddr = *reinterpret_cast<uint64_t*>(p + 16 * 9);
+		}
+		else if (cmd->cmd == LC_SEGMENT_64)
+		{
+			segment_command_64* segcmd = (segment_command_64*)p;
+			if (std::strncmp(segcmd->segname, SEG_DATA, 6) == 0)
+			{
+				for (int j = 0; j < segcmd->nsects; ++j)
+				{
+					auto secloc = p + sizeof(segment_command_64) + j * sizeof(section_64);
+					section_64* sec = (section_64*)secloc;
+					if (std::strncmp(sec->sectname, SECT_DATA, 6) == 0)
+					{
+						dataAddr = aslrBase + sec->addr;
+						log(QString("__data section addr is %1").arg(dataAddr));
+					}
+				}
+			}
+		}
+        p += cmd->cmdsize;
+    }
+
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "TargetBackend.h"
+
+#include <QProcessEnvironment>
+
+#include <mach/mach.h>
+
+extern task_port_t g_task;
+extern pid_t g_pid;
+
+class DebugProcess;
+
+class MachTargetBackend : public TargetBackend
+{
+public:
+	MachTargetBackend();
+	~MachTargetBackend();
+
+	void setExceptionCallback(ExceptionCallback callback) override;
+
+	bool debugNew(QString const& path, QString const& args) override;
+	void setEnvironment(QString const& name, QString const& value) override;
+	void preloadLibrary(QString const& path) override;
+	bool attach(pid_t pid) override;
+	bool pause() override;
+	void stop() override;
+	bool run() override;
+	pid_t pid() const override { return g_pid; }
+	bool stopsAllThreads() const override { return true; }
+
+	bool readMemory(uint64_t address, void* buffer, uint64_t size) override;
+	bool writeMemory(uint64_t address, const void* buffer, uint64_t size) override;
+	bool findRegion(uint64_t address, MemoryRegion& region) override;
+	std::vector<MemoryRegion> getMemoryMap() override;
+	bool allocateMemory(ThreadId thread, uint64_t hint, uint64_t size, uint64_t& address) override;
+
+	bool getThreadState(ThreadId thread, ThreadState& state) override;
+	bool setThreadState(ThreadId thread, ThreadState const& state) override;
+	bool getVectorState(ThreadId thread, VectorState& state) override;
+	bool resume(ThreadId thread) override;
+
+	bool getDebugRegisters(ThreadId thread, DebugRegisters& regs) override;
+	bool setDebugRegisters(DebugRegisters const& regs) override;
+
+	bool getEntryAndDataAddr(uint64_t& entryAddr, uint64_t& dataAddr) override;
+
+private:
+	mach_vm_address_t findBaseAddress();
+
+	ExceptionCallback m_callback;
+	bool m_isAttach = false;
+	DebugProcess* m_process = nullptr;
+	//debugNew()启动的进程使用的环境变量
+	QProcessEnvironment m_environment = QProcessEnvironment::systemEnvironment();
+};
@@ -8,6 +8,7 @@
 #include "MemoryMapView.h"
 #include "RegisterView.h"
 #include "MemoryView.h"
+#include "TraceView.h"
 
 #include <QtDockWidget.h>
 #include <QtFlexWidget.h>
@@ -15,6 +16,8 @@
 
 #include "DebugCore.h"
 
+#include <algorithm>
+#include <climits>
 
 MainWindow::MainWindow(QWidget *parent)
 		: QMainWindow(parent)
@@ -70,6 +73,10 @@ MainWindow::MainWindow(QWidget *parent)
 	{
 		activeOrAddDockWidget(Flex::ToolView,"输出",Flex::B0,0,center);
 	}, Qt::ALT + Qt::Key_L));
+	addAction("view.traceView", menu->addAction("跟踪窗口", [this]
+	{
+		activeOrAddDockWidget(Flex::ToolView,"跟踪",Flex::B0,0,center);
+	}, QKeySequence(Qt::ALT + Qt::Key_T)));
 	menuBar()->addMenu(menu);
 
 	menu = new QMenu("调试",this);
@@ -163,14 +170,90 @@ MainWindow::MainWindow(QWidget *parent)
 		  QMessageBox::warning(this, "错误", "请先选择要调试的程序");
 		}
 	}, QKeySequence(Qt::Key_F7)));
-	addAction("debug.runToReturn", menu->addAction(QIcon(":/icon/Resources/run_to_ret.png"), "运行到返回", []
+	addAction("debug.runToReturn", menu->addAction(QIcon(":/icon/Resources/run_to_ret.png"), "运行到返回", [this]
 	{
-
+		if (m_debugCore)
+		{
+			m_debugCore->stepOut();
+		}
+		else
+		{
+			QMessageBox::warning(this, "错误", "请先选择要调试的程序");
+		}
 	}, QKeySequence(Qt::CTRL + Qt::Key_F7)));
-	addAction("debug.runToCursor", menu->addAction(QIcon(":/icon/Resources/run_to_cursor.png"), "运行到光标处", []
+	addAction("debug.runToCursor", menu->addAction(QIcon(":/icon/Resources/run_to_cursor.png"), "运行到光标处", [this]
 	{
+		if (!m_debugCore)
+		{
+			QMessageBox::warning(this, "错误", "请先选择要调试的程序");
+			return;
+		}
 
+		if (!m_debugCore->runTo(g_highlightAddress))
+		{
+			QMessageBox::warning(this, "错误", QString("无法运行到 0x%1").arg(g_highlightAddress, 0, 16));
+		}
 	}, QKeySequence(Qt::Key_F4)));
+	addAction("debug.trace", menu->addAction("跟踪步入", [this]
+	{
+		if (!m_debugCore)
+		{
+			QMessageBox::warning(this, "错误", "请先选择要调试的程序");
+			return;
+		}
+
+		bool ok = false;
+		auto count = QInputDialog::getInt(this, "跟踪步入", "最多执行的指令数", 1000000, 1, INT_MAX, 1, &ok);
+		if (ok)
+		{
+			activeOrAddDockWidget(Flex::ToolView,"跟踪",Flex::B0,0,center);
+			m_debugCore->trace(count);
+		}
+	}, QKeySequence(Qt::CTRL + Qt::Key_F11)));
+	auto agentAction = menu->addAction("启动时注入agent");
+	agentAction->setCheckable(true);
+	addAction("debug.agent", agentAction);
+	addAction("debug.tracepoint", menu->addAction("添加/删除跟踪点", [this]
+	{
+		if (!m_debugCore || !m_debugCore->agentEnabled())
+		{
+			QMessageBox::information(this, "提示", "跟踪点需要在启动调试目标前选择\"启动时注入agent\"");
+			return;
+		}
+
+		auto const& tracepoints = m_debugCore->tracepoints();
+		if (std::binary_search(tracepoints.begin(), tracepoints.end(), g_highlightAddress))
+		{
+			m_debugCore->removeTracepoint(g_highlightAddress);
+		}
+		else if (!m_debugCore->addTracepoint(g_highlightAddress))
+		{
+			QMessageBox::warning(this, "错误", QString("在 0x%1 处添加跟踪点失败").arg(g_highlightAddress, 0, 16));
+		}
+	}));
+	addAction("debug.tracepointHits", menu->addAction("跟踪点命中统计", [this]
+	{
+		if (!m_debugCore || !m_debugCore->agentEnabled())
+		{
+			return;
+		}
+
+		//命中次数由跳板计数,记录只用于查看详细信息,命中频繁时大部分会被覆盖
+		std::vector<AgentRecord> records;
+		m_debugCore->drainTracepointHits(records, m_tracepointDropped);
+		for (auto const& record : records)
+		{
+			++m_tracepointRecords[record.address];
+		}
+		for (auto address : m_debugCore->tracepoints())
+		{
+			auto state = m_debugCore->tracepointState(address);
+			log(QString("跟踪点 0x%1: 命中 %2 次, 读取到 %3 条记录%4").arg(address, 0, 16)
+				.arg(m_debugCore->tracepointHits(address)).arg(m_tracepointRecords[address])
+				.arg(state == AgentHookState::Failed ? ", 安装失败" : state == AgentHookState::Install ? ", 等待agent安装" : ""));
+		}
+		log(QString("来不及读取被覆盖的记录: %1").arg(m_tracepointDropped));
+	}));
 	menuBar()->addMenu(menu);
 
 	menu = new QMenu("工具",this);
@@ -223,6 +306,8 @@ MainWindow::MainWindow(QWidget *parent)
 	tb->addAction(getAction("debug.run"));
 	tb->addAction(getAction("debug.stepOver"));
 	tb->addAction(getAction("debug.stepIn"));
+	tb->addAction(getAction("debug.runToReturn"));
+	tb->addAction(getAction("debug.runToCursor"));
 
 
 	tb = addToolBar("工具");
@@ -368,6 +453,12 @@ void MainWindow::onDockWidgetCreated(DockWidget *widget)
 		}
 		widget->attachWidget(view);
 	}
+	else if (title == "跟踪")
+	{
+		auto view = new TraceView(widget);
+		view->setDebugCore(m_debugCore);
+		widget->attachWidget(view);
+	}
 	else if (title == "栈")
 	{
 //		auto view = new QHexView(this);
@@ -438,6 +529,18 @@ void MainWindow::onFileOpen()
 	m_debugCore = std::make_shared<DebugCore>();
     emit EventDispatcher::instance()->setDebugCore(m_debugCore);
 
+	m_tracepointRecords.clear();
+	m_tracepointDropped = 0;
+	if (getAction("debug.agent")->isChecked())
+	{
+		//agent和Saber在同一个目录
+#ifdef Q_OS_MAC
+		auto library = QCoreApplication::applicationDirPath() + "/libsaber_agent.dylib";
+#else
+		auto library = QCoreApplication::applicationDirPath() + "/libsaber_agent.so";
+#endif
+		m_debugCore->enableAgent(library);
+	}
 	m_debugCore->debugNew(path, args);
 }
 
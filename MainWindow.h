@@ -49,5 +49,9 @@ private:
     std::shared_ptr<DebugCore> m_debugCore = nullptr;
 
     OutputModel* m_outputModel;
+
+    //每个跟踪点读取到的命中记录数,启动新的调试目标时清空
+    std::map<uint64_t, uint64_t> m_tracepointRecords;
+    uint64_t m_tracepointDropped = 0;
 };
 
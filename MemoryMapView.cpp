@@ -30,7 +30,7 @@ void MemoryMapView::updateContent()
 	{
 		setItem(i, 0, new QTableWidgetItem(QString("%1").arg(regions[i].start, 0, 16)));
 		setItem(i, 1, new QTableWidgetItem(QString("%1").arg(regions[i].size, 0, 16)));
-		setItem(i, 2, new QTableWidgetItem(QString("%1").arg(regions[i].info.protection, 0, 16)));
+		setItem(i, 2, new QTableWidgetItem(QString("%1").arg(regions[i].protection, 0, 16)));
 	}
 }
 
@@ -3,41 +3,122 @@
 //
 
 #include "OutputView.h"
-#include "EventDispatcher.h"
+
+#include <QColor>
+#include <QTimer>
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
 
 OutputModel::OutputModel(QObject *parent)
-	: QStandardItemModel(parent)
+	: QAbstractTableModel(parent)
+{
+	auto timer = new QTimer(this);
+	QObject::connect(timer, &QTimer::timeout, this, &OutputModel::drainLogs);
+	timer->start(1000 / 30);
+}
+
+int OutputModel::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : (int)m_entries.size();
+}
+
+int OutputModel::columnCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : 2;
+}
+
+QVariant OutputModel::data(const QModelIndex& index, int role) const
+{
+	if (!index.isValid() || index.row() >= (int)m_entries.size())
+	{
+		return QVariant();
+	}
+
+	auto const& entry = m_entries[index.row()];
+	switch (role)
+	{
+	case Qt::DisplayRole:
+		if (index.column() == 1)
+		{
+			return entry.msg;
+		}
+		switch (entry.type)
+		{
+		case LogType::Debug:
+			return "Debug";
+		case LogType::Info:
+			return "Info";
+		case LogType::Warning:
+			return "Warning";
+		case LogType::Error:
+			return "Error";
+		}
+		return QVariant();
+	case Qt::BackgroundRole:
+		switch (entry.type)
+		{
+		case LogType::Debug:
+			return QColor(Qt::lightGray);
+		case LogType::Info:
+			return QColor(Qt::white);
+		case LogType::Warning:
+			return QColor(Qt::yellow);
+		case LogType::Error:
+			return QColor(Qt::red);
+		}
+		return QVariant();
+	default:
+		return QVariant();
+	}
+}
+
+QVariant OutputModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
-	setHorizontalHeaderLabels(QStringList() << "级别" << "信息");
-	QObject::connect(EventDispatcher::instance(), &EventDispatcher::addLog, this, &OutputModel::addLog);
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+	{
+		return QAbstractTableModel::headerData(section, orientation, role);
+	}
+
+	return section == 0 ? QString("级别") : QString("信息");
 }
 
-void OutputModel::addLog(QString msg, LogType t)
+void OutputModel::drainLogs()
 {
-	QString level;
-	QColor color;
-	switch (t)
+	auto queue = LogQueue::instance();
+	std::vector<LogQueue::Entry> batch;
+	LogQueue::Entry entry;
+	while (queue->pop(entry))
 	{
-	case LogType::Info:
-		level = "Info";
-		color = Qt::white;
-		break;
-	case LogType::Warning:
-		level = "Warning";
-		color = Qt::yellow;
-		break;
-	case LogType::Error:
-		level = "Error";
-		color = Qt::red;
-		break;
+		batch.push_back(std::move(entry));
 	}
 
-	auto item1 = new QStandardItem(level);
-	item1->setBackground(color);
-	auto item2 = new QStandardItem(msg);
-	item2->setBackground(color);
+	auto dropped = queue->takeDropped();
+	if (dropped)
+	{
+		batch.push_back({QString("输出太快,丢弃了 %1 条日志").arg(dropped), LogType::Warning});
+	}
+
+	if (batch.empty())
+	{
+		return;
+	}
+
+	//一帧内的日志超过上限时只保留最后的部分
+	auto skip = batch.size() > (std::size_t)maxRows ? batch.size() - maxRows : 0;
+	auto count = (int)(batch.size() - skip);
+	auto removeCount = std::min((int)m_entries.size(), (int)m_entries.size() + count - maxRows);
+	if (removeCount > 0)
+	{
+		beginRemoveRows(QModelIndex(), 0, removeCount - 1);
+		m_entries.erase(m_entries.begin(), m_entries.begin() + removeCount);
+		endRemoveRows();
+	}
 
-	appendRow(QList<QStandardItem*>() << item1 << item2);
+	beginInsertRows(QModelIndex(), (int)m_entries.size(), (int)m_entries.size() + count - 1);
+	std::move(batch.begin() + skip, batch.end(), std::back_inserter(m_entries));
+	endInsertRows();
 }
 
 OutputView::OutputView(QWidget *parent)
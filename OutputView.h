@@ -7,15 +7,32 @@
 #include "Common.h"
 
 #include <QTableView>
-#include <QStandardItemModel>
+#include <QAbstractTableModel>
 
-class OutputModel : public QStandardItemModel
+#include <deque>
+
+#include "LogQueue.h"
+
+//按固定的帧率从LogQueue批量读取日志,每帧最多插入一次行
+class OutputModel : public QAbstractTableModel
 {
 	Q_OBJECT
 public:
 	OutputModel(QObject* parent);
-public slots:
-	void addLog(QString msg, LogType t);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+	//超过时删除最早的日志
+	static const int maxRows = 100000;
+
+private slots:
+	void drainLogs();
+
+private:
+	std::deque<LogQueue::Entry> m_entries;
 };
 
 class OutputView : public QTableView
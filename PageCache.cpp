@@ -0,0 +1,157 @@
+#include "PageCache.h"
+#include "TargetBackend.h"
+
+#include <cstring>
+#include <algorithm>
+
+//超过这个数量就清空,避免内存视图来回滚动时缓存无限增长
+static const std::size_t maxCachedPages = 4096;
+
+PageCache::PageCache(TargetBackend* backend)
+	: m_backend(backend)
+{
+}
+
+void PageCache::setEnabled(bool enabled)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_enabled = enabled;
+	m_pages.clear();
+	m_regionsLoaded = false;
+	m_writable.clear();
+}
+
+void PageCache::invalidate()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	m_pages.clear();
+}
+
+void PageCache::invalidate(uint64_t address, uint64_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto first = address / pageSize;
+	auto last = (address + size - 1) / pageSize;
+	for (auto page = first; page <= last; ++page)
+	{
+		m_pages.erase(page);
+	}
+}
+
+bool PageCache::read(uint64_t address, void* buffer, uint64_t size)
+{
+	if (size == 0)
+	{
+		return true;
+	}
+
+	auto first = address / pageSize;
+	auto last = (address + size - 1) / pageSize;
+
+	std::unique_lock<std::mutex> lock(m_mtx);
+	//调试目标运行中或者一次读取的范围太大时直接读取
+	if (!m_enabled || last - first + 1 > maxCachedPages / 4 || isWritable(address, size))
+	{
+		lock.unlock();
+		return m_backend->readMemory(address, buffer, size);
+	}
+
+	if (m_pages.size() + (last - first + 1) > maxCachedPages)
+	{
+		m_pages.clear();
+	}
+
+	//把连续的未缓存页合并成一次读取
+	for (auto page = first; page <= last;)
+	{
+		if (m_pages.count(page))
+		{
+			++page;
+			continue;
+		}
+
+		auto runEnd = page + 1;
+		while (runEnd <= last && !m_pages.count(runEnd))
+		{
+			++runEnd;
+		}
+
+		fetch(page, runEnd - page);
+		page = runEnd;
+	}
+
+	auto out = (uint8_t*)buffer;
+	for (auto page = first; page <= last; ++page)
+	{
+		auto const& data = m_pages[page];
+		if (data.empty())
+		{
+			return false;
+		}
+
+		auto pageStart = page * pageSize;
+		auto begin = std::max(address, pageStart);
+		auto end = std::min(address + size, pageStart + pageSize);
+		std::memcpy(out + (begin - address), data.data() + (begin - pageStart), end - begin);
+	}
+
+	return true;
+}
+
+bool PageCache::isWritable(uint64_t address, uint64_t size)
+{
+	if (m_backend->stopsAllThreads())
+	{
+		return false;
+	}
+
+	//每次启用只读取一次内存映射,其他线程这期间新映射的内存按不可写处理,直到下次停止
+	if (!m_regionsLoaded)
+	{
+		for (auto const& region : m_backend->getMemoryMap())
+		{
+			if (region.protection & ProtWrite)
+			{
+				m_writable.push_back(region);
+			}
+		}
+		m_regionsLoaded = true;
+	}
+
+	auto it = std::upper_bound(m_writable.begin(), m_writable.end(), address,
+		[](uint64_t addr, MemoryRegion const& region) { return addr < region.start + region.size; });
+	return it != m_writable.end() && it->start < address + size;
+}
+
+bool PageCache::fetch(uint64_t firstPage, uint64_t count)
+{
+	std::vector<uint8_t> buf(count * pageSize);
+	if (m_backend->readMemory(firstPage * pageSize, buf.data(), buf.size()))
+	{
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			m_pages[firstPage + i].assign(buf.begin() + i * pageSize, buf.begin() + (i + 1) * pageSize);
+		}
+		return true;
+	}
+
+	if (count == 1)
+	{
+		//不可读的页也缓存下来,避免每次重绘都去读取
+		m_pages[firstPage].clear();
+		return false;
+	}
+
+	//整体读取失败说明中间有不可读的页,逐页读取
+	bool ok = true;
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		ok = fetch(firstPage + i, 1) && ok;
+	}
+	return ok;
+}
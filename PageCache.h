@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class TargetBackend;
+
+//调试目标内存的页缓存,只在调试目标停止时有效
+//缓存的是原始内存(包含0xCC),断点的屏蔽由DebugCore处理
+//后端不停止所有线程时(Linux),其他线程还在修改可写的内存,只缓存不可写的页,可写的页直接读取
+class PageCache
+{
+public:
+	static const uint64_t pageSize = 4096;
+
+	explicit PageCache(TargetBackend* backend);
+
+	bool read(uint64_t address, void* buffer, uint64_t size);
+
+	//调试目标停止时启用,继续运行前禁用,启用和禁用都会清空缓存
+	void setEnabled(bool enabled);
+	void invalidate();
+	void invalidate(uint64_t address, uint64_t size);
+
+private:
+	bool fetch(uint64_t firstPage, uint64_t count);
+	bool isWritable(uint64_t address, uint64_t size);
+
+	TargetBackend* m_backend;
+
+	std::mutex m_mtx;
+	bool m_enabled = false;
+	//页号 -> 页数据,空表示该页不可读
+	std::unordered_map<uint64_t, std::vector<uint8_t>> m_pages;
+	//启用后第一次读取时加载的可写内存区域,按地址排序
+	bool m_regionsLoaded = false;
+	std::vector<MemoryRegion> m_writable;
+};
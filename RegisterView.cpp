@@ -7,6 +7,8 @@
 #include "DebugCore.h"
 #include <QtWidgets>
 
+#include <cstring>
+
 class ValueDlg : public QDialog
 {
 public:
@@ -29,7 +31,7 @@ public:
 				return;
 			}
 
-			ok = debugCore->setRegisterState(debugCore->excInfo().threadPort, type, value);
+			ok = debugCore->setRegisterState(debugCore->excInfo().threadId, type, value);
 			if (!ok)
 			{
 				QMessageBox::warning(this, "错误", "设置寄存器值失败");
@@ -76,6 +78,64 @@ RegisterView::RegisterView(QWidget *parent)
 	m_cs = new QTreeWidgetItem(regGroup, QStringList() << "CS");
 	m_fs = new QTreeWidgetItem(regGroup, QStringList() << "FS");
 	m_gs = new QTreeWidgetItem(regGroup, QStringList() << "GS");
+
+	//硬件断点由断点窗口管理,这里只显示
+	regGroup = new QTreeWidgetItem(this, QStringList() << "调试寄存器");
+	for (int i = 0; i < 4; ++i)
+	{
+		m_dr[i] = new QTreeWidgetItem(regGroup, QStringList() << QString("DR%1").arg(i));
+	}
+	m_dr6 = new QTreeWidgetItem(regGroup, QStringList() << "DR6");
+	m_dr7 = new QTreeWidgetItem(regGroup, QStringList() << "DR7");
+
+	//x87和向量寄存器默认折叠,展开时才从调试目标读取
+	m_x87Group = new QTreeWidgetItem(this, QStringList() << "x87/SSE状态");
+	for (int i = 0; i < 8; ++i)
+	{
+		m_st[i] = new QTreeWidgetItem(m_x87Group, QStringList() << QString("ST%1").arg(i));
+	}
+	m_fcw = new QTreeWidgetItem(m_x87Group, QStringList() << "FCW");
+	m_fsw = new QTreeWidgetItem(m_x87Group, QStringList() << "FSW");
+	m_ftw = new QTreeWidgetItem(m_x87Group, QStringList() << "FTW");
+	m_mxcsr = new QTreeWidgetItem(m_x87Group, QStringList() << "MXCSR");
+
+	m_vectorGroup = new QTreeWidgetItem(this, QStringList() << "向量寄存器");
+	for (int i = 0; i < 32; ++i)
+	{
+		m_vector[i] = new QTreeWidgetItem(m_vectorGroup, QStringList() << QString("XMM%1").arg(i));
+	}
+	for (int i = 0; i < 8; ++i)
+	{
+		m_k[i] = new QTreeWidgetItem(m_vectorGroup, QStringList() << QString("K%1").arg(i));
+	}
+	connect(this, &QTreeWidget::itemExpanded, [this](QTreeWidgetItem* item)
+	{
+		if (item == m_x87Group || item == m_vectorGroup)
+		{
+			updateVectorContent();
+		}
+	});
+
+	m_menu = new QMenu(this);
+	auto formatMenu = m_menu->addMenu("向量寄存器格式");
+	auto formatGroup = new QActionGroup(this);
+	static const char* const formatNames[] =
+	{
+		"8位十六进制", "16位十六进制", "32位十六进制", "64位十六进制",
+		"32位有符号整数", "64位有符号整数", "单精度浮点数", "双精度浮点数",
+	};
+	for (int i = 0; i < 8; ++i)
+	{
+		auto action = formatMenu->addAction(formatNames[i], [this, i]
+		{
+			m_vectorFormat = (VectorFormat)i;
+			updateVectorContent();
+		});
+		action->setCheckable(true);
+		action->setChecked(i == (int)m_vectorFormat);
+		formatGroup->addAction(action);
+	}
+
 	connect(EventDispatcher::instance(), &EventDispatcher::setDebugCore, this, &RegisterView::setDebugCore);
 	connect(EventDispatcher::instance(), &EventDispatcher::debugEvent, this, &RegisterView::updateContent);
 }
@@ -92,31 +152,133 @@ void RegisterView::updateContent()
 		return;
 	}
 
-	auto reg = debugCore->getAllRegisterState(debugCore->excInfo().threadPort);
-	m_rax->setText(1, QString::number(reg.threadState.__rax, 16));
-	m_rbx->setText(1, QString::number(reg.threadState.__rbx, 16));
-	m_rcx->setText(1, QString::number(reg.threadState.__rcx, 16));
-	m_rdx->setText(1, QString::number(reg.threadState.__rdx, 16));
-	m_rdi->setText(1, QString::number(reg.threadState.__rdi, 16));
-	m_rsi->setText(1, QString::number(reg.threadState.__rsi, 16));
-	m_rbp->setText(1, QString::number(reg.threadState.__rbp, 16));
-	m_rsp->setText(1, QString::number(reg.threadState.__rsp, 16));
-	m_r8->setText(1, QString::number(reg.threadState.__r8, 16));
-	m_r9->setText(1, QString::number(reg.threadState.__r9, 16));
-	m_r10->setText(1, QString::number(reg.threadState.__r10, 16));
-	m_r11->setText(1, QString::number(reg.threadState.__r11, 16));
-	m_r12->setText(1, QString::number(reg.threadState.__r12, 16));
-	m_r13->setText(1, QString::number(reg.threadState.__r13, 16));
-	m_r14->setText(1, QString::number(reg.threadState.__r14, 16));
-	m_r15->setText(1, QString::number(reg.threadState.__r15, 16));
-
-	m_rip->setText(1, QString::number(reg.threadState.__rip, 16));
-
-	m_rflags->setText(1, QString::number(reg.threadState.__rflags, 16));
-
-	m_cs->setText(1, QString::number(reg.threadState.__cs, 16));
-	m_fs->setText(1, QString::number(reg.threadState.__fs, 16));
-	m_gs->setText(1, QString::number(reg.threadState.__gs, 16));
+	auto reg = debugCore->getAllRegisterState(debugCore->excInfo().threadId);
+	m_rax->setText(1, QString::number(reg.threadState.rax, 16));
+	m_rbx->setText(1, QString::number(reg.threadState.rbx, 16));
+	m_rcx->setText(1, QString::number(reg.threadState.rcx, 16));
+	m_rdx->setText(1, QString::number(reg.threadState.rdx, 16));
+	m_rdi->setText(1, QString::number(reg.threadState.rdi, 16));
+	m_rsi->setText(1, QString::number(reg.threadState.rsi, 16));
+	m_rbp->setText(1, QString::number(reg.threadState.rbp, 16));
+	m_rsp->setText(1, QString::number(reg.threadState.rsp, 16));
+	m_r8->setText(1, QString::number(reg.threadState.r8, 16));
+	m_r9->setText(1, QString::number(reg.threadState.r9, 16));
+	m_r10->setText(1, QString::number(reg.threadState.r10, 16));
+	m_r11->setText(1, QString::number(reg.threadState.r11, 16));
+	m_r12->setText(1, QString::number(reg.threadState.r12, 16));
+	m_r13->setText(1, QString::number(reg.threadState.r13, 16));
+	m_r14->setText(1, QString::number(reg.threadState.r14, 16));
+	m_r15->setText(1, QString::number(reg.threadState.r15, 16));
+
+	m_rip->setText(1, QString::number(reg.threadState.rip, 16));
+
+	m_rflags->setText(1, QString::number(reg.threadState.rflags, 16));
+
+	m_cs->setText(1, QString::number(reg.threadState.cs, 16));
+	m_fs->setText(1, QString::number(reg.threadState.fs, 16));
+	m_gs->setText(1, QString::number(reg.threadState.gs, 16));
+
+	for (int i = 0; i < 4; ++i)
+	{
+		m_dr[i]->setText(1, QString::number(reg.debugState.dr[i], 16));
+	}
+	m_dr6->setText(1, QString::number(reg.debugState.dr6, 16));
+	m_dr7->setText(1, QString::number(reg.debugState.dr7, 16));
+
+	updateVectorContent();
+}
+
+void RegisterView::updateVectorContent()
+{
+	if (!m_x87Group->isExpanded() && !m_vectorGroup->isExpanded())
+	{
+		return;
+	}
+
+	//调试目标运行时不能读取
+	auto debugCore = m_debugCore.lock();
+	VectorState state;
+	if (!debugCore || !debugCore->getVectorState(debugCore->excInfo().threadId, state))
+	{
+		for (auto group : {m_x87Group, m_vectorGroup})
+		{
+			for (int i = 0; i < group->childCount(); ++i)
+			{
+				group->child(i)->setText(1, QString());
+			}
+		}
+		return;
+	}
+
+	//st中是80位扩展精度数,和x86上的long double相同
+	for (int i = 0; i < 8; ++i)
+	{
+		long double value = 0;
+		std::memcpy(&value, state.st[i], 10);
+		m_st[i]->setText(1, QString::number((double)value, 'g', 17));
+	}
+	m_fcw->setText(1, QString::number(state.fcw, 16));
+	m_fsw->setText(1, QString::number(state.fsw, 16));
+	m_ftw->setText(1, QString::number(state.ftw, 16));
+	m_mxcsr->setText(1, QString::number(state.mxcsr, 16));
+
+	auto prefix = state.vectorSize == 64 ? "ZMM" : state.vectorSize == 32 ? "YMM" : "XMM";
+	for (int i = 0; i < 32; ++i)
+	{
+		m_vector[i]->setHidden(i >= state.vectorCount);
+		m_vector[i]->setText(0, QString("%1%2").arg(prefix).arg(i));
+		m_vector[i]->setText(1, formatVector(state.zmm[i], state.vectorSize));
+	}
+	for (int i = 0; i < 8; ++i)
+	{
+		m_k[i]->setHidden(state.vectorSize < 64);
+		m_k[i]->setText(1, QString::number(state.k[i], 16));
+	}
+}
+
+QString RegisterView::formatVector(uint8_t const* data, int size) const
+{
+	static const int elementSizes[] = { 1, 2, 4, 8, 4, 8, 4, 8 };
+	auto elementSize = elementSizes[(int)m_vectorFormat];
+	QStringList elements;
+	for (int offset = size - elementSize; offset >= 0; offset -= elementSize)
+	{
+		uint64_t bits = 0;
+		std::memcpy(&bits, data + offset, elementSize);
+		switch (m_vectorFormat)
+		{
+		case VectorFormat::Int32:
+			elements << QString::number((int32_t)bits);
+			break;
+		case VectorFormat::Int64:
+			elements << QString::number((qlonglong)bits);
+			break;
+		case VectorFormat::Float:
+		{
+			float value;
+			std::memcpy(&value, &bits, sizeof(value));
+			elements << QString::number(value, 'g', 9);
+			break;
+		}
+		case VectorFormat::Double:
+		{
+			double value;
+			std::memcpy(&value, &bits, sizeof(value));
+			elements << QString::number(value, 'g', 17);
+			break;
+		}
+		default:
+			elements << QString("%1").arg(bits, elementSize * 2, 16, QChar('0'));
+			break;
+		}
+	}
+	return elements.join(' ');
+}
+
+void RegisterView::contextMenuEvent(QContextMenuEvent *event)
+{
+	m_menu->exec(event->globalPos());
+	QTreeWidget::contextMenuEvent(event);
 }
 void RegisterView::mouseDoubleClickEvent(QMouseEvent *event)
 {
@@ -236,6 +398,10 @@ void RegisterView::mouseDoubleClickEvent(QMouseEvent *event)
 		type = RegisterType::GS;
 		text = m_gs->text(1);
 	}
+	else
+	{
+		return;
+	}
 
 	ValueDlg dlg(text, debugCore, type, this);
 	if (dlg.exec() == QDialog::Accepted)
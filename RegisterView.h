@@ -3,16 +3,19 @@
 //
 
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <QTreeWidget>
 
 class DebugCore;
+class QMenu;
 
 class RegisterView : public QTreeWidget
 {
 	Q_OBJECT
 protected:
 	virtual void mouseDoubleClickEvent(QMouseEvent *event) override;
+	virtual void contextMenuEvent(QContextMenuEvent *event) override;
 private:
 public:
 	RegisterView(QWidget* parent);
@@ -22,6 +25,24 @@ public slots:
 	void updateContent();
 
 private:
+	//向量寄存器中元素的显示格式
+	enum class VectorFormat
+	{
+		Hex8,
+		Hex16,
+		Hex32,
+		Hex64,
+		Int32,
+		Int64,
+		Float,
+		Double,
+	};
+
+	//x87和向量寄存器只在展开时读取,普通的停止不需要读取
+	void updateVectorContent();
+	//按m_vectorFormat显示,元素从高到低排列
+	QString formatVector(uint8_t const* data, int size) const;
+
 	std::weak_ptr<DebugCore> m_debugCore;
 
 	QTreeWidgetItem* m_rax;
@@ -48,4 +69,22 @@ private:
 	QTreeWidgetItem* m_cs;
 	QTreeWidgetItem* m_fs;
 	QTreeWidgetItem* m_gs;
+
+	QTreeWidgetItem* m_dr[4];
+	QTreeWidgetItem* m_dr6;
+	QTreeWidgetItem* m_dr7;
+
+	QTreeWidgetItem* m_x87Group;
+	QTreeWidgetItem* m_st[8];
+	QTreeWidgetItem* m_fcw;
+	QTreeWidgetItem* m_fsw;
+	QTreeWidgetItem* m_ftw;
+	QTreeWidgetItem* m_mxcsr;
+
+	QTreeWidgetItem* m_vectorGroup;
+	QTreeWidgetItem* m_vector[32];
+	QTreeWidgetItem* m_k[8];
+	VectorFormat m_vectorFormat = VectorFormat::Hex32;
+
+	QMenu* m_menu;
 };
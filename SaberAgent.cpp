@@ -0,0 +1,332 @@
+//注入到调试目标中的agent,由调试器通过LD_PRELOAD(macOS下DYLD_INSERT_LIBRARIES)加载,不依赖Qt
+//在被hook的地址写入jmp rel32跳到跳板,跳板在共享内存中写入命中记录后执行被覆盖的指令,再跳回原来的位置
+//命中时不产生调试异常,调试器在需要时读取共享内存中的记录
+
+#include "AgentProtocol.h"
+#include "InsnRelocator.h"
+#include "libasmx64.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_vm.h>
+#endif
+
+static const int patchSize = agentPatchSize;
+static const int trampolineSize = 256;
+//跳板所在的内存块,每块按trampolineSize分为多个跳板
+static const uint64_t chunkSize = 0x10000;
+//jmp rel32能跳到的范围,留出一个内存块的余量
+static const int64_t nearRange = 0x7fff0000 - (int64_t)chunkSize;
+
+static_assert(agentRecordCount == 0x10000, "跳板中用movzx edx, dx计算记录的下标");
+
+struct Chunk
+{
+	uint64_t address;
+	uint64_t used;
+};
+
+struct LocalHook
+{
+	bool installed;
+	uint64_t address;
+	uint8_t original[patchSize];
+};
+
+static AgentShared* g_shared = nullptr;
+//以下只在控制线程中访问
+static LocalHook g_hooks[agentMaxHooks];
+static std::vector<Chunk> g_chunks;
+
+static bool isNear(uint64_t from, uint64_t to)
+{
+	auto distance = (int64_t)(to - from);
+	return distance > -nearRange && distance < nearRange;
+}
+
+//在address的jmp rel32范围内分配一个跳板
+//跳板所在的内存一直是可读可写可执行的,其他线程可能正在执行同一块中的其他跳板
+static uint64_t allocateTrampoline(uint64_t address)
+{
+	for (auto& chunk : g_chunks)
+	{
+		if (chunk.used + trampolineSize <= chunkSize && isNear(address, chunk.address))
+		{
+			auto trampoline = chunk.address + chunk.used;
+			chunk.used += trampolineSize;
+			return trampoline;
+		}
+	}
+
+	//从address附近向两边尝试,不使用MAP_FIXED,hint处已被占用时内核会返回其他地址
+	static const uint64_t step = 0x100000;
+	auto base = address & ~(chunkSize - 1);
+	for (uint64_t distance = step; distance < (uint64_t)nearRange; distance += step)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			if (i == 0 && base < distance + 0x10000)
+			{
+				continue;
+			}
+			auto hint = i == 0 ? base - distance : base + distance;
+			auto p = mmap((void*)hint, chunkSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED)
+			{
+				continue;
+			}
+			if (!isNear(address, (uint64_t)p))
+			{
+				munmap(p, chunkSize);
+				continue;
+			}
+			g_chunks.emplace_back(Chunk{(uint64_t)p, trampolineSize});
+			return (uint64_t)p;
+		}
+	}
+	return 0;
+}
+
+//跳板开头记录命中的代码,只使用rax/rcx/rdx并在栈上保存,不调用任何函数
+//先跳过red zone,address不是函数入口时也不会破坏栈上的数据
+//pushfq/popfq很慢,只有lock inc和lock xadd修改标志,前后用lahf/seto和sahf保存恢复
+static int writeRecordStub(uint8_t* code, uint64_t address, std::atomic<uint64_t>* hits)
+{
+	auto p = code;
+	auto emit = [&p](std::initializer_list<uint8_t> bytes)
+	{
+		for (auto b : bytes)
+		{
+			*p++ = b;
+		}
+	};
+	auto emit32 = [&p](uint32_t value)
+	{
+		std::memcpy(p, &value, sizeof(value));
+		p += sizeof(value);
+	};
+	auto emit64 = [&p](uint64_t value)
+	{
+		std::memcpy(p, &value, sizeof(value));
+		p += sizeof(value);
+	};
+
+	emit({0x48, 0x8d, 0x64, 0x24, 0x80});				//lea rsp, [rsp-128]
+	emit({0x50, 0x51, 0x52});							//push rax; push rcx; push rdx
+	emit({0x9f, 0x0f, 0x90, 0xc0});					//lahf; seto al
+	emit({0x48, 0xb9});									//mov rcx, hits
+	emit64((uint64_t)hits);
+	emit({0xf0, 0x48, 0xff, 0x01});						//lock inc qword [rcx]
+	emit({0x48, 0xb9});									//mov rcx, g_shared
+	emit64((uint64_t)g_shared);
+	emit({0xba, 1, 0, 0, 0});							//mov edx, 1
+	emit({0xf0, 0x48, 0x0f, 0xc1, 0x11});				//lock xadd [rcx], rdx
+	emit({0x04, 0x7f, 0x9e});							//add al, 0x7f; sahf
+	emit({0x48, 0x8d, 0x42, 0x01});						//lea rax, [rdx+1]
+	emit({0x0f, 0xb7, 0xd2});							//movzx edx, dx
+	emit({0x48, 0x8d, 0x14, 0x95});						//lea rdx, [rdx*4]
+	emit32(0);
+	emit({0x48, 0x8d, 0x94, 0xd1});						//lea rdx, [rcx+rdx*8+records]
+	emit32(offsetof(AgentShared, records));
+	emit({0x48, 0xb9});									//mov rcx, address
+	emit64(address);
+	emit({0x48, 0x89, 0x4a, 0x08});						//mov [rdx+8], rcx
+	emit({0x48, 0x8b, 0x8c, 0x24});						//mov rcx, [rsp+152]
+	emit32(128 + 24);
+	emit({0x48, 0x89, 0x4a, 0x10});						//mov [rdx+16], rcx
+#ifdef __APPLE__
+	emit({0x65, 0x48, 0x8b, 0x0c, 0x25});				//mov rcx, gs:[0]
+#else
+	emit({0x64, 0x48, 0x8b, 0x0c, 0x25});				//mov rcx, fs:[0]
+#endif
+	emit32(0);
+	emit({0x48, 0x89, 0x4a, 0x18});						//mov [rdx+24], rcx
+	emit({0x48, 0x89, 0x02});							//mov [rdx], rax,最后写入序号
+	emit({0x5a, 0x59, 0x58});							//pop rdx; pop rcx; pop rax
+	emit({0x48, 0x8d, 0xa4, 0x24});						//lea rsp, [rsp+128]
+	emit32(128);
+	return (int)(p - code);
+}
+
+//修改代码,代码页原来是只读可执行的,写入后恢复
+static bool writeCode(uint64_t address, const void* data, int size)
+{
+	auto pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+	auto start = address & ~(pageSize - 1);
+	auto end = (address + size + pageSize - 1) & ~(pageSize - 1);
+#ifdef __APPLE__
+	if (mach_vm_protect(mach_task_self(), start, end - start, FALSE,
+			VM_PROT_READ | VM_PROT_WRITE | VM_PROT_EXECUTE | VM_PROT_COPY) != KERN_SUCCESS)
+#else
+	if (mprotect((void*)start, end - start, PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+#endif
+	{
+		return false;
+	}
+
+	//在对齐的8字节内时一次写入,其他线程不会执行到只写了一半的jmp
+	if ((address & 7) + size <= 8)
+	{
+		auto word = (uint64_t*)(address & ~(uint64_t)7);
+		auto value = __atomic_load_n(word, __ATOMIC_RELAXED);
+		std::memcpy((uint8_t*)&value + (address & 7), data, size);
+		__atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+	}
+	else
+	{
+		std::memcpy((void*)address, data, size);
+	}
+
+#ifdef __APPLE__
+	mach_vm_protect(mach_task_self(), start, end - start, FALSE, VM_PROT_READ | VM_PROT_EXECUTE);
+#else
+	mprotect((void*)start, end - start, PROT_READ | PROT_EXEC);
+#endif
+	return true;
+}
+
+//跳到address的指令不能在被覆盖的5字节中间,这里没有检查
+static bool installHook(LocalHook& hook, uint64_t address, std::atomic<uint64_t>* hits, uint64_t& trampoline)
+{
+	for (auto const& other : g_hooks)
+	{
+		if (other.installed && (other.address - address < patchSize || address - other.address < patchSize))
+		{
+			return false;
+		}
+	}
+
+	trampoline = allocateTrampoline(address);
+	if (!trampoline)
+	{
+		return false;
+	}
+
+	//搬移被覆盖的指令,不能在覆盖完之前遇到无条件跳转或ret
+	uint8_t code[trampolineSize];
+	auto len = writeRecordStub(code, address, hits);
+	auto original = (uint8_t const*)address;
+	int covered = 0;
+	bool fallsThrough = true;
+	while (covered < patchSize)
+	{
+		x86dis_insn insn;
+		Relocation relocation;
+		if (!fallsThrough || len + InsnRelocator::maxSize + InsnRelocator::jumpSize > trampolineSize
+			|| !x64dis::decode(original + covered, 15, address + covered, insn)
+			|| !InsnRelocator::relocate(insn, original + covered, address + covered, trampoline + len,
+				code + len, relocation))
+		{
+			return false;
+		}
+		len += relocation.size;
+		covered += insn.size;
+		fallsThrough = relocation.fallsThrough;
+	}
+	if (fallsThrough)
+	{
+		len += InsnRelocator::writeJump(code + len, address + covered);
+	}
+	std::memcpy((void*)trampoline, code, len);
+
+	uint8_t jmp[patchSize] = {0xe9};
+	auto rel = (int32_t)(trampoline - (address + patchSize));
+	std::memcpy(jmp + 1, &rel, sizeof(rel));
+	std::memcpy(hook.original, original, patchSize);
+	if (!writeCode(address, jmp, patchSize))
+	{
+		return false;
+	}
+	hook.installed = true;
+	hook.address = address;
+	//跳板不释放,移除后其他线程可能还在跳板中执行
+	return true;
+}
+
+static void processHook(int index)
+{
+	auto& shared = g_shared->hooks[index];
+	auto& local = g_hooks[index];
+	auto state = (AgentHookState)shared.state.load(std::memory_order_acquire);
+	if (state == AgentHookState::Install)
+	{
+		uint64_t trampoline = 0;
+		bool installed = installHook(local, shared.address, &shared.hits, trampoline);
+		shared.trampoline = installed ? trampoline : 0;
+		//调试器可能已经改为Remove,下次轮询时移除
+		auto expected = (uint32_t)AgentHookState::Install;
+		shared.state.compare_exchange_strong(expected,
+			(uint32_t)(installed ? AgentHookState::Installed : AgentHookState::Failed), std::memory_order_release);
+	}
+	else if (state == AgentHookState::Remove)
+	{
+		if (local.installed && writeCode(local.address, local.original, patchSize))
+		{
+			local.installed = false;
+		}
+		shared.state.store((uint32_t)AgentHookState::Free, std::memory_order_release);
+	}
+}
+
+//轮询调试器的请求
+static void* controlThread(void*)
+{
+	timespec interval{0, 1000000};
+	for (;;)
+	{
+		for (int i = 0; i < agentMaxHooks; ++i)
+		{
+			processHook(i);
+		}
+		nanosleep(&interval, nullptr);
+	}
+	return nullptr;
+}
+
+__attribute__((constructor)) static void startAgent()
+{
+	auto name = getenv(SABER_AGENT_SHM_ENV);
+	if (!name)
+	{
+		return;
+	}
+	int fd = shm_open(name, O_RDWR, 0);
+	//调试目标启动的子进程不使用同一个共享内存
+	unsetenv(SABER_AGENT_SHM_ENV);
+	if (fd < 0)
+	{
+		return;
+	}
+	auto shared = mmap(nullptr, sizeof(AgentShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shared == MAP_FAILED)
+	{
+		return;
+	}
+	g_shared = (AgentShared*)shared;
+	if (g_shared->magic != agentMagic)
+	{
+		munmap(shared, sizeof(AgentShared));
+		g_shared = nullptr;
+		return;
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, controlThread, nullptr) != 0)
+	{
+		return;
+	}
+	pthread_detach(thread);
+	g_shared->agentPid.store((uint32_t)getpid(), std::memory_order_release);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Common.h"
+
+#include <memory>
+#include <vector>
+
+#include <sys/types.h>
+
+//异常回调,只保存对象指针和调用函数,不拥有对象
+//和std::function不同,设置时不分配内存,调用时没有类型擦除的额外开销
+class ExceptionCallback
+{
+public:
+	ExceptionCallback() = default;
+
+	template <typename T, bool (T::*method)(ExceptionInfo const&)>
+	static ExceptionCallback bind(T* object)
+	{
+		ExceptionCallback callback;
+		callback.m_object = object;
+		callback.m_invoke = [](void* object, ExceptionInfo const& info)
+		{
+			return (static_cast<T*>(object)->*method)(info);
+		};
+		return callback;
+	}
+
+	bool operator()(ExceptionInfo const& info) const { return m_invoke(m_object, info); }
+	explicit operator bool() const { return m_invoke != nullptr; }
+
+private:
+	void* m_object = nullptr;
+	bool (*m_invoke)(void*, ExceptionInfo const&) = nullptr;
+};
+
+//调试目标的平台相关操作, DebugCore只通过该接口访问调试目标
+//macOS下基于mach task/exception port实现, Linux下基于ptrace实现
+class TargetBackend
+{
+public:
+	virtual ~TargetBackend() = default;
+
+	//需要在debugNew()/attach()之前设置
+	virtual void setExceptionCallback(ExceptionCallback callback) = 0;
+
+	virtual bool debugNew(QString const& path, QString const& args) = 0;
+	//以下两个需要在debugNew()之前设置,只对debugNew()启动的进程有效
+	//添加或覆盖调试目标的环境变量
+	virtual void setEnvironment(QString const& name, QString const& value) = 0;
+	//调试目标启动时加载的动态库(LD_PRELOAD/DYLD_INSERT_LIBRARIES),加在已有的设置前面
+	virtual void preloadLibrary(QString const& path) = 0;
+	virtual bool attach(pid_t pid) = 0;
+	virtual bool pause() = 0;
+	virtual void stop() = 0;
+	//在调试线程中执行,接收调试目标的异常并调用回调,直到调试目标退出或者调用stop()
+	virtual bool run() = 0;
+	virtual pid_t pid() const = 0;
+	//异常回调期间调试目标的所有线程是否都停止: Mach下整个task停止,Linux下只有触发异常的线程停止
+	virtual bool stopsAllThreads() const = 0;
+
+	//以下接口读写的都是调试目标的原始内存,不处理断点
+	virtual bool readMemory(uint64_t address, void* buffer, uint64_t size) = 0;
+	virtual bool writeMemory(uint64_t address, const void* buffer, uint64_t size) = 0;
+	//查找包含address或者在address之后的第一个内存区域
+	virtual bool findRegion(uint64_t address, MemoryRegion& region) = 0;
+	virtual std::vector<MemoryRegion> getMemoryMap() = 0;
+	//在调试目标中分配可读可执行的内存,尽量使用hint处的地址,写入通过writeMemory()
+	//只能在异常回调中调用,Linux下需要在停止的线程thread中执行系统调用
+	virtual bool allocateMemory(ThreadId thread, uint64_t hint, uint64_t size, uint64_t& address) = 0;
+
+	virtual bool getThreadState(ThreadId thread, ThreadState& state) = 0;
+	virtual bool setThreadState(ThreadId thread, ThreadState const& state) = 0;
+	//读取x87/SSE/AVX/AVX-512寄存器,只读取CPU支持的部分,Linux下只能在调试线程中调用
+	virtual bool getVectorState(ThreadId thread, VectorState& state) = 0;
+	//在异常回调中调用,让调试目标继续运行
+	//单步由调用者在RFLAGS中设置TF实现,返回值作为异常回调的返回值
+	virtual bool resume(ThreadId thread) = 0;
+
+	//调试寄存器对所有线程(包括之后创建的线程)相同,在各线程继续运行前写入
+	virtual bool getDebugRegisters(ThreadId thread, DebugRegisters& regs) = 0;
+	virtual bool setDebugRegisters(DebugRegisters const& regs) = 0;
+
+	virtual bool getEntryAndDataAddr(uint64_t& entryAddr, uint64_t& dataAddr) = 0;
+};
+
+std::unique_ptr<TargetBackend> createTargetBackend();
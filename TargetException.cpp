@@ -3,9 +3,12 @@
 //
 
 #include "TargetException.h"
+#include "MachTargetBackend.h"
 #include "mach_exc.h"
 #include "global.h"
 
+#include <signal.h>
+
 extern "C" boolean_t mach_exc_server(mach_msg_header_t *InHeadP, mach_msg_header_t *OutHeadP);
 
 extern "C" kern_return_t  catch_mach_exception_raise_state(
@@ -167,12 +170,67 @@ TargetException::onCatchMachExceptionRaise(
     }
 
     ExceptionInfo exceptionInfo;
-    exceptionInfo.threadPort = threadPort;
-    exceptionInfo.taskPort = taskPort;
-    exceptionInfo.exceptionType = excType;
+    exceptionInfo.threadId = threadPort;
+    exceptionInfo.signal = 0;
     for (int i = 0; i < excDataCount; ++i)
     {
-        exceptionInfo.exceptionData.emplace_back(excData[i]);
+        exceptionInfo.addExceptionData(excData[i]);
+    }
+
+    switch (excType)
+    {
+    case EXC_SOFTWARE:
+        if (excDataCount == 2 && excData[0] == EXC_SOFT_SIGNAL)
+        {
+            //调试目标的signal, data[1]为signal的值
+            exceptionInfo.signal = (int)excData[1];
+            exceptionInfo.exceptionType = exceptionInfo.signal == SIGTRAP ? ExceptionType::Exec : ExceptionType::Signal;
+        }
+        else if (excDataCount >= 1 && excData[0] == 1)
+        {
+            //lldb中将这种情况当做breakpoint进行处理的
+            exceptionInfo.exceptionType = ExceptionType::SingleStep;
+        }
+        else
+        {
+            exceptionInfo.exceptionType = ExceptionType::Other;
+        }
+        break;
+    case EXC_BREAKPOINT:
+        //data[0]为EXC_I386_SGL时是单步或硬件断点, EXC_I386_BPT时是int3
+        exceptionInfo.exceptionType = (excDataCount >= 1 && excData[0] == EXC_I386_SGL)
+                                      ? ExceptionType::SingleStep : ExceptionType::Breakpoint;
+        if (exceptionInfo.exceptionType == ExceptionType::SingleStep)
+        {
+            //内核把DR6保存在线程的调试状态中,不会自动清除
+            x86_debug_state64_t debugState;
+            mach_msg_type_number_t count = x86_DEBUG_STATE64_COUNT;
+            if (thread_get_state(threadPort, x86_DEBUG_STATE64, (thread_state_t)&debugState, &count) == KERN_SUCCESS
+                && (debugState.__dr6 & 0xf))
+            {
+                exceptionInfo.exceptionType = ExceptionType::HardwareBreakpoint;
+                exceptionInfo.debugStatus = (debugState.__dr6 & 0xf) | (debugState.__dr6 & dr6SingleStep);
+                debugState.__dr6 = 0;
+                thread_set_state(threadPort, x86_DEBUG_STATE64, (thread_state_t)&debugState, x86_DEBUG_STATE64_COUNT);
+            }
+        }
+        break;
+    case EXC_BAD_ACCESS:
+    case EXC_BAD_INSTRUCTION:
+    case EXC_ARITHMETIC:
+    case EXC_EMULATION:
+    case EXC_SYSCALL:
+    case EXC_MACH_SYSCALL:
+    case EXC_RPC_ALERT:
+    case EXC_CRASH:
+    case EXC_RESOURCE:
+    case EXC_GUARD:
+    case EXC_CORPSE_NOTIFY:
+        exceptionInfo.exceptionType = ExceptionType::Fault;
+        break;
+    default:
+        exceptionInfo.exceptionType = ExceptionType::Other;
+        break;
     }
 
     /* you could just as easily put your code in here, I'm just doing this to
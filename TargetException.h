@@ -4,14 +4,14 @@
 
 #pragma once
 
-#include "Common.h"
+#include "TargetBackend.h"
+
+#include <mach/mach.h>
 
 #include <map>
 #include <thread>
 #include <atomic>
 
-using ExceptionCallback = std::function<bool(ExceptionInfo const&)>;
-
 class TargetException
 {
 public:
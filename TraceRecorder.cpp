@@ -0,0 +1,338 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//块越大,随机读取时需要从块开头解码的记录越多
+static const std::size_t chunkSize = 256 * 1024;
+//一条记录的最大长度: 掩码和每个寄存器最多10字节
+static const std::size_t maxRecordSize = 4 + TraceRecorder::fieldCount * 10;
+static const std::size_t maxMemoryBytes = 64 << 20;
+static const uint64_t segmentSize = 64 << 20;
+static const uint64_t maxSpillSize = 16ull << 30;
+
+static const int ripField = offsetof(ThreadState, rip) / sizeof(uint64_t);
+//掩码的位按寄存器变化的频率排列,大部分指令的掩码只占一个字节
+static const int maskOrder[TraceRecorder::fieldCount - 1] =
+{
+	offsetof(ThreadState, rflags) / sizeof(uint64_t),
+	offsetof(ThreadState, rax) / sizeof(uint64_t),
+	offsetof(ThreadState, rsp) / sizeof(uint64_t),
+	offsetof(ThreadState, rcx) / sizeof(uint64_t),
+	offsetof(ThreadState, rdx) / sizeof(uint64_t),
+	offsetof(ThreadState, rsi) / sizeof(uint64_t),
+	offsetof(ThreadState, rdi) / sizeof(uint64_t),
+	offsetof(ThreadState, rbx) / sizeof(uint64_t),
+	offsetof(ThreadState, rbp) / sizeof(uint64_t),
+	offsetof(ThreadState, r8) / sizeof(uint64_t),
+	offsetof(ThreadState, r9) / sizeof(uint64_t),
+	offsetof(ThreadState, r10) / sizeof(uint64_t),
+	offsetof(ThreadState, r11) / sizeof(uint64_t),
+	offsetof(ThreadState, r12) / sizeof(uint64_t),
+	offsetof(ThreadState, r13) / sizeof(uint64_t),
+	offsetof(ThreadState, r14) / sizeof(uint64_t),
+	offsetof(ThreadState, r15) / sizeof(uint64_t),
+	offsetof(ThreadState, cs) / sizeof(uint64_t),
+	offsetof(ThreadState, fs) / sizeof(uint64_t),
+	offsetof(ThreadState, gs) / sizeof(uint64_t),
+};
+
+static void putVarint(std::vector<uint8_t>& data, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		data.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	data.push_back((uint8_t)value);
+}
+
+static uint64_t getVarint(uint8_t const* data, std::size_t& offset)
+{
+	uint64_t value = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		auto b = data[offset++];
+		value |= (uint64_t)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+		{
+			return value;
+		}
+	}
+}
+
+//差值的绝对值小时编码后也小
+static uint64_t zigzag(uint64_t delta)
+{
+	return (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+}
+
+static uint64_t unzigzag(uint64_t value)
+{
+	return (value >> 1) ^ (0 - (value & 1));
+}
+
+static uint32_t changedFields(uint32_t mask)
+{
+	uint32_t changed = 0;
+	for (int i = 0; i < TraceRecorder::fieldCount - 1; ++i)
+	{
+		if (mask & (1u << i))
+		{
+			changed |= 1u << maskOrder[i];
+		}
+	}
+	return changed;
+}
+
+TraceRecorder::TraceRecorder()
+	: m_prev()
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+	closeSpill();
+}
+
+bool TraceRecorder::reset(std::string const& spillPath)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	closeSpill();
+	m_chunks.clear();
+	m_writing = false;
+	m_count = 0;
+	m_prev = ThreadState();
+	m_memoryBytes = 0;
+	m_firstInMemory = 0;
+	m_cursorValid = false;
+
+	if (spillPath.empty())
+	{
+		return true;
+	}
+
+	m_spillFd = open(spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (m_spillFd < 0)
+	{
+		return false;
+	}
+	//文件只通过已打开的描述符使用,退出时自动删除
+	unlink(spillPath.c_str());
+	return true;
+}
+
+void TraceRecorder::record(ThreadState const& state)
+{
+	uint64_t cur[fieldCount];
+	uint64_t prev[fieldCount];
+	std::memcpy(cur, &state, sizeof(cur));
+
+	std::lock_guard<std::mutex> lock(m_mtx);
+	std::memcpy(prev, &m_prev, sizeof(prev));
+	bool keyframe = !m_writing;
+	if (keyframe)
+	{
+		Chunk chunk{m_count, 0, {}, nullptr, 0};
+		chunk.data.reserve(chunkSize + maxRecordSize);
+		m_chunks.push_back(std::move(chunk));
+		m_writing = true;
+	}
+
+	auto& chunk = m_chunks.back();
+	uint32_t mask = 0;
+	for (int i = 0; i < fieldCount - 1; ++i)
+	{
+		if (cur[maskOrder[i]] != prev[maskOrder[i]])
+		{
+			mask |= 1u << i;
+		}
+	}
+	putVarint(chunk.data, mask);
+
+	//块的第一条记录保存完整的寄存器,使每个块可以单独解码
+	if (keyframe)
+	{
+		auto size = chunk.data.size();
+		chunk.data.resize(size + sizeof(cur));
+		std::memcpy(chunk.data.data() + size, cur, sizeof(cur));
+	}
+	else
+	{
+		putVarint(chunk.data, zigzag(cur[ripField] - prev[ripField]));
+		for (int i = 0; i < fieldCount - 1; ++i)
+		{
+			if (mask & (1u << i))
+			{
+				putVarint(chunk.data, zigzag(cur[maskOrder[i]] - prev[maskOrder[i]]));
+			}
+		}
+	}
+
+	chunk.size = chunk.data.size();
+	++chunk.count;
+	++m_count;
+	m_prev = state;
+	if (chunk.size >= chunkSize)
+	{
+		sealChunk();
+	}
+}
+
+uint64_t TraceRecorder::count()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_count;
+}
+
+uint64_t TraceRecorder::firstIndex()
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	return m_chunks.empty() ? m_count : m_chunks.front().firstIndex;
+}
+
+bool TraceRecorder::read(uint64_t index, Entry& entry)
+{
+	std::lock_guard<std::mutex> lock(m_mtx);
+	auto chunk = findChunk(index);
+	if (!chunk)
+	{
+		return false;
+	}
+
+	auto bytes = chunk->bytes();
+	Cursor c;
+	if (m_cursorValid && m_cursor.chunkFirst == chunk->firstIndex && m_cursor.index <= index)
+	{
+		c = m_cursor;
+	}
+	else
+	{
+		c.chunkFirst = chunk->firstIndex;
+		c.index = chunk->firstIndex;
+		c.offset = 0;
+		c.entry.changed = changedFields((uint32_t)getVarint(bytes, c.offset));
+		std::memcpy(&c.entry.state, bytes + c.offset, sizeof(ThreadState));
+		c.offset += sizeof(ThreadState);
+	}
+
+	uint64_t fields[fieldCount];
+	std::memcpy(fields, &c.entry.state, sizeof(fields));
+	for (; c.index < index; ++c.index)
+	{
+		auto mask = (uint32_t)getVarint(bytes, c.offset);
+		fields[ripField] += unzigzag(getVarint(bytes, c.offset));
+		for (int i = 0; i < fieldCount - 1; ++i)
+		{
+			if (mask & (1u << i))
+			{
+				fields[maskOrder[i]] += unzigzag(getVarint(bytes, c.offset));
+			}
+		}
+		c.entry.changed = changedFields(mask);
+	}
+	std::memcpy(&c.entry.state, fields, sizeof(fields));
+
+	m_cursor = c;
+	m_cursorValid = true;
+	entry = c.entry;
+	return true;
+}
+
+void TraceRecorder::closeSpill()
+{
+	for (auto segment : m_segments)
+	{
+		munmap(segment, segmentSize);
+	}
+	m_segments.clear();
+	if (m_spillFd >= 0)
+	{
+		close(m_spillFd);
+		m_spillFd = -1;
+	}
+	m_spillSize = 0;
+}
+
+void TraceRecorder::sealChunk()
+{
+	m_writing = false;
+	m_memoryBytes += m_chunks.back().data.capacity();
+
+	//从最旧的还在内存中的块开始写入溢出文件
+	while (m_memoryBytes > maxMemoryBytes && m_firstInMemory < m_chunks.size())
+	{
+		auto& chunk = m_chunks[m_firstInMemory];
+		auto bytes = chunk.data.capacity();
+		if (spill(chunk))
+		{
+			++m_firstInMemory;
+		}
+		else
+		{
+			m_chunks.erase(m_chunks.begin() + m_firstInMemory);
+		}
+		m_memoryBytes -= bytes;
+	}
+}
+
+bool TraceRecorder::spill(Chunk& chunk)
+{
+	if (m_spillFd < 0)
+	{
+		return false;
+	}
+
+	//块不跨段,读取时只需要一次映射
+	auto offset = m_spillSize;
+	if (offset / segmentSize != (offset + chunk.size - 1) / segmentSize)
+	{
+		offset = (offset / segmentSize + 1) * segmentSize;
+	}
+	if (offset + chunk.size > maxSpillSize)
+	{
+		return false;
+	}
+
+	auto segment = offset / segmentSize;
+	while (m_segments.size() <= segment)
+	{
+		//映射超过文件末尾的部分是允许的,只是不能访问,读取的都是已经写入的部分
+		auto p = mmap(nullptr, segmentSize, PROT_READ, MAP_SHARED, m_spillFd, m_segments.size() * segmentSize);
+		if (p == MAP_FAILED)
+		{
+			return false;
+		}
+		m_segments.push_back((uint8_t*)p);
+	}
+
+	//用pwrite写入,磁盘已满时返回错误而不是在写映射的内存时收到SIGBUS
+	if (pwrite(m_spillFd, chunk.data.data(), chunk.size, offset) != (ssize_t)chunk.size)
+	{
+		m_spillSize = maxSpillSize;
+		return false;
+	}
+
+	chunk.spilled = m_segments[segment] + (offset - segment * segmentSize);
+	std::vector<uint8_t>().swap(chunk.data);
+	m_spillSize = offset + chunk.size;
+	return true;
+}
+
+TraceRecorder::Chunk const* TraceRecorder::findChunk(uint64_t index) const
+{
+	auto it = std::upper_bound(m_chunks.begin(), m_chunks.end(), index,
+		[](uint64_t index, Chunk const& chunk) { return index < chunk.firstIndex; });
+	if (it == m_chunks.begin())
+	{
+		return nullptr;
+	}
+
+	--it;
+	return index - it->firstIndex < it->count ? &*it : nullptr;
+}
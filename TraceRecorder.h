@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//指令跟踪的记录,每条指令记录执行前的寄存器,只保存和上一条相比变化的部分
+//记录分块存放,块内第一条是完整的寄存器,后面每条是:
+//	varint(变化的寄存器掩码) zigzag varint(rip的差值) 每个变化的寄存器的zigzag varint(差值)
+//内存中的块超过上限后最旧的块写入溢出文件,通过内存映射读取;没有溢出文件或文件已满时丢弃
+//记录和读取可以在不同的线程中进行
+class TraceRecorder
+{
+public:
+	static const int fieldCount = sizeof(ThreadState) / sizeof(uint64_t);
+
+	struct Entry
+	{
+		ThreadState state;
+		//和上一条记录相比变化的寄存器,第i位对应ThreadState的第i个字段
+		uint32_t changed;
+	};
+
+	TraceRecorder();
+	~TraceRecorder();
+
+	//丢弃之前的记录,spillPath为空时不使用溢出文件,溢出文件创建失败时返回false
+	bool reset(std::string const& spillPath);
+	void record(ThreadState const& state);
+
+	//记录过的总数,包括已经丢弃的
+	uint64_t count();
+	//最早的还能读取的记录的序号
+	uint64_t firstIndex();
+	bool read(uint64_t index, Entry& entry);
+
+private:
+	struct Chunk
+	{
+		uint64_t firstIndex;
+		uint64_t count;
+		//在内存中时的数据,写入溢出文件后清空,改用spilled
+		std::vector<uint8_t> data;
+		uint8_t const* spilled;
+		std::size_t size;
+
+		uint8_t const* bytes() const { return spilled ? spilled : data.data(); }
+	};
+
+	void closeSpill();
+	void sealChunk();
+	bool spill(Chunk& chunk);
+	Chunk const* findChunk(uint64_t index) const;
+
+	std::mutex m_mtx;
+	std::deque<Chunk> m_chunks;
+	//正在写入的块在m_chunks的最后
+	bool m_writing = false;
+	uint64_t m_count = 0;
+	ThreadState m_prev;
+	//内存中已写满的块的总大小
+	std::size_t m_memoryBytes = 0;
+	//这之前的块都已写入溢出文件
+	std::size_t m_firstInMemory = 0;
+
+	int m_spillFd = -1;
+	uint64_t m_spillSize = 0;
+	//溢出文件按段映射,每段映射一次
+	std::vector<uint8_t*> m_segments;
+
+	//顺序读取时从上一次读到的位置继续解码
+	struct Cursor
+	{
+		uint64_t chunkFirst;
+		uint64_t index;
+		std::size_t offset;
+		Entry entry;
+	};
+	Cursor m_cursor;
+	bool m_cursorValid = false;
+};
@@ -0,0 +1,171 @@
+#include "TraceView.h"
+#include "DebugCore.h"
+#include "EventDispatcher.h"
+
+#include <QHeaderView>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+//和ThreadState的字段顺序一致
+static const char* const registerNames[TraceRecorder::fieldCount] =
+{
+	"rax", "rbx", "rcx", "rdx", "rdi", "rsi", "rbp", "rsp",
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+	"rip", "rflags", "cs", "fs", "gs",
+};
+
+TraceModel::TraceModel(QObject* parent)
+	: QAbstractTableModel(parent)
+{
+}
+
+int TraceModel::rowCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : m_rows;
+}
+
+int TraceModel::columnCount(const QModelIndex& parent) const
+{
+	return parent.isValid() ? 0 : 4;
+}
+
+QVariant TraceModel::data(const QModelIndex& index, int role) const
+{
+	auto debugCore = m_debugCore.lock();
+	if (role != Qt::DisplayRole || !debugCore || !index.isValid())
+	{
+		return QVariant();
+	}
+
+	auto n = m_first + index.row();
+	if (index.column() == 0)
+	{
+		return QString::number(n);
+	}
+
+	TraceRecorder::Entry entry;
+	if (!debugCore->traceRecorder().read(n, entry))
+	{
+		return QVariant();
+	}
+
+	auto const& state = entry.state;
+	switch (index.column())
+	{
+	case 1:
+		return QString("%1").arg(state.rip, 16, 16, QChar('0')).toUpper();
+	case 2:
+	{
+		//使用当前的内存解码,自修改的代码显示的不是当时执行的指令
+		auto insn = debugCore->decodeInsn(state.rip);
+		return insn ? QString::fromStdString(insn->text) : QString("???");
+	}
+	case 3:
+	{
+		uint64_t fields[TraceRecorder::fieldCount];
+		std::memcpy(fields, &state, sizeof(fields));
+		QStringList changes;
+		for (int i = 0; i < TraceRecorder::fieldCount; ++i)
+		{
+			if (entry.changed & (1u << i))
+			{
+				changes << QString("%1=%2").arg(registerNames[i]).arg(fields[i], 0, 16);
+			}
+		}
+		return changes.join(" ");
+	}
+	default:
+		return QVariant();
+	}
+}
+
+QVariant TraceModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+	if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+	{
+		return QAbstractTableModel::headerData(section, orientation, role);
+	}
+
+	switch (section)
+	{
+	case 0:
+		return "序号";
+	case 1:
+		return "地址";
+	case 2:
+		return "指令";
+	case 3:
+		return "寄存器";
+	default:
+		return QVariant();
+	}
+}
+
+void TraceModel::setDebugCore(std::shared_ptr<DebugCore> debugCore)
+{
+	m_debugCore = debugCore;
+	updateContent();
+}
+
+void TraceModel::updateContent()
+{
+	beginResetModel();
+	auto debugCore = m_debugCore.lock();
+	m_first = 0;
+	m_rows = 0;
+	if (debugCore)
+	{
+		auto& trace = debugCore->traceRecorder();
+		m_first = trace.firstIndex();
+		m_rows = (int)std::min<uint64_t>(trace.count() - m_first, INT_MAX);
+	}
+	endResetModel();
+}
+
+uint64_t TraceModel::address(int row) const
+{
+	auto debugCore = m_debugCore.lock();
+	TraceRecorder::Entry entry;
+	if (!debugCore || !debugCore->traceRecorder().read(m_first + row, entry))
+	{
+		return 0;
+	}
+	return entry.state.rip;
+}
+
+TraceView::TraceView(QWidget* parent)
+	: QTableView(parent)
+	, m_model(new TraceModel(this))
+{
+	setModel(m_model);
+	setSelectionBehavior(QAbstractItemView::SelectRows);
+	setEditTriggers(QAbstractItemView::NoEditTriggers);
+	//行数可能有上百万,固定行高避免计算每一行的高度
+	verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+	verticalHeader()->hide();
+	horizontalHeader()->setStretchLastSection(true);
+
+	connect(this, &TraceView::doubleClicked, [this](const QModelIndex& index)
+	{
+		auto address = m_model->address(index.row());
+		if (address)
+		{
+			emit EventDispatcher::instance()->setDisasmAddress(address);
+		}
+	});
+	connect(EventDispatcher::instance(), &EventDispatcher::setDebugCore, this, &TraceView::setDebugCore);
+	connect(EventDispatcher::instance(), &EventDispatcher::traceChanged, this, &TraceView::updateContent);
+}
+
+void TraceView::setDebugCore(std::shared_ptr<DebugCore> debugCore)
+{
+	m_model->setDebugCore(debugCore);
+}
+
+void TraceView::updateContent()
+{
+	m_model->updateContent();
+	scrollToBottom();
+}
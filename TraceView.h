@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QTableView>
+
+#include <memory>
+
+class DebugCore;
+
+//显示DebugCore记录的指令跟踪,数据在需要显示时才从TraceRecorder中解码
+class TraceModel : public QAbstractTableModel
+{
+	Q_OBJECT
+public:
+	TraceModel(QObject* parent);
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+	int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+	QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+	void setDebugCore(std::shared_ptr<DebugCore> debugCore);
+	//跟踪结束后重新读取记录的范围
+	void updateContent();
+	uint64_t address(int row) const;
+
+private:
+	std::weak_ptr<DebugCore> m_debugCore;
+	uint64_t m_first = 0;
+	int m_rows = 0;
+};
+
+class TraceView : public QTableView
+{
+	Q_OBJECT
+public:
+	TraceView(QWidget* parent);
+
+public slots:
+	void setDebugCore(std::shared_ptr<DebugCore> debugCore);
+	void updateContent();
+
+private:
+	TraceModel* m_model;
+};
@@ -3,14 +3,31 @@
 //
 
 #include "global.h"
-#include "EventDispatcher.h"
+#include "LogQueue.h"
+
+#include <atomic>
 
 uint64_t g_highlightAddress = 0;
 
-task_port_t g_task = 0;
-pid_t g_pid = 0;
+static std::atomic<int> logLevel((int)LogType::Info);
+
+void setLogLevel(LogType level)
+{
+	logLevel.store((int)level, std::memory_order_relaxed);
+}
+
+bool logEnabled(LogType t)
+{
+	return (int)t >= logLevel.load(std::memory_order_relaxed);
+}
 
 void log(QString const &msg, LogType t)
 {
-	emit EventDispatcher::instance()->addLog(msg, t);
+	if (!logEnabled(t))
+	{
+		return;
+	}
+
+	//输出窗口定时从队列中读取
+	LogQueue::instance()->push(msg, t);
 }
@@ -9,7 +9,18 @@
 #include <cstdint>
 
 extern uint64_t g_highlightAddress;
-extern task_port_t g_task;
-extern pid_t g_pid;
 
-void log(QString const & msg, LogType t = LogType::Info);
\ No newline at end of file
+void log(QString const & msg, LogType t = LogType::Info);
+//低于level的日志不记录,默认为Info
+void setLogLevel(LogType level);
+bool logEnabled(LogType t);
+
+//先检查级别再生成消息,不记录时不构造QString,用于处理每个异常时都会执行的日志
+template <typename F>
+inline void logLazy(LogType t, F const& makeMessage)
+{
+	if (logEnabled(t))
+	{
+		log(makeMessage(), t);
+	}
+}
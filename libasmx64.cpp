@@ -1946,13 +1946,13 @@ x86opc_insn x86_insns_ext_f3[256] =
 	{ 0 },
 	/* 18 */
 	{ 0 },
-	{ 0 },
-	{ 0 },
-	{ 0 },
-	{ 0 },
-	{ 0 },
-	{ 0 },
-	{ 0 },
+	{ "~nop",{ Ev } },
+	{ "~nop",{ Ev } },
+	{ "~nop",{ Ev } },
+	{ "~nop",{ Ev } },
+	{ "~nop",{ Ev } },
+	{ "~nop",{ Ev } }, // endbr64/endbr32
+	{ "~nop",{ Ev } },
 	/* 20 */
 	{ 0 },
 	{ 0 },
@@ -6516,16 +6516,68 @@ x86opc_vex_insn *x86_vex_insns[256] =
 };
 
 
+enum
+{
+	LEN_INSN = 0,
+	LEN_INVALID,
+	LEN_SLOW,			/* 交给decode() */
+	LEN_PREFIX,
+	LEN_GROUP,
+	LEN_OPC_GROUP,
+};
+
+#define LEN_MODRM		0x01
+#define LEN_DISP		0x02	/* 读取sib和disp */
+#define LEN_MEM			0x04	/* mod必须不为3 */
+#define LEN_REG			0x08	/* mod必须为3 */
+#define LEN_SEG			0x10	/* modrm.reg必须是有效的段寄存器 */
+#define LEN_MOFFS		0x20	/* 地址大小的直接地址 */
+#define LEN_DEFAULT_64	0x40
+
+#define X86_LEN_GROUPS (sizeof x86_group_insns / sizeof x86_group_insns[0])
+
+struct x86len_desc
+{
+	uint8_t kind;
+	uint8_t data;
+	uint8_t flags;
+	//立即数的字节数,按操作数大小: 66前缀, 32位, 64位, 66前缀+REX.W
+	uint8_t imm[4];
+};
+
+struct x86len_tables
+{
+	x86len_desc insns[256];
+	//0F, 66 0F, F2 0F, F3 0F
+	x86len_desc ext[4][256];
+	x86len_desc opcGroups[X86_OPC_GROUPS][256];
+	x86len_desc groups[X86_LEN_GROUPS][8];
+};
+
+#ifdef LIBASMX64_GENERATOR
+//生成器运行时由指令表构造,见writeTables()
+static x86opc_insn x86_64_insns[256];
+static x86len_tables lengthTables;
+#else
+//构建时由libasmx64_gen生成,解码器不需要初始化
+#include "libasmx64_tables.inc"
+#endif
+
 x64dis::x64dis()
+	: x64dis(m_insn)
 {
+	m_insn.invalid = true;
+}
+
+x64dis::x64dis(x86dis_insn& out)
+	: insn(out)
+{
+	//str()也通过这里格式化调用者的insn,不能修改它,decode()会重新初始化insn
 	disable_highlighting();
 
 	opsize = X86_OPSIZE32;
 	addrsize = X86_ADDRSIZE64;
-	insn.invalid = true;
-	x86_insns = &x86_32_insns;
-
-	prepInsns();
+	x86_insns = &x86_64_insns;
 }
 
 void x64dis::checkInfo(x86opc_insn *xinsn)
@@ -6686,25 +6738,6 @@ void x64dis::prefixes()
 
 }
 
-void x64dis::prepInsns()
-{
-	if (!x86_64_insns)
-	{
-		x86_64_insns = (x86opc_insn(*)[256])malloc(sizeof *x86_64_insns);
-		memcpy(x86_64_insns, x86_32_insns, sizeof x86_32_insns);
-
-		int i = 0;
-		while (x86_64_insn_patches[i].opc != -1)
-		{
-			(*x86_64_insns)[x86_64_insn_patches[i].opc] = x86_64_insn_patches[i].insn;
-			i++;
-		}
-	}
-	x86_insns = x86_64_insns;
-}
-
-x86opc_insn(*x64dis::x86_64_insns)[256];
-
 void x64dis::decode_insn(x86opc_insn *xinsn)
 {
 	if (!xinsn->name)
@@ -6852,6 +6885,7 @@ void x64dis::decode_insn(x86opc_insn *xinsn)
 		{
 			insn.opcodeclass = X86DIS_OPCODE_CLASS_EXT;
 			insn.opcode = getbyte();
+			opcgroup = true;
 			decode_insn(&x86_opc_group_insns[specialdata][insn.opcode]);
 			break;
 		}
@@ -7790,7 +7824,7 @@ void x64dis::str_format(char **str, const char **format, char *p, char *n, char
 	*str = s;
 }
 
-static const char *regs(x86dis_insn *insn, int mode, int nr)
+static const char *regs(x86dis_insn const *insn, int mode, int nr)
 {
 	if (insn->rexprefix)
 	{
@@ -7802,7 +7836,7 @@ static const char *regs(x86dis_insn *insn, int mode, int nr)
 	}
 }
 
-void x64dis::str_op(char *opstr, int *opstrlen, x86dis_insn *insn, x86_insn_op *op, bool explicit_params)
+void x64dis::str_op(char *opstr, int *opstrlen, x86dis_insn const *insn, x86_insn_op const *op, bool explicit_params)
 {
 	const char *cs_default = get_cs(e_cs_default);
 	const char *cs_number = get_cs(e_cs_number);
@@ -8153,6 +8187,7 @@ x86dis_insn* x64dis::decode(uint8_t *code, int _maxlen, uint64_t _addr)
 	drex = -1;
 	special_imm = -1;
 	have_disp = false;
+	opcgroup = false;
 	memset(&insn, 0, sizeof insn);
 	insn.invalid = false;
 	insn.eopsize = opsize;
@@ -8181,10 +8216,11 @@ x86dis_insn* x64dis::decode(uint8_t *code, int _maxlen, uint64_t _addr)
 	else
 	{
 		insn.size = int(codep - ocodep);
+		insn.flow = (uint8_t)classifyFlow();
 		if (fixdisp)
 		{
-			// ip-relativ addressing in PM64
-			for (int i = 0; i < 2; i++)
+			// ip-relativ addressing in PM64, VEX编码的内存操作数可能是第3个
+			for (int i = 0; i < 5; i++)
 			{
 				if (insn.op[i].type == X86_OPTYPE_MEM && insn.op[i].mem.hasdisp)
 				{
@@ -8196,6 +8232,677 @@ x86dis_insn* x64dis::decode(uint8_t *code, int _maxlen, uint64_t _addr)
 	return &insn;
 }
 
+#ifdef LIBASMX64_GENERATOR
+x86len_desc x64dis::describeLength(x86opc_insn const* xinsn)
+{
+	x86len_desc d = {};
+	if (!xinsn->name)
+	{
+		switch (xinsn->op[0])
+		{
+		case SPECIAL_TYPE_INVALID:
+			d.kind = LEN_INVALID;
+			break;
+		case SPECIAL_TYPE_PREFIX:
+			d.kind = LEN_PREFIX;
+			break;
+		case SPECIAL_TYPE_OPC_GROUP:
+			d.kind = LEN_OPC_GROUP;
+			d.data = xinsn->op[1];
+			break;
+		case SPECIAL_TYPE_GROUP:
+			d.kind = LEN_GROUP;
+			d.data = xinsn->op[1];
+			break;
+		default:
+			d.kind = LEN_SLOW;
+			break;
+		}
+		return d;
+	}
+
+	static const X86OpSize eopsizes[4] = { X86_OPSIZE16, X86_OPSIZE32, X86_OPSIZE64, X86_OPSIZE64 };
+	static const int opsizeprefixes[4] = { X86_PREFIX_OPSIZE, X86_PREFIX_NO, X86_PREFIX_NO, X86_PREFIX_OPSIZE };
+
+	d.kind = LEN_INSN;
+	if (x86_op_type[xinsn->op[0]].info & INFO_DEFAULT_64)
+	{
+		d.flags |= LEN_DEFAULT_64;
+	}
+
+	//和decode_op()读取的字节一致
+	for (int i = 0; i < 4; i++)
+	{
+		x86opc_insn_op *xop = &x86_op_type[xinsn->op[i]];
+		switch (xop->type)
+		{
+		case TYPE_C:
+		case TYPE_D:
+		case TYPE_F:
+		case TYPE_G:
+		case TYPE_P:
+		case TYPE_V:
+		case TYPE_Y:
+			d.flags |= LEN_MODRM;
+			break;
+		case TYPE_S:
+			d.flags |= LEN_MODRM | LEN_SEG;
+			break;
+		case TYPE_R:
+		case TYPE_PR:
+		case TYPE_VR:
+			d.flags |= LEN_MODRM | LEN_REG;
+			break;
+		case TYPE_E:
+			d.flags |= LEN_MODRM | LEN_DISP;
+			if (xop->size == SIZE_P)
+			{
+				d.flags |= LEN_MEM;
+			}
+			break;
+		case TYPE_M:
+			d.flags |= LEN_MODRM | LEN_DISP | LEN_MEM;
+			break;
+		case TYPE_MR:
+			if (xop->extra == SIZE_P)
+			{
+				d.kind = LEN_SLOW;
+				return d;
+			}
+			d.flags |= LEN_MODRM | LEN_DISP;
+			break;
+		case TYPE_Q:
+		case TYPE_W:
+		case TYPE_X:
+			d.flags |= LEN_MODRM | LEN_DISP;
+			break;
+		case TYPE_Sx:
+			if (xop->extra > 5)
+			{
+				d.kind = LEN_INVALID;
+				return d;
+			}
+			break;
+		case TYPE_O:
+			d.flags |= LEN_MOFFS;
+			break;
+		case TYPE_I:
+		case TYPE_Is:
+		case TYPE_J:
+			for (int k = 0; k < 4; k++)
+			{
+				insn.eopsize = eopsizes[k];
+				insn.opsizeprefix = opsizeprefixes[k];
+				int s = xop->type == TYPE_J ? esizeop(xop->size) : esizeop_ex(xop->size);
+				switch (s)
+				{
+				case 1:
+				case 2:
+				case 4:
+					d.imm[k] += s;
+					break;
+				case 8:
+					d.imm[k] += xop->type == TYPE_J ? 4 : 8;
+					break;
+				}
+			}
+			break;
+		case TYPE_I4:
+		case TYPE_VI:
+		case TYPE_YI:
+		case TYPE_VD:
+		case TYPE_VS:
+			d.kind = LEN_SLOW;
+			return d;
+		}
+	}
+	return d;
+}
+
+static void writeLengthDesc(FILE* out, x86len_desc const& d)
+{
+	fprintf(out, "{ %d, %d, 0x%02x, { %d, %d, %d, %d } },", d.kind, d.data, d.flags, d.imm[0], d.imm[1], d.imm[2], d.imm[3]);
+}
+
+static void writeLengthDescs(FILE* out, x86len_desc const* descs, int count, const char* indent)
+{
+	fprintf(out, "%s{\n", indent);
+	for (int i = 0; i < count; i++)
+	{
+		fprintf(out, i % 4 == 0 ? "%s\t" : " ", indent);
+		writeLengthDesc(out, descs[i]);
+		if (i % 4 == 3 || i == count - 1)
+		{
+			fputc('\n', out);
+		}
+	}
+	fprintf(out, "%s},\n", indent);
+}
+
+bool x64dis::writeTables(const char* path)
+{
+	//64位指令表
+	memcpy(x86_64_insns, x86_32_insns, sizeof x86_32_insns);
+	for (int i = 0; x86_64_insn_patches[i].opc != -1; i++)
+	{
+		x86_64_insns[x86_64_insn_patches[i].opc] = x86_64_insn_patches[i].insn;
+	}
+
+	//长度描述表
+	auto& t = lengthTables;
+	x86dis_insn tmp;
+	x64dis d(tmp);
+	for (int i = 0; i < 256; i++)
+	{
+		t.insns[i] = d.describeLength(&x86_64_insns[i]);
+		if (t.insns[i].kind == LEN_PREFIX && i != 0x0f && i != 0x8f)
+		{
+			//c4/c5在64位下总是VEX,其他前缀字节只会在前缀超过15字节时作为操作码出现
+			t.insns[i].kind = (i == 0xc4 || i == 0xc5) ? LEN_SLOW : LEN_INVALID;
+		}
+
+		x86opc_insn *ext[4] = { &x86_insns_ext[i], &x86_insns_ext_66[i], &x86_insns_ext_f2[i], &x86_insns_ext_f3[i] };
+		for (int m = 0; m < 4; m++)
+		{
+			t.ext[m][i] = d.describeLength(ext[m]);
+			if (t.ext[m][i].kind == LEN_PREFIX)
+			{
+				t.ext[m][i].kind = LEN_INVALID;
+			}
+		}
+
+		for (int g = 0; g < X86_OPC_GROUPS; g++)
+		{
+			t.opcGroups[g][i] = d.describeLength(&x86_opc_group_insns[g][i]);
+			if (t.opcGroups[g][i].kind == LEN_PREFIX)
+			{
+				t.opcGroups[g][i].kind = LEN_INVALID;
+			}
+			else if (t.opcGroups[g][i].kind == LEN_OPC_GROUP)
+			{
+				t.opcGroups[g][i].kind = LEN_SLOW;
+			}
+		}
+	}
+
+	//组内的特殊项很少见,交给decode()
+	for (std::size_t g = 0; g < X86_LEN_GROUPS; g++)
+	{
+		for (int r = 0; r < 8; r++)
+		{
+			auto& desc = t.groups[g][r];
+			desc = d.describeLength(&x86_group_insns[g][r]);
+			if (desc.kind != LEN_INSN && desc.kind != LEN_INVALID)
+			{
+				desc.kind = LEN_SLOW;
+			}
+		}
+	}
+
+	FILE* out = fopen(path, "w");
+	if (!out)
+	{
+		return false;
+	}
+
+	fprintf(out, "/* 由libasmx64_gen根据libasmx64.cpp中的指令表生成,不要修改 */\n\n");
+	fprintf(out, "static x86opc_insn x86_64_insns[256] =\n{\n");
+	for (int i = 0; i < 256; i++)
+	{
+		auto& xinsn = x86_64_insns[i];
+		fprintf(out, "\t{ ");
+		if (xinsn.name)
+		{
+			fputc('"', out);
+			for (const char* c = xinsn.name; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+				{
+					fputc('\\', out);
+				}
+				fputc(*c, out);
+			}
+			fputc('"', out);
+		}
+		else
+		{
+			fputc('0', out);
+		}
+		fprintf(out, ",{ %d, %d, %d, %d } }, /* %02x */\n", xinsn.op[0], xinsn.op[1], xinsn.op[2], xinsn.op[3], i);
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static constexpr x86len_tables lengthTables =\n{\n");
+	writeLengthDescs(out, t.insns, 256, "\t");
+	fprintf(out, "\t{\n");
+	for (int m = 0; m < 4; m++)
+	{
+		writeLengthDescs(out, t.ext[m], 256, "\t\t");
+	}
+	fprintf(out, "\t},\n\t{\n");
+	for (int g = 0; g < X86_OPC_GROUPS; g++)
+	{
+		writeLengthDescs(out, t.opcGroups[g], 256, "\t\t");
+	}
+	fprintf(out, "\t},\n\t{\n");
+	for (std::size_t g = 0; g < X86_LEN_GROUPS; g++)
+	{
+		writeLengthDescs(out, t.groups[g], 8, "\t\t");
+	}
+	fprintf(out, "\t},\n};\n");
+
+	return fclose(out) == 0;
+}
+#endif
+
+static int slowLength(uint8_t const* code, int maxlen)
+{
+	x86dis_insn insn;
+	return x64dis::decode(code, maxlen, 0, insn) ? insn.size : 0;
+}
+
+//指令开头的前缀
+struct x86prefix_scan
+{
+	bool opsize16;
+	bool addrsize32;
+	int rep;
+	uint8_t rex;
+	uint8_t opcode;
+};
+
+#define PREFIX_SCAN_INVALID	0
+#define PREFIX_SCAN_SLOW	(-1)
+
+static inline bool isLegacyPrefix(uint8_t c)
+{
+	switch (c)
+	{
+	case 0x26:
+	case 0x2e:
+	case 0x36:
+	case 0x3e:
+	case 0x64:
+	case 0x65:
+	case 0x66:
+	case 0x67:
+	case 0xf0:
+	case 0xf2:
+	case 0xf3:
+		return true;
+	}
+	return false;
+}
+
+//和prefixes()相同,返回操作码之后的位置
+//大部分指令没有前缀,先检查第一个字节
+static int scanPrefixes(uint8_t const* code, int maxlen, x86prefix_scan& scan)
+{
+	scan.opsize16 = false;
+	scan.addrsize32 = false;
+	scan.rep = X86_PREFIX_NO;
+	scan.rex = 0;
+
+	if (maxlen <= 0)
+	{
+		return PREFIX_SCAN_INVALID;
+	}
+
+	int pos = 0;
+	if (isLegacyPrefix(code[0]))
+	{
+		for (;; pos++)
+		{
+			if (pos == 15)
+			{
+				return PREFIX_SCAN_SLOW;
+			}
+			if (pos >= maxlen)
+			{
+				return PREFIX_SCAN_INVALID;
+			}
+			uint8_t c = code[pos];
+			if (!isLegacyPrefix(c))
+			{
+				break;
+			}
+			switch (c)
+			{
+			case 0x66:
+				scan.opsize16 = true;
+				break;
+			case 0x67:
+				scan.addrsize32 = true;
+				break;
+			case 0xf2:
+				scan.rep = X86_PREFIX_REPNZ;
+				break;
+			case 0xf3:
+				scan.rep = X86_PREFIX_REPZ;
+				break;
+			}
+		}
+	}
+
+	uint8_t c = code[pos++];
+	if ((c & 0xf0) == 0x40)
+	{
+		scan.rex = c;
+		if (pos >= maxlen)
+		{
+			return PREFIX_SCAN_INVALID;
+		}
+		c = code[pos++];
+	}
+	scan.opcode = c;
+	return pos;
+}
+
+int x64dis::rawLength(uint8_t const* code, int maxlen)
+{
+	auto& t = lengthTables;
+
+	x86prefix_scan scan;
+	int pos = scanPrefixes(code, maxlen, scan);
+	if (pos == PREFIX_SCAN_SLOW)
+	{
+		return slowLength(code, maxlen);
+	}
+	if (pos == PREFIX_SCAN_INVALID)
+	{
+		return 0;
+	}
+	bool opsize16 = scan.opsize16;
+	bool addrsize32 = scan.addrsize32;
+	int rep = scan.rep;
+	uint8_t rex = scan.rex;
+	uint8_t c = scan.opcode;
+
+	int modrm = -1;
+	x86len_desc const* d = &t.insns[c];
+	if (d->kind == LEN_PREFIX)
+	{
+		if (pos >= maxlen)
+		{
+			return 0;
+		}
+		uint8_t b = code[pos++];
+		if (c == 0x8f)
+		{
+			//8F的reg为0时是pop,否则是XOP
+			if ((b & 0x38) != 0)
+			{
+				return slowLength(code, maxlen);
+			}
+			modrm = b;
+			d = &t.groups[GROUP_8F][0];
+		}
+		else
+		{
+			//0F
+			if (rep != X86_PREFIX_NO && opsize16)
+			{
+				return 0;
+			}
+			int map = rep == X86_PREFIX_REPNZ ? 2 : rep == X86_PREFIX_REPZ ? 3 : opsize16 ? 1 : 0;
+			d = &t.ext[map][b];
+			if (d->kind == LEN_OPC_GROUP)
+			{
+				if (pos >= maxlen)
+				{
+					return 0;
+				}
+				d = &t.opcGroups[d->data][code[pos++]];
+			}
+		}
+	}
+
+	if (d->kind == LEN_GROUP)
+	{
+		if (pos >= maxlen)
+		{
+			return 0;
+		}
+		modrm = code[pos++];
+		d = &t.groups[d->data][(modrm >> 3) & 7];
+	}
+
+	switch (d->kind)
+	{
+	case LEN_INSN:
+		break;
+	case LEN_SLOW:
+		return slowLength(code, maxlen);
+	default:
+		return 0;
+	}
+
+	if (d->flags & LEN_MODRM)
+	{
+		if (modrm == -1)
+		{
+			if (pos >= maxlen)
+			{
+				return 0;
+			}
+			modrm = code[pos++];
+		}
+
+		int mod = modrm >> 6;
+		int rm = modrm & 7;
+		if (((d->flags & LEN_MEM) && mod == 3)
+			|| ((d->flags & LEN_REG) && mod != 3)
+			|| ((d->flags & LEN_SEG) && ((modrm >> 3) & 7) > 5))
+		{
+			return 0;
+		}
+
+		//和getdisp()相同,64位模式下没有16位寻址
+		if ((d->flags & LEN_DISP) && mod != 3)
+		{
+			if (rm == 4)
+			{
+				if (pos >= maxlen)
+				{
+					return 0;
+				}
+				if (mod == 0 && (code[pos] & 7) == 5)
+				{
+					mod = 2;
+				}
+				pos++;
+			}
+			else if (mod == 0 && rm == 5)
+			{
+				mod = 2;
+			}
+			pos += mod == 1 ? 1 : mod == 2 ? 4 : 0;
+		}
+	}
+
+	int size;
+	if (rex & 0x08)
+	{
+		size = opsize16 ? 3 : 2;
+	}
+	else if (opsize16)
+	{
+		size = 0;
+	}
+	else
+	{
+		size = (d->flags & LEN_DEFAULT_64) ? 2 : 1;
+	}
+	pos += d->imm[size];
+	if (d->flags & LEN_MOFFS)
+	{
+		pos += addrsize32 ? 4 : 8;
+	}
+
+	return pos <= maxlen ? pos : 0;
+}
+
+int x64dis::length(uint8_t const* code, int maxlen)
+{
+	auto len = rawLength(code, maxlen);
+	return len ? len : 1;
+}
+
+std::size_t x64dis::decodeBatch(uint8_t const* code, std::size_t len, uint64_t addr,
+	x86dis_rec* out, std::size_t maxCount, int mode)
+{
+	x86dis_insn insn;
+	x64dis decoder(insn);
+	std::size_t offset = 0;
+	std::size_t count = 0;
+	while (count < maxCount && offset < len)
+	{
+		auto maxlen = (int)std::min<std::size_t>(15, len - offset);
+		if (mode & X86DIS_BATCH_LENGTH_ONLY)
+		{
+			auto size = rawLength(code + offset, maxlen);
+			auto& rec = out[count++];
+			rec.offset = (uint32_t)offset;
+			rec.size = (uint8_t)(size ? size : 1);
+			rec.kind = X86_FLOW_NONE;
+			rec.opcodeclass = 0;
+			rec.flags = size ? 0 : X86DIS_REC_INVALID;
+			rec.target = 0;
+			offset += rec.size;
+			continue;
+		}
+
+		decoder.decode(const_cast<uint8_t*>(code) + offset, maxlen, addr + offset);
+
+		auto& rec = out[count++];
+		rec.offset = (uint32_t)offset;
+		rec.size = (uint8_t)insn.size;
+		rec.kind = X86_FLOW_NONE;
+		rec.opcodeclass = (uint8_t)insn.opcodeclass;
+		rec.flags = insn.invalid ? X86DIS_REC_INVALID : 0;
+		rec.target = 0;
+		offset += insn.size;
+
+		if (insn.invalid)
+		{
+			continue;
+		}
+
+		rec.kind = insn.flow;
+		if (branchTarget(insn, rec.target))
+		{
+			rec.flags |= X86DIS_REC_TARGET;
+		}
+		else if (rec.kind == X86_FLOW_JMP || rec.kind == X86_FLOW_JCC || rec.kind == X86_FLOW_CALL)
+		{
+			rec.flags |= X86DIS_REC_INDIRECT;
+		}
+	}
+
+	return count;
+}
+
+bool x64dis::absoluteAddress(x86_insn_op const& op, uint64_t& address)
+{
+	if (op.type != X86_OPTYPE_MEM || op.mem.base != X86_REG_NO || op.mem.index != X86_REG_NO || !op.mem.hasdisp)
+	{
+		return false;
+	}
+
+	address = op.mem.disp;
+	return true;
+}
+
+bool x64dis::branchTarget(x86dis_insn const& insn, uint64_t& target)
+{
+	if ((insn.flow != X86_FLOW_JMP && insn.flow != X86_FLOW_JCC && insn.flow != X86_FLOW_CALL)
+		|| insn.op[0].type != X86_OPTYPE_IMM)
+	{
+		return false;
+	}
+
+	target = insn.op[0].imm;
+	return true;
+}
+
+X86FlowKind x64dis::classifyFlow()
+{
+	//VEX/XOP编码和三字节操作码(0F 38等)中没有控制流指令,它们的opcode会和前面的指令表重合
+	if (insn.invalid || insn.vexprefix.mmmm || opcgroup)
+	{
+		return X86_FLOW_NONE;
+	}
+
+	auto op = insn.opcode;
+	switch (insn.opcodeclass)
+	{
+	case X86DIS_OPCODE_CLASS_STD:
+		if ((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3))
+		{
+			return X86_FLOW_JCC;	//jcc, loop, jrcxz
+		}
+		switch (op)
+		{
+		case 0xe8:
+			return X86_FLOW_CALL;
+		case 0xe9:
+		case 0xeb:
+			return X86_FLOW_JMP;
+		case 0xc2:
+		case 0xc3:
+		case 0xca:
+		case 0xcb:
+		case 0xcf:
+			return X86_FLOW_RET;
+		case 0xcc:
+		case 0xcd:
+		case 0xce:
+			return X86_FLOW_INT;
+		case 0xf4:
+			return X86_FLOW_HALT;
+		case 0xff:
+			//FF /2 /3是call, /4 /5是jmp
+			switch ((modrm >> 3) & 7)
+			{
+			case 2:
+			case 3:
+				return X86_FLOW_CALL;
+			case 4:
+			case 5:
+				return X86_FLOW_JMP;
+			}
+			break;
+		}
+		break;
+	case X86DIS_OPCODE_CLASS_EXT:
+	case X86DIS_OPCODE_CLASS_EXT_66:
+		switch (op)
+		{
+		case 0x05:
+		case 0x34:
+			return X86_FLOW_INT;	//syscall, sysenter
+		case 0x07:
+		case 0x35:
+			return X86_FLOW_RET;	//sysret, sysexit
+		case 0xb8:
+			return X86_FLOW_JMP;	//jmpe
+		case 0x0b:
+		case 0xb9:
+			return X86_FLOW_HALT;	//ud2, ud1
+		}
+		//fallthrough
+	case X86DIS_OPCODE_CLASS_EXT_F2:
+	case X86DIS_OPCODE_CLASS_EXT_F3:
+		if (op >= 0x80 && op <= 0x8f)
+		{
+			return X86_FLOW_JCC;
+		}
+		break;
+	}
+
+	return X86_FLOW_NONE;
+}
+
 void x64dis::getOpcodeMetrics(int &min_length, int &max_length, int &min_look_ahead, int &avg_look_ahead, int &addr_align)
 {
 	min_length = 1;
@@ -8210,7 +8917,7 @@ uint8_t x64dis::getSize(void *disasm_insn)
 	return ((x86dis_insn*)disasm_insn)->size;
 }
 
-const char * x64dis::str(x86dis_insn*disasm_insn, int options)
+const char * x64dis::str(x86dis_insn const *disasm_insn, int options)
 {
 	return strf(disasm_insn, options, DISASM_STRF_DEFAULT_FORMAT);
 }
@@ -8256,9 +8963,9 @@ static void pickname(char *result, const char *name, int n)
 	ht_strlcpy(result, name, s - name + 1);
 }
 
-const char * x64dis::strf(x86dis_insn* disasm_insn, int opt, const char *format)
+const char * x64dis::strf(x86dis_insn const *disasm_insn, int opt, const char *format)
 {
-	x86dis_insn *insn = (x86dis_insn*)disasm_insn;
+	x86dis_insn const *insn = disasm_insn;
 	char prefix[64];
 	char *p = prefix;
 	options = opt;
@@ -8338,6 +9045,21 @@ const char * x64dis::strf(x86dis_insn* disasm_insn, int opt, const char *format)
 	return insnstr;
 }
 
+bool x64dis::decode(uint8_t const* code, int maxlen, uint64_t addr, x86dis_insn& insn)
+{
+	//解码时只读取code
+	x64dis decoder(insn);
+	decoder.decode(const_cast<uint8_t*>(code), maxlen, addr);
+	return !insn.invalid;
+}
+
+int x64dis::str(x86dis_insn const& insn, int options, char* buffer, int size)
+{
+	//格式化只读取insn,使用格式化器自己的m_insn构造
+	x64dis formatter;
+	return (int)ht_strlcpy(buffer, formatter.str(&insn, options), size);
+}
+
 bool x64dis::validInsn(x86dis_insn* disasm_insn)
 {
 	return !((x86dis_insn *)disasm_insn)->invalid;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
 
 struct x86dis_vex
 {
@@ -100,6 +101,7 @@ struct x86dis_insn
 	int size;
 	int opcode;
 	int opcodeclass;
+	uint8_t flow;		/* X86FlowKind, 解码时按操作码计算 */
 	X86OpSize eopsize;
 	X86AddrSize eaddrsize;
 	bool ambiguous;
@@ -152,19 +154,87 @@ struct x86opc_insn_op
 #define X86DIS_STYLE_OPTIMIZE_ADDR	0x00000002	/* IF SET: mov [eax*3], ax 		ELSE: mov [eax+eax*2+00000000], ax */
 
 
+//指令对控制流的影响
+enum X86FlowKind
+{
+	X86_FLOW_NONE = 0,		/* 顺序执行 */
+	X86_FLOW_JMP,
+	X86_FLOW_JCC,			/* 条件跳转, 包括loop/jcxz */
+	X86_FLOW_CALL,
+	X86_FLOW_RET,			/* ret/iret/sysret */
+	X86_FLOW_INT,			/* int/syscall/sysenter */
+	X86_FLOW_HALT,			/* hlt/ud1/ud2 */
+};
+
+/* x86dis_rec.flags */
+#define X86DIS_REC_INVALID		0x01	/* 无效指令, 按db处理, 长度为1 */
+#define X86DIS_REC_INDIRECT		0x02	/* 间接跳转/调用 */
+#define X86DIS_REC_TARGET		0x04	/* target有效 */
+
+/* decodeBatch()的mode */
+#define X86DIS_BATCH_LENGTH_ONLY	0x01	/* 只需要offset, size和X86DIS_REC_INVALID, 使用length()计算 */
+
+//批量解码的结果,每条指令16字节
+struct x86dis_rec
+{
+	uint32_t offset;		/* 相对code的偏移 */
+	uint8_t size;
+	uint8_t kind;			/* X86FlowKind */
+	uint8_t opcodeclass;
+	uint8_t flags;
+	uint64_t target;		/* 直接跳转/调用的目标地址 */
+};
+
+struct x86len_desc;
+
 class x64dis
 {
 public:
 	x64dis();
+	x64dis(x64dis const&) = delete;
+	x64dis& operator=(x64dis const&) = delete;
+
 	x86dis_insn* decode(uint8_t *code, int maxlen, uint64_t addr);
-	const char *str(x86dis_insn* disasm_insn, int options);
-	const char *strf(x86dis_insn* disasm_insn, int options, const char *format);
+	const char *str(x86dis_insn const *disasm_insn, int options);
+	const char *strf(x86dis_insn const *disasm_insn, int options, const char *format);
+
+	//可重入接口,结果写入调用者提供的insn和buffer,不分配内存,可以在多个线程中同时调用
+	//返回指令是否有效,无效指令和decode()一样被解码为长度为1的db
+	static bool decode(uint8_t const* code, int maxlen, uint64_t addr, x86dis_insn& insn);
+	//返回写入的字符数(不包括结尾的0),结果超出size时被截断
+	static int str(x86dis_insn const& insn, int options, char* buffer, int size);
+	//从code开始连续解码,最多maxCount条,返回解码的指令数
+	//每条指令最多读取15字节,不会超过len;offset >= len时停止
+	static std::size_t decodeBatch(uint8_t const* code, std::size_t len, uint64_t addr,
+		x86dis_rec* out, std::size_t maxCount, int mode = 0);
+	//指令的类别(call/jmp/jcc/ret等),解码时已经按操作码算好,不需要比较指令名
+	static X86FlowKind flowKind(x86dis_insn const& insn) { return (X86FlowKind)insn.flow; }
+	//直接跳转/调用的目标地址,间接跳转和其他指令返回false
+	static bool branchTarget(x86dis_insn const& insn, uint64_t& target);
+	//内存操作数不带寄存器时返回它的地址,64位下rip相对的地址解码后也是这种形式
+	static bool absoluteAddress(x86_insn_op const& op, uint64_t& address);
+	//只计算指令长度,结果和decode()的size相同(无效指令为1)
+	//由指令表生成的描述表查表计算,不填充操作数,VEX/XOP等少见的编码交给decode()
+	static int length(uint8_t const* code, int maxlen);
 private:
+	//解码直接写入out
+	explicit x64dis(x86dis_insn& out);
+
+	//无效指令返回0
+	static int rawLength(uint8_t const* code, int maxlen);
+#ifdef LIBASMX64_GENERATOR
+	x86len_desc describeLength(x86opc_insn const* xinsn);
+public:
+	//生成libasmx64_tables.inc: 64位指令表和length()使用的描述表
+	static bool writeTables(const char* path);
+private:
+#endif
+
 	void checkInfo(x86opc_insn *xinsn);
+	X86FlowKind classifyFlow();
 	void decode_modrm(x86_insn_op *op, char size, bool allow_reg,
 		bool allow_mem, bool mmx, bool xmm, bool ymm);
 	void prefixes();
-	void prepInsns();
 	void decode_insn(x86opc_insn *xinsn);
 	void decode_vex_insn(x86opc_vex_insn *xinsn);
 	void decode_op(x86_insn_op *op, x86opc_insn_op *xop);
@@ -185,8 +255,8 @@ private:
 	bool isaddr(char c);
 	void str_format(char **str, const char **format, char *p, char *n,
 		char *op[5], int oplen[5], char stopchar, int print);
-	void str_op(char *opstr, int *opstrlen, x86dis_insn *insn,
-		x86_insn_op *op, bool explicit_params);
+	void str_op(char *opstr, int *opstrlen, x86dis_insn const *insn,
+		x86_insn_op const *op, bool explicit_params);
 	uint32_t mkmod(uint32_t modrm);
 	uint32_t mkreg(uint32_t modrm);
 	uint32_t mkindex(uint32_t modrm);
@@ -207,11 +277,14 @@ public:
 
 	char* (*addr_sym_func)(uint64_t addr, int *symstrlen, void *context) = nullptr;
 	void* addr_sym_func_context = nullptr;
-	static x86opc_insn(*x86_64_insns)[256];
 	X86OpSize opsize;
 	X86AddrSize addrsize;
 	x86opc_insn(*x86_insns)[256];
-	x86dis_insn insn;
+private:
+	x86dis_insn m_insn;
+public:
+	//默认指向m_insn,可重入接口中指向调用者提供的结构
+	x86dis_insn& insn;
 	char insnstr[256];
 	uint8_t *codep, *ocodep;
 	uint64_t addr;
@@ -223,6 +296,8 @@ public:
 	int special_imm;
 	uint32_t disp;
 	bool have_disp;
+	//opcode是0F 38等三字节操作码的最后一个字节
+	bool opcgroup;
 	bool fixdisp;
 	int options;
 	bool highlight;
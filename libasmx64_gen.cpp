@@ -0,0 +1,20 @@
+#include "libasmx64.h"
+
+#include <cstdio>
+
+//构建时运行,根据libasmx64.cpp中的指令表生成libasmx64_tables.inc
+int main(int argc, char* argv[])
+{
+	if (argc != 2)
+	{
+		fprintf(stderr, "usage: libasmx64_gen <libasmx64_tables.inc>\n");
+		return 1;
+	}
+
+	if (!x64dis::writeTables(argv[1]))
+	{
+		fprintf(stderr, "libasmx64_gen: 无法写入 %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
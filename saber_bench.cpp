@@ -0,0 +1,566 @@
+#include "libasmx64.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <elf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//反汇编器的基准测试,不依赖Qt
+//语料: 固定种子生成的常见指令序列,固定种子的随机字节,saber_bench自身的代码段,以及命令行指定的文件
+//结果以JSON输出,便于在不同版本之间比较
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void* operator new(std::size_t size)
+{
+	++g_allocations;
+	if (void* p = malloc(size ? size : 1))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	free(p);
+}
+
+//缓存未命中计数,只在Linux上可用
+class CacheMissCounter
+{
+public:
+	CacheMissCounter()
+	{
+#ifdef __linux__
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~CacheMissCounter()
+	{
+#ifdef __linux__
+		if (m_fd >= 0)
+		{
+			close(m_fd);
+		}
+#endif
+	}
+
+	bool available() const { return m_fd >= 0; }
+
+	void start()
+	{
+#ifdef __linux__
+		if (m_fd >= 0)
+		{
+			ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	uint64_t stop()
+	{
+		uint64_t count = 0;
+#ifdef __linux__
+		if (m_fd >= 0)
+		{
+			ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(m_fd, &count, sizeof count) != sizeof count)
+			{
+				count = 0;
+			}
+		}
+#endif
+		return count;
+	}
+
+private:
+	int m_fd = -1;
+};
+
+struct Corpus
+{
+	std::string name;
+	std::vector<uint8_t> code;
+};
+
+struct Result
+{
+	std::string corpus;
+	std::string bench;
+	uint64_t instructions;
+	uint64_t bytes;
+	double seconds;
+	uint64_t allocations;
+	uint64_t cacheMisses;
+};
+
+//按编译器输出中常见的指令编码生成,modrm/sib/disp/立即数随机
+static std::vector<uint8_t> syntheticCode(uint32_t seed, std::size_t size)
+{
+	std::mt19937 rng(seed);
+	std::vector<uint8_t> code;
+	code.reserve(size + 16);
+
+	auto byte = [&](uint8_t b) { code.push_back(b); };
+	auto imm = [&](int n) { for (int i = 0; i < n; i++) byte((uint8_t)rng()); };
+	auto modrm = [&](int reg)
+	{
+		int mod = rng() % 4;
+		int rm = rng() % 8;
+		byte((uint8_t)(mod << 6 | (reg & 7) << 3 | rm));
+		if (mod != 3 && rm == 4)
+		{
+			int base = rng() % 8;
+			byte((uint8_t)((rng() % 4) << 6 | (rng() % 8) << 3 | base));
+			if (mod == 0 && base == 5)
+			{
+				imm(4);
+			}
+		}
+		if (mod == 0 && rm == 5)
+		{
+			imm(4);
+		}
+		imm(mod == 1 ? 1 : mod == 2 ? 4 : 0);
+	};
+	auto rex = [&]() { byte((uint8_t)(0x48 | (rng() % 8))); };
+
+	while (code.size() < size)
+	{
+		switch (rng() % 24)
+		{
+		case 0: byte((uint8_t)(0x50 + rng() % 8)); break;							// push
+		case 1: byte((uint8_t)(0x58 + rng() % 8)); break;							// pop
+		case 2: case 3: case 4: rex(); byte(0x8b); modrm(rng()); break;				// mov r, r/m
+		case 5: case 6: rex(); byte(0x89); modrm(rng()); break;						// mov r/m, r
+		case 7: rex(); byte(0x8d); modrm(rng()); break;								// lea
+		case 8: rex(); byte(0x83); modrm(rng()); imm(1); break;						// add/sub/cmp r/m, imm8
+		case 9: rex(); byte(0xc7); modrm(0); imm(4); break;							// mov r/m, imm32
+		case 10: byte(0xe8); imm(4); break;											// call
+		case 11: byte((uint8_t)(0x70 + rng() % 16)); imm(1); break;					// jcc rel8
+		case 12: byte(0x0f); byte((uint8_t)(0x80 + rng() % 16)); imm(4); break;	// jcc rel32
+		case 13: { bool rel8 = rng() % 2; byte(rel8 ? 0xeb : 0xe9); imm(rel8 ? 1 : 4); break; }	// jmp
+		case 14: byte(0xc3); break;													// ret
+		case 15: byte(0x85); modrm(rng()); break;									// test
+		case 16: byte(0x0f); byte(rng() % 2 ? 0xb6 : 0xb7); modrm(rng()); break;	// movzx
+		case 17: byte((uint8_t)(rng() % 2 ? 0xf2 : 0xf3)); byte(0x0f); byte(0x10); modrm(rng()); break;	// movss/movsd
+		case 18: byte(0x66); byte(0x0f); byte(0xef); modrm(rng()); break;			// pxor
+		case 19: byte(0xc5); byte(0xfe); byte(0x6f); modrm(rng()); break;			// vmovdqu
+		case 20: byte(0x0f); byte((uint8_t)(0x40 + rng() % 16)); modrm(rng()); break;	// cmovcc
+		case 21: byte((uint8_t)(0xb8 + rng() % 8)); imm(4); break;								// mov r32, imm32
+		case 22: byte(0x0f); byte(0x1f); modrm(0); break;							// nop r/m
+		case 23: byte(0x64); byte(0x48); byte(0x8b); byte(0x04); byte(0x25); imm(4); break;	// mov r, fs:[disp32]
+		}
+	}
+	code.resize(size);
+	return code;
+}
+
+static std::vector<uint8_t> randomCode(uint32_t seed, std::size_t size)
+{
+	std::mt19937 rng(seed);
+	std::vector<uint8_t> code(size);
+	for (auto& b : code)
+	{
+		b = (uint8_t)rng();
+	}
+	return code;
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		return false;
+	}
+	uint8_t buf[65536];
+	std::size_t n;
+	while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+	{
+		data.insert(data.end(), buf, buf + n);
+	}
+	fclose(f);
+	return true;
+}
+
+//ELF文件只取.text,其他格式使用整个文件
+static void extractText(std::vector<uint8_t>& data)
+{
+#ifdef __linux__
+	if (data.size() < sizeof(Elf64_Ehdr) || memcmp(data.data(), ELFMAG, SELFMAG) != 0 || data[EI_CLASS] != ELFCLASS64)
+	{
+		return;
+	}
+
+	Elf64_Ehdr ehdr;
+	memcpy(&ehdr, data.data(), sizeof ehdr);
+	if (ehdr.e_shoff + (uint64_t)ehdr.e_shnum * sizeof(Elf64_Shdr) > data.size() || ehdr.e_shstrndx >= ehdr.e_shnum)
+	{
+		return;
+	}
+
+	auto section = [&](int i)
+	{
+		Elf64_Shdr shdr;
+		memcpy(&shdr, data.data() + ehdr.e_shoff + i * sizeof(Elf64_Shdr), sizeof shdr);
+		return shdr;
+	};
+	auto strtab = section(ehdr.e_shstrndx);
+	for (int i = 0; i < ehdr.e_shnum; i++)
+	{
+		auto shdr = section(i);
+		if (strtab.sh_offset + shdr.sh_name + 6 <= data.size()
+			&& strcmp((const char*)data.data() + strtab.sh_offset + shdr.sh_name, ".text") == 0
+			&& shdr.sh_offset + shdr.sh_size <= data.size())
+		{
+			data = std::vector<uint8_t>(data.begin() + shdr.sh_offset, data.begin() + shdr.sh_offset + shdr.sh_size);
+			return;
+		}
+	}
+#else
+	(void)data;
+#endif
+}
+
+//线性扫描一遍,返回指令数
+using Sweep = uint64_t(*)(std::vector<uint8_t> const& code);
+
+static uint64_t sweepDecode(std::vector<uint8_t> const& code)
+{
+	x86dis_insn insn;
+	uint64_t count = 0;
+	for (std::size_t pos = 0; pos < code.size(); pos += insn.size, ++count)
+	{
+		x64dis::decode(code.data() + pos, (int)std::min<std::size_t>(15, code.size() - pos), pos, insn);
+	}
+	return count;
+}
+
+static uint64_t sweepStr(std::vector<uint8_t> const& code)
+{
+	x86dis_insn insn;
+	char text[256];
+	uint64_t count = 0;
+	for (std::size_t pos = 0; pos < code.size(); pos += insn.size, ++count)
+	{
+		x64dis::decode(code.data() + pos, (int)std::min<std::size_t>(15, code.size() - pos), pos, insn);
+		x64dis::str(insn, 0, text, sizeof text);
+	}
+	return count;
+}
+
+static uint64_t sweepLength(std::vector<uint8_t> const& code)
+{
+	uint64_t count = 0;
+	for (std::size_t pos = 0; pos < code.size(); ++count)
+	{
+		pos += x64dis::length(code.data() + pos, (int)std::min<std::size_t>(15, code.size() - pos));
+	}
+	return count;
+}
+
+template <int mode>
+static uint64_t sweepBatch(std::vector<uint8_t> const& code)
+{
+	x86dis_rec recs[512];
+	uint64_t count = 0;
+	std::size_t pos = 0;
+	while (pos < code.size())
+	{
+		auto n = x64dis::decodeBatch(code.data() + pos, code.size() - pos, pos, recs, 512, mode);
+		pos += recs[n - 1].offset + recs[n - 1].size;
+		count += n;
+	}
+	return count;
+}
+
+static Result run(Corpus const& corpus, const char* name, Sweep sweep, int iterations, CacheMissCounter& counter)
+{
+	//预热,同时生成只读的表
+	sweep(corpus.code);
+
+	std::vector<double> times;
+	uint64_t instructions = 0;
+	uint64_t allocations = 0;
+	uint64_t misses = 0;
+	for (int i = 0; i < iterations; i++)
+	{
+		auto allocs = g_allocations.load();
+		counter.start();
+		auto t0 = std::chrono::steady_clock::now();
+		instructions = sweep(corpus.code);
+		auto t1 = std::chrono::steady_clock::now();
+		misses += counter.stop();
+		allocations += g_allocations.load() - allocs;
+		times.push_back(std::chrono::duration<double>(t1 - t0).count());
+	}
+
+	//取中位数
+	std::sort(times.begin(), times.end());
+	Result r;
+	r.corpus = corpus.name;
+	r.bench = name;
+	r.instructions = instructions;
+	r.bytes = corpus.code.size();
+	r.seconds = times[times.size() / 2];
+	r.allocations = allocations / iterations;
+	r.cacheMisses = misses / iterations;
+	return r;
+}
+
+//length()和decodeBatch()的长度模式与decode()逐字节对比
+static uint64_t verify(Corpus const& corpus, uint64_t& checked)
+{
+	uint64_t mismatches = 0;
+	x86dis_insn insn;
+	x86dis_rec rec;
+	auto& code = corpus.code;
+	for (std::size_t pos = 0; pos < code.size(); ++pos)
+	{
+		auto maxlen = (int)std::min<std::size_t>(15, code.size() - pos);
+		bool valid = x64dis::decode(code.data() + pos, maxlen, pos, insn);
+		auto len = x64dis::length(code.data() + pos, maxlen);
+		x64dis::decodeBatch(code.data() + pos, code.size() - pos, pos, &rec, 1, X86DIS_BATCH_LENGTH_ONLY);
+		++checked;
+		if (len != insn.size || rec.size != insn.size || valid == !!(rec.flags & X86DIS_REC_INVALID))
+		{
+			if (mismatches++ < 10)
+			{
+				fprintf(stderr, "%s+0x%zx: decode %d, length %d, batch %d\n", corpus.name.c_str(), pos, insn.size, len, rec.size);
+			}
+		}
+	}
+	return mismatches;
+}
+
+static std::string jsonString(std::string const& s)
+{
+	std::string out = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char buf[8];
+			snprintf(buf, sizeof buf, "\\u%04x", c);
+			out += buf;
+		}
+		else
+		{
+			out += c;
+		}
+	}
+	return out + "\"";
+}
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: saber_bench [options] [file...]\n"
+		"  --json <path>       JSON结果写入文件, 默认写到标准输出\n"
+		"  --iterations <n>    每项测试的次数, 默认5\n"
+		"  --size <bytes>      生成的语料大小, 默认4194304\n"
+		"  --seed <n>          生成语料的种子, 默认1\n"
+		"  --verify            对比length()和decode()的长度, 不一致时返回1\n"
+		"  --no-self           不使用saber_bench自身的代码段\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* jsonPath = nullptr;
+	int iterations = 5;
+	std::size_t size = 4 << 20;
+	uint32_t seed = 1;
+	bool doVerify = false;
+	bool useSelf = true;
+	std::vector<const char*> files;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--json" && hasValue)
+		{
+			jsonPath = argv[++i];
+		}
+		else if (arg == "--iterations" && hasValue)
+		{
+			iterations = std::max(1, atoi(argv[++i]));
+		}
+		else if (arg == "--size" && hasValue)
+		{
+			size = std::max<std::size_t>(16, strtoull(argv[++i], nullptr, 0));
+		}
+		else if (arg == "--seed" && hasValue)
+		{
+			seed = (uint32_t)strtoul(argv[++i], nullptr, 0);
+		}
+		else if (arg == "--verify")
+		{
+			doVerify = true;
+		}
+		else if (arg == "--no-self")
+		{
+			useSelf = false;
+		}
+		else if (arg[0] == '-')
+		{
+			usage();
+			return 2;
+		}
+		else
+		{
+			files.push_back(argv[i]);
+		}
+	}
+
+	std::vector<Corpus> corpora;
+	corpora.push_back({ "synthetic", syntheticCode(seed, size) });
+	corpora.push_back({ "random", randomCode(seed, size) });
+
+	std::vector<const char*> paths;
+	if (useSelf)
+	{
+#ifdef __linux__
+		paths.push_back("/proc/self/exe");
+#else
+		paths.push_back(argv[0]);
+#endif
+	}
+	paths.insert(paths.end(), files.begin(), files.end());
+	for (std::size_t i = 0; i < paths.size(); i++)
+	{
+		Corpus c;
+		c.name = (useSelf && i == 0) ? "self" : paths[i];
+		if (!readFile(paths[i], c.code))
+		{
+			fprintf(stderr, "无法读取 %s\n", paths[i]);
+			return 1;
+		}
+		extractText(c.code);
+		if (!c.code.empty())
+		{
+			corpora.push_back(std::move(c));
+		}
+	}
+
+	struct
+	{
+		const char* name;
+		Sweep sweep;
+	} benches[] =
+	{
+		{ "decode", sweepDecode },
+		{ "decode+str", sweepStr },
+		{ "length", sweepLength },
+		{ "batch", sweepBatch<0> },
+		{ "batch_length", sweepBatch<X86DIS_BATCH_LENGTH_ONLY> },
+	};
+
+	CacheMissCounter counter;
+	std::vector<Result> results;
+	for (auto& corpus : corpora)
+	{
+		for (auto& b : benches)
+		{
+			auto r = run(corpus, b.name, b.sweep, iterations, counter);
+			fprintf(stderr, "%-12s %-14s %10.2f Minsn/s %9.2f MB/s  allocs %-6llu misses %llu\n",
+				r.corpus.c_str(), r.bench.c_str(),
+				r.instructions / r.seconds / 1e6, r.bytes / r.seconds / 1e6,
+				(unsigned long long)r.allocations, (unsigned long long)r.cacheMisses);
+			results.push_back(r);
+		}
+	}
+
+	uint64_t checked = 0;
+	uint64_t mismatches = 0;
+	if (doVerify)
+	{
+		for (auto& corpus : corpora)
+		{
+			mismatches += verify(corpus, checked);
+		}
+		fprintf(stderr, "verify: %llu offsets, %llu mismatches\n", (unsigned long long)checked, (unsigned long long)mismatches);
+	}
+
+	FILE* out = jsonPath ? fopen(jsonPath, "w") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "无法写入 %s\n", jsonPath);
+		return 1;
+	}
+
+	fprintf(out, "{\n  \"seed\": %u,\n  \"iterations\": %d,\n  \"corpus\": [\n", seed, iterations);
+	for (std::size_t i = 0; i < corpora.size(); i++)
+	{
+		fprintf(out, "    { \"name\": %s, \"bytes\": %zu }%s\n",
+			jsonString(corpora[i].name).c_str(), corpora[i].code.size(), i + 1 < corpora.size() ? "," : "");
+	}
+	fprintf(out, "  ],\n  \"results\": [\n");
+	for (std::size_t i = 0; i < results.size(); i++)
+	{
+		auto& r = results[i];
+		fprintf(out, "    { \"corpus\": %s, \"bench\": %s, \"instructions\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+			"\"insns_per_sec\": %.0f, \"bytes_per_sec\": %.0f, \"allocations\": %llu, \"cache_misses\": ",
+			jsonString(r.corpus).c_str(), jsonString(r.bench).c_str(),
+			(unsigned long long)r.instructions, (unsigned long long)r.bytes, r.seconds,
+			r.instructions / r.seconds, r.bytes / r.seconds, (unsigned long long)r.allocations);
+		if (counter.available())
+		{
+			fprintf(out, "%llu", (unsigned long long)r.cacheMisses);
+		}
+		else
+		{
+			fprintf(out, "null");
+		}
+		fprintf(out, " }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(out, "  ]");
+	if (doVerify)
+	{
+		fprintf(out, ",\n  \"verify\": { \"checked\": %llu, \"mismatches\": %llu }",
+			(unsigned long long)checked, (unsigned long long)mismatches);
+	}
+	fprintf(out, "\n}\n");
+	if (jsonPath)
+	{
+		fclose(out);
+	}
+
+	return mismatches ? 1 : 0;
+}